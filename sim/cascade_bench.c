@@ -0,0 +1,101 @@
+/*
+ * Float vs fixed point PID cascade benchmark
+ *
+ * Host timings only give a relative indication, the relevant numbers are
+ * the cycle counts of the cascade and current loop stages reported by the
+ * firmware (cvra.ControlLoopTiming) built with and without
+ * USE_FIXED_POINT_CONTROL.
+ *
+ * usage: cascade_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "pid_cascade.h"
+#include "pid_cascade_q31.h"
+
+#define NB_INPUTS 1024
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void configure(struct pid_cascade_s *ctrl)
+{
+    memset(ctrl, 0, sizeof(*ctrl));
+    pid_init(&ctrl->position_pid);
+    pid_init(&ctrl->velocity_pid);
+    pid_init(&ctrl->current_pid);
+    pid_set_gains(&ctrl->position_pid, 15, 0, 0);
+    pid_set_frequency(&ctrl->position_pid, 2083);
+    pid_set_gains(&ctrl->velocity_pid, 2, 60, 0);
+    pid_set_frequency(&ctrl->velocity_pid, 2083);
+    pid_set_gains(&ctrl->current_pid, 3, 10000, 0);
+    pid_set_frequency(&ctrl->current_pid, 25000);
+    ctrl->motor_current_constant = 0.68;
+    ctrl->velocity_limit = 10;
+    ctrl->torque_limit = 5;
+    ctrl->current_limit = INFINITY;
+    ctrl->setpts.position_control_enabled = true;
+    ctrl->setpts.velocity_control_enabled = true;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+    const float position_lsb = 2 * (float)M_PI / (4096 * 49);
+    static float position[NB_INPUTS], velocity[NB_INPUTS], current[NB_INPUTS];
+    static int32_t position_q[NB_INPUTS], velocity_q[NB_INPUTS], current_q[NB_INPUTS];
+    int i;
+    for (i = 0; i < NB_INPUTS; i++) {
+        position_q[i] = q31_from_float(0.1f * sinf(i * 0.01f), position_lsb);
+        position[i] = q31_to_float(position_q[i], position_lsb);
+        velocity[i] = 0.3f * cosf(i * 0.01f);
+        velocity_q[i] = q31_from_float(velocity[i], PID_CASCADE_Q31_VELOCITY_LSB);
+        current[i] = 0.02f * sinf(i * 0.1f); // current loop tracking error
+        current_q[i] = q31_from_float(current[i], PID_CASCADE_Q31_CURRENT_LSB);
+    }
+
+    static struct pid_cascade_s ctrl;
+    static struct pid_cascade_q31_s ctrl_q31;
+    configure(&ctrl);
+    pid_q31_init(&ctrl_q31.position_pid);
+    pid_q31_init(&ctrl_q31.velocity_pid);
+    pid_q31_init(&ctrl_q31.current_pid);
+    pid_cascade_q31_configure(&ctrl_q31, &ctrl, position_lsb);
+    pid_cascade_q31_set_setpoints(&ctrl_q31, &ctrl.setpts);
+
+    long n;
+    double start = now();
+    for (n = 0; n < iterations; n++) {
+        int k = n % NB_INPUTS;
+        ctrl.position = position[k];
+        ctrl.velocity = velocity[k];
+        ctrl.current = ctrl.current_setpoint + current[k];
+        pid_cascade_control(&ctrl);
+    }
+    double float_time = now() - start;
+
+    start = now();
+    for (n = 0; n < iterations; n++) {
+        int k = n % NB_INPUTS;
+        ctrl_q31.position = position_q[k];
+        ctrl_q31.velocity = velocity_q[k];
+        ctrl_q31.current = q31_add(ctrl_q31.current_setpoint, current_q[k]);
+        pid_cascade_q31_control(&ctrl_q31);
+    }
+    double q31_time = now() - start;
+
+    printf("float cascade: %.1f ns/iteration (last output %f)\n",
+           float_time / iterations * 1e9, ctrl.motor_voltage);
+    printf("q31 cascade:   %.1f ns/iteration (last output %f)\n",
+           q31_time / iterations * 1e9,
+           q31_to_float(ctrl_q31.motor_voltage, PID_CASCADE_Q31_VOLTAGE_LSB));
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <math.h>
+#include "kpi.h"
+
+
+void kpi_init(kpi_t *k, float settling_band, float initial_value)
+{
+    k->settling_band = settling_band;
+    k->error_sq_sum = 0;
+    k->current_sq_sum = 0;
+    k->nb_samples = 0;
+    k->max_error = 0;
+    k->max_current = 0;
+    k->start_value = initial_value;
+    k->target = initial_value;
+    k->max_excursion = 0;
+    k->last_target_change = 0;
+    k->last_outside_band = 0;
+}
+
+void kpi_set_target(kpi_t *k, float target, float value, float time)
+{
+    k->start_value = value;
+    k->target = target;
+    k->max_excursion = 0;
+    k->last_target_change = time;
+    k->last_outside_band = time;
+}
+
+void kpi_update(kpi_t *k, float time, float value, float setpoint, float current)
+{
+    float error = value - setpoint;
+    k->error_sq_sum += error * error;
+    k->current_sq_sum += current * current;
+    k->nb_samples++;
+    if (fabsf(error) > k->max_error) {
+        k->max_error = fabsf(error);
+    }
+    if (fabsf(current) > k->max_current) {
+        k->max_current = fabsf(current);
+    }
+
+    float direction = copysignf(1, k->target - k->start_value);
+    float excursion = (value - k->target) * direction;
+    if (excursion > k->max_excursion) {
+        k->max_excursion = excursion;
+    }
+    if (fabsf(value - k->target) > k->settling_band) {
+        k->last_outside_band = time;
+    }
+}
+
+void kpi_get(const kpi_t *k, float time, struct kpi_result *res)
+{
+    if (k->nb_samples > 0) {
+        res->rms_error = sqrt(k->error_sq_sum / k->nb_samples);
+        res->rms_current = sqrt(k->current_sq_sum / k->nb_samples);
+    } else {
+        res->rms_error = 0;
+        res->rms_current = 0;
+    }
+    res->max_error = k->max_error;
+    res->max_current = k->max_current;
+
+    float move = fabsf(k->target - k->start_value);
+    if (move > 0) {
+        res->overshoot = k->max_excursion / move * 100;
+    } else {
+        res->overshoot = 0;
+    }
+
+    // settled if the value stayed within the band over the last 10% of the run
+    if (time - k->last_outside_band > 0.1f * (time - k->last_target_change)) {
+        res->settling_time = k->last_outside_band - k->last_target_change;
+    } else {
+        res->settling_time = -1;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef KPI_H
+#define KPI_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Tracking performance indicators accumulated over a simulation run.
+ * The following error is the difference between the measured and the
+ * interpolated setpoint, settling and overshoot refer to the final target.
+ */
+typedef struct {
+    // configuration
+    float settling_band;        // absolute error band for the settling time
+
+    // accumulators
+    double error_sq_sum;
+    double current_sq_sum;
+    unsigned long nb_samples;
+    float max_error;
+    float max_current;
+    float start_value;          // value at the last target change
+    float target;               // final target
+    float max_excursion;        // in the direction of the move, past target
+    float last_target_change;   // [s]
+    float last_outside_band;    // [s]
+} kpi_t;
+
+struct kpi_result {
+    float rms_error;
+    float max_error;
+    float settling_time;    // [s] after the last target change, negative if not settled
+    float overshoot;        // [%] of the last move
+    float max_current;      // [A]
+    float rms_current;      // [A]
+};
+
+
+void kpi_init(kpi_t *k, float settling_band, float initial_value);
+void kpi_set_target(kpi_t *k, float target, float value, float time);
+void kpi_update(kpi_t *k, float time, float value, float setpoint, float current);
+void kpi_get(const kpi_t *k, float time, struct kpi_result *res);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KPI_H */
@@ -0,0 +1,67 @@
+#include <math.h>
+#include "motor_model.h"
+
+
+static double deadzone(double x, double half_width)
+{
+    if (x > half_width) {
+        return x - half_width;
+    }
+    if (x < -half_width) {
+        return x + half_width;
+    }
+    return 0;
+}
+
+void motor_model_init(motor_model_t *m, const struct motor_model_params *p)
+{
+    m->p = *p;
+    m->current = 0;
+    m->motor_position = 0;
+    m->motor_velocity = 0;
+    m->load_position = 0;
+    m->load_velocity = 0;
+    m->gear_torque = 0;
+}
+
+void motor_model_step(motor_model_t *m, double u, double dt)
+{
+    const struct motor_model_params *p = &m->p;
+
+    // gearbox
+    double twist = deadzone(m->motor_position / p->gear_ratio - m->load_position,
+                            p->backlash / 2);
+    double tau_g = 0;
+    if (twist != 0) {
+        tau_g = p->stiffness * twist
+              + p->damping * (m->motor_velocity / p->gear_ratio - m->load_velocity);
+        // the gear teeth can only push
+        if (tau_g * twist < 0) {
+            tau_g = 0;
+        }
+    }
+    m->gear_torque = tau_g;
+
+    // electrical, semi-implicit in the current for stability with small L
+    double di = (u - p->R * m->current - p->Kt * m->motor_velocity) / p->L * dt;
+    m->current += di / (1 + p->R / p->L * dt);
+
+    // rotor
+    double motor_acc = (p->Kt * m->current - tau_g / p->gear_ratio) / p->J_motor;
+    m->motor_velocity += motor_acc * dt;
+    m->motor_position += m->motor_velocity * dt;
+
+    // load, coulomb friction sticks when it would reverse the velocity
+    double tau_load = tau_g - p->viscous * m->load_velocity;
+    double load_velocity = m->load_velocity;
+    if (load_velocity != 0) {
+        load_velocity += (tau_load - copysign(p->coulomb, load_velocity)) / p->J_load * dt;
+        if (load_velocity * m->load_velocity < 0) {
+            load_velocity = 0;
+        }
+    } else if (fabs(tau_load) > p->coulomb) {
+        load_velocity += (tau_load - copysign(p->coulomb, tau_load)) / p->J_load * dt;
+    }
+    m->load_velocity = load_velocity;
+    m->load_position += m->load_velocity * dt;
+}
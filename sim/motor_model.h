@@ -0,0 +1,58 @@
+#ifndef MOTOR_MODEL_H
+#define MOTOR_MODEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DC motor + gearbox + load plant model
+ * =====================================
+ *
+ * electrical:  L di/dt = u - R i - Kt w_m
+ * rotor:       J_m dw_m/dt = Kt i - tau_g / N
+ * load:        J_l dw_l/dt = tau_g - b w_l - tau_coulomb
+ *
+ * The gearbox (ratio N = motor revolutions per output revolution) is a
+ * stiff spring with damping acting across a backlash dead zone:
+ * tau_g = k * deadzone(th_m / N - th_l) + c * (w_m / N - w_l) when engaged.
+ * The PWM switching ripple is not modeled, u is the period average.
+ */
+
+struct motor_model_params {
+    double R;           // [Ohm] winding resistance
+    double L;           // [H] winding inductance
+    double Kt;          // [Nm/A] torque constant (= back EMF constant [Vs/rad])
+    double J_motor;     // [kg m^2] rotor inertia
+    double gear_ratio;  // motor revolutions per output revolution
+    double J_load;      // [kg m^2] load inertia at the output
+    double viscous;     // [Nm s/rad] viscous friction at the output
+    double coulomb;     // [Nm] coulomb friction at the output
+    double backlash;    // [rad] total backlash at the output
+    double stiffness;   // [Nm/rad] gearbox stiffness at the output
+    double damping;     // [Nm s/rad] gearbox damping at the output
+};
+
+typedef struct {
+    struct motor_model_params p;
+    double current;             // [A]
+    double motor_position;      // [rad] rotor angle
+    double motor_velocity;      // [rad/s]
+    double load_position;       // [rad] output angle
+    double load_velocity;       // [rad/s]
+    double gear_torque;         // [Nm] torque transmitted to the load
+} motor_model_t;
+
+
+void motor_model_init(motor_model_t *m, const struct motor_model_params *p);
+
+/* Advances the model by dt [s] with the motor voltage u [V] applied. dt must
+ * be small compared to the electrical (L/R) and gearbox time constants. */
+void motor_model_step(motor_model_t *m, double u, double dt);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MOTOR_MODEL_H */
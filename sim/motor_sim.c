@@ -0,0 +1,595 @@
+/*
+ * Closed loop motor control simulation
+ * ====================================
+ *
+ * Runs the firmware control modules (feedback, setpoint, pid_cascade,
+ * motor_protection) against the DC motor plant model in virtual time and
+ * prints tracking KPIs for a scripted trajectory.
+ *
+ * The loop structure mirrors control.c: the current loop runs at the PWM
+ * frequency and skips the charge pump recharge periods, the velocity and
+ * position loops are decimated.
+ *
+ * usage: motor_sim [name=value ...]
+ * Controller settings use the firmware parameter names (for example
+ * control/velocity/kp=0.5), see the config table below for all names.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "feedback.h"
+#include "feedforward.h"
+#include "setpoint.h"
+#include "trajectory_buffer.h"
+#include "pid_cascade.h"
+#include "motor_protection.h"
+#include "timestamp/timestamp.h"
+#include "motor_model.h"
+#include "kpi.h"
+
+#define PWM_FREQUENCY               25000
+#define PLANT_STEPS_PER_PWM_PERIOD  40      // 1us integration step
+#define ADC_SAMPLES_PER_PWM_PERIOD  19
+#define RECHARGE_PERIOD             50      // 25kHz / 500Hz charge pump recharge
+#define RECHARGE_HOLDOFF_PERIODS    6
+#define MAX_DUTY_CYCLE              0.95
+#define ADC_MAX                     4096
+#define ADC_TO_AMPS                 0.001611328125 // 3.3/4096/(0.01*50)
+#define MAX_MESSAGES_IN_FLIGHT      64
+
+enum scenario {
+    SCENARIO_STEP,          // position step
+    SCENARIO_VELOCITY,      // velocity steps forth and back
+    SCENARIO_TRAJECTORY,    // sine trajectory streamed at traj_rate
+    SCENARIO_BUFFERED,      // same, as buffered trajectory points
+};
+
+static const char *scenario_names[] = {"step", "velocity", "trajectory", "buffered"};
+
+static struct {
+    struct motor_model_params plant;
+    double battery_voltage;     // [V]
+    double current_noise;       // [ADC LSB] rms
+    double encoder_ticks;       // per motor revolution
+    double output_encoder_ticks; // per output revolution
+    double pot_gain;            // [rad] per unit of potentiometer input
+    double feedback;            // enum feedback_input_selection
+    double edge_timing;         // primary encoder velocity from edge timing
+
+    double current_kp, current_ki, current_kd, current_i_limit;
+    double velocity_kp, velocity_ki, velocity_kd, velocity_i_limit;
+    double position_kp, position_ki, position_kd, position_i_limit;
+    double velocity_divider;
+    double position_divider;
+    double velocity_limit;
+    double torque_limit;
+    double acceleration_limit;
+    double torque_cst;          // [A/Nm] at the output
+    double ff_inertia, ff_viscous, ff_coulomb, ff_coulomb_band, ff_offset, ff_gravity;
+
+    double scenario;
+    double duration;            // [s]
+    double amplitude;           // [rad] or [rad/s]
+    double frequency;           // [Hz] of the trajectory sine
+    double traj_rate;           // [Hz] trajectory message rate
+    double traj_delay;          // [s] trajectory transmission delay
+    double traj_jitter;         // [s] additional uniformly distributed delay
+    double playout_delay;       // [s] of the buffered trajectory
+    double settling_band;
+    double seed;
+} cfg = {
+    .plant = {
+        .R = 2.0,
+        .L = 0.5e-3,
+        .Kt = 0.03,
+        .J_motor = 1e-5,
+        .gear_ratio = 49,
+        .J_load = 1e-3,
+        .viscous = 0.01,
+        .coulomb = 0.05,
+        .backlash = 0.005,
+        .stiffness = 500,
+        .damping = 0.5,
+    },
+    .battery_voltage = 18,
+    .current_noise = 2,
+    .encoder_ticks = 2048,
+    .output_encoder_ticks = 4096,
+    .pot_gain = 2 * M_PI,
+    .feedback = FEEDBACK_PRIMARY_ENCODER_BOUNDED,
+    .edge_timing = 0,
+
+    .current_kp = 3, .current_ki = 10000, .current_kd = 0, .current_i_limit = INFINITY,
+    .velocity_kp = 2, .velocity_ki = 60, .velocity_kd = 0, .velocity_i_limit = INFINITY,
+    .position_kp = 15, .position_ki = 0, .position_kd = 0, .position_i_limit = INFINITY,
+    .velocity_divider = 12,
+    .position_divider = 1,
+    .velocity_limit = 10,
+    .torque_limit = 5,
+    .acceleration_limit = 100,
+    .torque_cst = 1 / (0.03 * 49),
+    .ff_coulomb_band = 0.1,
+
+    .scenario = SCENARIO_STEP,
+    .duration = 2,
+    .amplitude = 1,
+    .frequency = 1,
+    .traj_rate = 100,
+    .traj_delay = 0.001,
+    .traj_jitter = 0,
+    .playout_delay = 0.02,
+    .settling_band = 0.01,
+    .seed = 1,
+};
+
+static const struct {
+    const char *name;
+    double *value;
+} config_table[] = {
+    {"plant/R", &cfg.plant.R},
+    {"plant/L", &cfg.plant.L},
+    {"plant/Kt", &cfg.plant.Kt},
+    {"plant/J_motor", &cfg.plant.J_motor},
+    {"plant/gear_ratio", &cfg.plant.gear_ratio},
+    {"plant/J_load", &cfg.plant.J_load},
+    {"plant/viscous", &cfg.plant.viscous},
+    {"plant/coulomb", &cfg.plant.coulomb},
+    {"plant/backlash", &cfg.plant.backlash},
+    {"plant/stiffness", &cfg.plant.stiffness},
+    {"plant/damping", &cfg.plant.damping},
+    {"plant/battery_voltage", &cfg.battery_voltage},
+    {"sensor/current_noise", &cfg.current_noise},
+    {"sensor/encoder_ticks", &cfg.encoder_ticks},
+    {"sensor/output_encoder_ticks", &cfg.output_encoder_ticks},
+    {"sensor/pot_gain", &cfg.pot_gain},
+    {"sensor/feedback", &cfg.feedback},
+    {"feedback/primary_encoder_edge_timing", &cfg.edge_timing},
+    {"control/current/kp", &cfg.current_kp},
+    {"control/current/ki", &cfg.current_ki},
+    {"control/current/kd", &cfg.current_kd},
+    {"control/current/i_limit", &cfg.current_i_limit},
+    {"control/velocity/kp", &cfg.velocity_kp},
+    {"control/velocity/ki", &cfg.velocity_ki},
+    {"control/velocity/kd", &cfg.velocity_kd},
+    {"control/velocity/i_limit", &cfg.velocity_i_limit},
+    {"control/velocity/divider", &cfg.velocity_divider},
+    {"control/position/kp", &cfg.position_kp},
+    {"control/position/ki", &cfg.position_ki},
+    {"control/position/kd", &cfg.position_kd},
+    {"control/position/i_limit", &cfg.position_i_limit},
+    {"control/position/divider", &cfg.position_divider},
+    {"control/velocity_limit", &cfg.velocity_limit},
+    {"control/torque_limit", &cfg.torque_limit},
+    {"control/acceleration_limit", &cfg.acceleration_limit},
+    {"control/feedforward/inertia", &cfg.ff_inertia},
+    {"control/feedforward/viscous", &cfg.ff_viscous},
+    {"control/feedforward/coulomb", &cfg.ff_coulomb},
+    {"control/feedforward/coulomb_band", &cfg.ff_coulomb_band},
+    {"control/feedforward/offset", &cfg.ff_offset},
+    {"control/feedforward/gravity", &cfg.ff_gravity},
+    {"motor/torque_cst", &cfg.torque_cst},
+    {"sim/scenario", &cfg.scenario},
+    {"sim/duration", &cfg.duration},
+    {"sim/amplitude", &cfg.amplitude},
+    {"sim/frequency", &cfg.frequency},
+    {"sim/traj_rate", &cfg.traj_rate},
+    {"sim/traj_delay", &cfg.traj_delay},
+    {"sim/traj_jitter", &cfg.traj_jitter},
+    {"control/trajectory/playout_delay", &cfg.playout_delay},
+    {"sim/settling_band", &cfg.settling_band},
+    {"sim/seed", &cfg.seed},
+};
+
+#define CONFIG_TABLE_SIZE (sizeof(config_table) / sizeof(config_table[0]))
+
+
+/* Virtual time, replaces the hardware timer of the firmware */
+static timestamp_t sim_time_us;
+
+timestamp_t timestamp_get(void)
+{
+    return sim_time_us;
+}
+
+
+static double gaussian_noise(void)
+{
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static int adc_current_sample(double current)
+{
+    int sample = lround(ADC_MAX / 2 - current / ADC_TO_AMPS
+                        + cfg.current_noise * gaussian_noise());
+    if (sample < 0) {
+        return 0;
+    }
+    if (sample >= ADC_MAX) {
+        return ADC_MAX - 1;
+    }
+    return sample;
+}
+
+/*
+ * Trajectory messages sent every 1 / traj_rate and received traj_delay plus
+ * up to traj_jitter later, possibly reordered.
+ */
+static struct {
+    double send_time[MAX_MESSAGES_IN_FLIGHT];
+    double receive_time[MAX_MESSAGES_IN_FLIGHT];
+    int count;
+    double next_send_time;
+} traj_link;
+
+static void traj_link_send(double t)
+{
+    while (traj_link.next_send_time <= t && traj_link.count < MAX_MESSAGES_IN_FLIGHT) {
+        double jitter = cfg.traj_jitter * rand() / RAND_MAX;
+        traj_link.send_time[traj_link.count] = traj_link.next_send_time;
+        traj_link.receive_time[traj_link.count] = traj_link.next_send_time
+                                                  + cfg.traj_delay + jitter;
+        traj_link.count++;
+        traj_link.next_send_time += 1 / cfg.traj_rate;
+    }
+}
+
+// returns true and the send time of a message received before t
+static bool traj_link_receive(double t, double *send_time)
+{
+    int i;
+    for (i = 0; i < traj_link.count; i++) {
+        if (traj_link.receive_time[i] <= t) {
+            *send_time = traj_link.send_time[i];
+            traj_link.count--;
+            traj_link.send_time[i] = traj_link.send_time[traj_link.count];
+            traj_link.receive_time[i] = traj_link.receive_time[traj_link.count];
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t encoder_counts(double position, double ticks_per_rev)
+{
+    return (uint16_t)(int64_t)floor(position / (2 * M_PI) * ticks_per_rev);
+}
+
+static void pid_configure(pid_ctrl_t *pid, double kp, double ki, double kd,
+                          double i_limit, float frequency)
+{
+    pid_init(pid);
+    pid_set_gains(pid, kp, ki, kd);
+    pid_set_integral_limit(pid, i_limit);
+    pid_set_frequency(pid, frequency);
+}
+
+static int parse_arguments(int argc, char **argv, const char **trace_file)
+{
+    int i;
+    unsigned j;
+    for (i = 1; i < argc; i++) {
+        char *value = strchr(argv[i], '=');
+        if (value == NULL) {
+            return -1;
+        }
+        *value++ = '\0';
+        if (strcmp(argv[i], "sim/trace") == 0) {
+            *trace_file = value;
+            continue;
+        }
+        if (strcmp(argv[i], "sim/scenario") == 0) {
+            for (j = 0; j < sizeof(scenario_names) / sizeof(scenario_names[0]); j++) {
+                if (strcmp(value, scenario_names[j]) == 0) {
+                    cfg.scenario = j;
+                    break;
+                }
+            }
+            if (j == sizeof(scenario_names) / sizeof(scenario_names[0])) {
+                fprintf(stderr, "unknown scenario %s\n", value);
+                return -1;
+            }
+            continue;
+        }
+        for (j = 0; j < CONFIG_TABLE_SIZE; j++) {
+            if (strcmp(argv[i], config_table[j].name) == 0) {
+                *config_table[j].value = atof(value);
+                break;
+            }
+        }
+        if (j == CONFIG_TABLE_SIZE) {
+            fprintf(stderr, "unknown setting %s\n", argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void print_usage(void)
+{
+    unsigned i;
+    fprintf(stderr, "usage: motor_sim [name=value ...]\n");
+    fprintf(stderr, "  sim/scenario = step | velocity | trajectory | buffered\n");
+    fprintf(stderr, "  sim/trace = <csv file>\n");
+    for (i = 0; i < CONFIG_TABLE_SIZE; i++) {
+        fprintf(stderr, "  %s = %g\n", config_table[i].name, *config_table[i].value);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *trace_file = NULL;
+    if (parse_arguments(argc, argv, &trace_file) != 0) {
+        print_usage();
+        return 1;
+    }
+    srand((unsigned)cfg.seed);
+
+    FILE *trace = NULL;
+    if (trace_file != NULL) {
+        trace = fopen(trace_file, "w");
+        if (trace == NULL) {
+            perror(trace_file);
+            return 1;
+        }
+        fprintf(trace, "time,position_setpoint,position,velocity_setpoint,"
+                       "velocity,current_setpoint,current,motor_voltage\n");
+    }
+
+    motor_model_t plant;
+    motor_model_init(&plant, &cfg.plant);
+
+    const int velocity_divider = cfg.velocity_divider < 1 ? 1 : cfg.velocity_divider;
+    const int position_divider = cfg.position_divider < 1 ? 1 : cfg.position_divider;
+    const float velocity_loop_frequency = PWM_FREQUENCY / (float)velocity_divider;
+    const float delta_t = 1 / velocity_loop_frequency;
+
+    static struct pid_cascade_s ctrl;
+    pid_configure(&ctrl.current_pid, cfg.current_kp, cfg.current_ki,
+                  cfg.current_kd, cfg.current_i_limit, PWM_FREQUENCY);
+    pid_configure(&ctrl.velocity_pid, cfg.velocity_kp, cfg.velocity_ki,
+                  cfg.velocity_kd, cfg.velocity_i_limit, velocity_loop_frequency);
+    pid_configure(&ctrl.position_pid, cfg.position_kp, cfg.position_ki,
+                  cfg.position_kd, cfg.position_i_limit,
+                  velocity_loop_frequency / position_divider);
+    ctrl.motor_current_constant = cfg.torque_cst;
+    ctrl.velocity_limit = cfg.velocity_limit;
+    ctrl.torque_limit = cfg.torque_limit;
+    ctrl.current_limit = INFINITY;
+
+    setpoint_interpolator_t setpoint_interpolation;
+    setpoint_init(&setpoint_interpolation);
+    setpoint_set_velocity_limit(&setpoint_interpolation, cfg.velocity_limit);
+    setpoint_set_acceleration_limit(&setpoint_interpolation, cfg.acceleration_limit);
+
+    // same time base mapping as control_queue_trajectory_point()
+    static trajectory_buffer_t trajectory_buffer;
+    trajectory_buffer_init(&trajectory_buffer);
+    if (cfg.scenario == SCENARIO_BUFFERED) {
+        setpoint_set_trajectory_buffer(&setpoint_interpolation, &trajectory_buffer);
+    }
+    uint32_t traj_time_offset = 0;
+
+    feedforward_t feedforward = {
+        .inertia = cfg.ff_inertia,
+        .viscous = cfg.ff_viscous,
+        .coulomb = cfg.ff_coulomb,
+        .coulomb_band = cfg.ff_coulomb_band,
+        .offset = cfg.ff_offset,
+        .gravity = cfg.ff_gravity,
+    };
+
+    static struct feedback_s feedback;
+    feedback.input_selection = (enum feedback_input_selection)cfg.feedback;
+    feedback.primary_encoder.transmission_p = 1;
+    feedback.primary_encoder.transmission_q = cfg.plant.gear_ratio;
+    feedback.primary_encoder.ticks_per_rev = cfg.encoder_ticks;
+    feedback.secondary_encoder.transmission_p = 1;
+    feedback.secondary_encoder.transmission_q = 1;
+    feedback.secondary_encoder.ticks_per_rev = cfg.output_encoder_ticks;
+    feedback.potentiometer.gain = cfg.pot_gain;
+    feedback.potentiometer.zero = 0;
+    feedback.primary_encoder.velocity_edge_timing = (cfg.edge_timing != 0);
+    velocity_estimator_reset(&feedback.primary_encoder.velocity_estimator);
+    struct encoder_edge_s primary_encoder_edge = {0, 0};
+    const float velocity_filter_gain = feedback_velocity_is_edge_timed(&feedback) ? 1 : 0.1;
+
+    motor_protection_t protection;
+    motor_protection_init(&protection, 100, 10, 10, 1);
+
+    const bool velocity_scenario = (cfg.scenario == SCENARIO_VELOCITY);
+    kpi_t kpi;
+    kpi_init(&kpi, cfg.settling_band, 0);
+
+    const long nb_periods = cfg.duration * PWM_FREQUENCY;
+    const double plant_dt = 1.0 / PWM_FREQUENCY / PLANT_STEPS_PER_PWM_PERIOD;
+    const long command_time = 0.1 * PWM_FREQUENCY;
+    bool current_control_en = false;
+    double motor_voltage = 0;
+    int velocity_loop_counter = 0;
+    int position_loop_counter = velocity_divider; // run on the first cycle
+    clock_t wall_clock_start = clock();
+
+    long period;
+    for (period = 0; period < nb_periods; period++) {
+        double t = (double)period / PWM_FREQUENCY;
+        sim_time_us = t * 1000000;
+
+        // plant, sampling the ADC during the period
+        int adc_accumulator = 0;
+        int adc_nb_samples = 0;
+        int k;
+        for (k = 0; k < PLANT_STEPS_PER_PWM_PERIOD; k++) {
+            motor_model_step(&plant, motor_voltage, plant_dt);
+            if (k * ADC_SAMPLES_PER_PWM_PERIOD / PLANT_STEPS_PER_PWM_PERIOD
+                    >= adc_nb_samples) {
+                adc_accumulator += adc_current_sample(plant.current);
+                adc_nb_samples++;
+            }
+        }
+
+        // current loop, PWM interrupt
+        encoder_edge_sample(&primary_encoder_edge,
+                            encoder_counts(plant.motor_position, cfg.encoder_ticks),
+                            period);
+        bool recharging = (period % RECHARGE_PERIOD) < RECHARGE_HOLDOFF_PERIODS;
+        if (!recharging) {
+            ctrl.current = -((float)adc_accumulator / adc_nb_samples - ADC_MAX / 2) * ADC_TO_AMPS;
+            if (current_control_en) {
+                pid_cascade_current_control(&ctrl);
+                double duty = ctrl.motor_voltage / cfg.battery_voltage;
+                if (duty > MAX_DUTY_CYCLE) {
+                    duty = MAX_DUTY_CYCLE;
+                } else if (duty < -MAX_DUTY_CYCLE) {
+                    duty = -MAX_DUTY_CYCLE;
+                }
+                motor_voltage = duty * cfg.battery_voltage;
+            } else {
+                pid_reset_integral(&ctrl.current_pid);
+            }
+        }
+
+        velocity_loop_counter++;
+        if (velocity_loop_counter < velocity_divider) {
+            continue;
+        }
+        velocity_loop_counter = 0;
+
+        // scripted commands
+        switch ((int)cfg.scenario) {
+            case SCENARIO_STEP:
+                if (period < command_time) {
+                    setpoint_update_position(&setpoint_interpolation, 0,
+                                             ctrl.position, ctrl.velocity);
+                } else if (kpi.target != (float)cfg.amplitude) {
+                    setpoint_update_position(&setpoint_interpolation, cfg.amplitude,
+                                             ctrl.position, ctrl.velocity);
+                    kpi_set_target(&kpi, cfg.amplitude, plant.load_position, t);
+                }
+                break;
+            case SCENARIO_VELOCITY:
+                if (period < command_time) {
+                    setpoint_update_velocity(&setpoint_interpolation, 0, ctrl.velocity);
+                } else if (period < nb_periods / 2) {
+                    setpoint_update_velocity(&setpoint_interpolation, cfg.amplitude, ctrl.velocity);
+                    if (kpi.target != (float)cfg.amplitude) {
+                        kpi_set_target(&kpi, cfg.amplitude, plant.load_velocity, t);
+                    }
+                } else {
+                    setpoint_update_velocity(&setpoint_interpolation, -cfg.amplitude, ctrl.velocity);
+                    if (kpi.target != (float)-cfg.amplitude) {
+                        kpi_set_target(&kpi, -cfg.amplitude, plant.load_velocity, t);
+                    }
+                }
+                break;
+            case SCENARIO_TRAJECTORY:
+            case SCENARIO_BUFFERED: {
+                double w = 2 * M_PI * cfg.frequency;
+                double ts;
+                traj_link_send(t);
+                while (traj_link_receive(t, &ts)) {
+                    float pos = cfg.amplitude * sin(w * ts);
+                    float vel = cfg.amplitude * w * cos(w * ts);
+                    float acc = -cfg.amplitude * w * w * sin(w * ts);
+                    uint32_t ts_us = ts * 1000000;
+                    if (cfg.scenario == SCENARIO_TRAJECTORY) {
+                        // stamped with the reception time like the firmware
+                        setpoint_update_trajectory(&setpoint_interpolation,
+                                                   pos, vel, acc, 0, sim_time_us);
+                        continue;
+                    }
+                    if (trajectory_buffer_count(&trajectory_buffer) == 0) {
+                        traj_time_offset = sim_time_us + cfg.playout_delay * 1000000 - ts_us;
+                    }
+                    struct trajectory_point_s point = {
+                        ts_us + traj_time_offset, pos, vel, acc, 0
+                    };
+                    trajectory_buffer_push(&trajectory_buffer, &point);
+                }
+                break;
+            }
+        }
+
+        // velocity & position loops, control thread
+        feedback.input.potentiometer = plant.load_position / cfg.pot_gain
+                                       + 1e-4 * gaussian_noise();
+        feedback.input.primary_encoder = encoder_counts(plant.motor_position, cfg.encoder_ticks);
+        feedback.input.secondary_encoder = encoder_counts(plant.load_position, cfg.output_encoder_ticks);
+        feedback.input.delta_t = delta_t;
+        feedback.input.primary_encoder_edge = primary_encoder_edge;
+        feedback.input.time = period;
+        feedback.input.time_lsb = 1.f / PWM_FREQUENCY;
+        if (period < velocity_divider) {
+            feedback.primary_encoder.previous = feedback.input.primary_encoder;
+            feedback.secondary_encoder.previous = feedback.input.secondary_encoder;
+        }
+
+        feedback_compute(&feedback);
+
+        ctrl.periodic_actuator = feedback.output.actuator_is_periodic;
+        ctrl.position = feedback.output.position;
+        ctrl.velocity = ctrl.velocity * (1 - velocity_filter_gain)
+                        + feedback.output.velocity * velocity_filter_gain;
+
+        motor_protection_update(&protection, ctrl.current, delta_t);
+        setpoint_compute(&setpoint_interpolation, &ctrl.setpts, delta_t);
+        ctrl.setpts.feedforward_torque += feedforward_torque(&feedforward, &ctrl.setpts);
+
+        position_loop_counter++;
+        if (position_loop_counter >= position_divider) {
+            position_loop_counter = 0;
+            pid_cascade_position_control(&ctrl);
+        }
+        pid_cascade_velocity_control(&ctrl);
+        current_control_en = true;
+
+        // evaluation on the true plant output
+        if (velocity_scenario) {
+            kpi_update(&kpi, t, plant.load_velocity, ctrl.setpts.velocity_setpt, plant.current);
+        } else {
+            kpi_update(&kpi, t, plant.load_position, ctrl.setpts.position_setpt, plant.current);
+        }
+
+        if (trace != NULL) {
+            fprintf(trace, "%f,%f,%f,%f,%f,%f,%f,%f\n", t,
+                    ctrl.setpts.position_setpt, plant.load_position,
+                    ctrl.setpts.velocity_setpt, plant.load_velocity,
+                    ctrl.current_setpoint, plant.current, motor_voltage);
+        }
+    }
+
+    double wall_clock = (double)(clock() - wall_clock_start) / CLOCKS_PER_SEC;
+    struct kpi_result res;
+    kpi_get(&kpi, cfg.duration, &res);
+
+    const char *unit = velocity_scenario ? "rad/s" : "rad";
+    printf("scenario:              %s\n", scenario_names[(int)cfg.scenario]);
+    printf("simulated time:        %.3f s (%.3f s wall clock)\n", cfg.duration, wall_clock);
+    printf("rms following error:   %.6f %s\n", res.rms_error, unit);
+    printf("max following error:   %.6f %s\n", res.max_error, unit);
+    if (cfg.scenario == SCENARIO_TRAJECTORY || cfg.scenario == SCENARIO_BUFFERED) {
+        printf("settling time:         n/a\n");
+        printf("overshoot:             n/a\n");
+    } else if (res.settling_time < 0) {
+        printf("settling time:         not settled\n");
+        printf("overshoot:             %.2f %%\n", res.overshoot);
+    } else {
+        printf("settling time:         %.4f s\n", res.settling_time);
+        printf("overshoot:             %.2f %%\n", res.overshoot);
+    }
+    printf("max current:           %.3f A\n", res.max_current);
+    printf("rms current:           %.3f A\n", res.rms_current);
+    if (cfg.scenario == SCENARIO_BUFFERED) {
+        printf("buffer underruns:      %u\n", (unsigned)setpoint_interpolation.traj_underruns);
+    }
+
+    if (trace != NULL) {
+        fclose(trace);
+    }
+    return 0;
+}
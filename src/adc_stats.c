@@ -0,0 +1,219 @@
+#include <string.h>
+#include "adc_stats.h"
+
+/*
+ * Dual 16bit operations, the DSP extension instructions on Cortex-M4 and
+ * equivalent C for the host tests. x and y hold two 16bit lanes.
+ */
+
+#define LANES_ONE   0x00010001u
+
+#if defined(__ARM_FEATURE_DSP)
+
+// acc + x.lo * y.lo + x.hi * y.hi, signed lanes
+static inline uint32_t smlad(uint32_t x, uint32_t y, uint32_t acc)
+{
+    uint32_t r;
+    __asm__ ("smlad %0, %1, %2, %3" : "=r" (r) : "r" (x), "r" (y), "r" (acc));
+    return r;
+}
+
+static inline uint32_t ssub16(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("ssub16 %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+
+static inline uint32_t uadd16(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("uadd16 %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+
+// x.hi in the high lane, y.hi in the low lane
+static inline uint32_t pack_high(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("pkhtb %0, %1, %2, asr #16" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+
+// x.lo in the low lane, y.lo in the high lane
+static inline uint32_t pack_low(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+
+// unsigned lanes, sel uses the GE flags of the usub16
+static inline uint32_t umax16(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("usub16 %0, %1, %2\n\t"
+             "sel %0, %1, %2" : "=&r" (r) : "r" (x), "r" (y) : "cc");
+    return r;
+}
+
+static inline uint32_t umin16(uint32_t x, uint32_t y)
+{
+    uint32_t r;
+    __asm__ ("usub16 %0, %1, %2\n\t"
+             "sel %0, %2, %1" : "=&r" (r) : "r" (x), "r" (y) : "cc");
+    return r;
+}
+
+#else
+
+static inline uint32_t smlad(uint32_t x, uint32_t y, uint32_t acc)
+{
+    return acc + (int16_t)x * (int16_t)y + (int16_t)(x >> 16) * (int16_t)(y >> 16);
+}
+
+static inline uint32_t ssub16(uint32_t x, uint32_t y)
+{
+    uint16_t lo = (int16_t)x - (int16_t)y;
+    uint16_t hi = (int16_t)(x >> 16) - (int16_t)(y >> 16);
+    return lo | ((uint32_t)hi << 16);
+}
+
+static inline uint32_t uadd16(uint32_t x, uint32_t y)
+{
+    uint16_t lo = (uint16_t)x + (uint16_t)y;
+    uint16_t hi = (uint16_t)(x >> 16) + (uint16_t)(y >> 16);
+    return lo | ((uint32_t)hi << 16);
+}
+
+static inline uint32_t pack_high(uint32_t x, uint32_t y)
+{
+    return (x & 0xffff0000u) | (y >> 16);
+}
+
+static inline uint32_t pack_low(uint32_t x, uint32_t y)
+{
+    return (x & 0xffffu) | (y << 16);
+}
+
+static inline uint16_t max_u16(uint16_t a, uint16_t b)
+{
+    return a > b ? a : b;
+}
+
+static inline uint16_t min_u16(uint16_t a, uint16_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline uint32_t umax16(uint32_t x, uint32_t y)
+{
+    return max_u16(x, y) | ((uint32_t)max_u16(x >> 16, y >> 16) << 16);
+}
+
+static inline uint32_t umin16(uint32_t x, uint32_t y)
+{
+    return min_u16(x, y) | ((uint32_t)min_u16(x >> 16, y >> 16) << 16);
+}
+
+#endif
+
+static inline uint32_t load_word(const uint16_t *p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+void adc_stats_compute(struct adc_stats_s *stats,
+                       const uint16_t *samples,
+                       size_t nb_samples)
+{
+    const uint32_t mid_scale = ADC_STATS_MID_SCALE * LANES_ONE;
+    uint32_t current_sum = 0;
+    uint32_t current_sq_sum = 0;
+    uint32_t current_min = 0xffffffff;
+    uint32_t current_max = 0;
+    uint32_t battery_sum = 0;
+    uint32_t aux_sum = 0;
+    size_t i;
+
+    // two conversions a and b per iteration, the current samples of both
+    // are packed in one word
+    for (i = 0; i + 1 < nb_samples; i += 2) {
+        const uint16_t *s = &samples[i * ADC_STATS_NB_CHANNELS];
+        uint32_t a0 = load_word(&s[0]);     // aux, current
+        uint32_t a1 = load_word(&s[2]);     // aux, battery
+        uint32_t b0 = load_word(&s[4]);
+        uint32_t b1 = load_word(&s[6]);
+
+        uint32_t current = pack_high(b0, a0);
+        current_max = umax16(current_max, current);
+        current_min = umin16(current_min, current);
+        current = ssub16(current, mid_scale);
+        current_sum = smlad(current, LANES_ONE, current_sum);
+        current_sq_sum = smlad(current, current, current_sq_sum);
+
+        battery_sum = smlad(pack_high(b1, a1), LANES_ONE, battery_sum);
+        aux_sum = smlad(pack_low(uadd16(a0, a1), uadd16(b0, b1)), LANES_ONE, aux_sum);
+    }
+
+    // fold the lanes, with the odd conversion in the high lanes
+    if (i < nb_samples) {
+        const uint16_t *s = &samples[i * ADC_STATS_NB_CHANNELS];
+        uint32_t current = (uint32_t)s[1] << 16;
+        current_max = umax16(current_max, current);
+        current_min = umin16(current_min, current | 0xffffu);
+        current = ssub16(current, ADC_STATS_MID_SCALE << 16);
+        current_sum = smlad(current, LANES_ONE, current_sum);
+        current_sq_sum = smlad(current, current, current_sq_sum);
+        battery_sum += s[3];
+        aux_sum += s[0] + s[2];
+    }
+
+    stats->nb_samples = nb_samples;
+    stats->current_sum = (int32_t)current_sum;
+    stats->current_sq_sum = current_sq_sum;
+    stats->current_max = umax16(current_max, current_max >> 16);
+    stats->current_min = umin16(current_min, current_min >> 16);
+    stats->battery_sum = battery_sum;
+    stats->aux_sum = aux_sum;
+}
+
+int32_t adc_stats_current_sum(const uint16_t *samples, size_t nb_samples)
+{
+    uint32_t sum = 0;
+    size_t i;
+
+    // the raw samples are positive in the signed lanes
+    for (i = 0; i + 1 < nb_samples; i += 2) {
+        const uint16_t *s = &samples[i * ADC_STATS_NB_CHANNELS];
+        sum = smlad(pack_high(load_word(&s[4]), load_word(&s[0])), LANES_ONE, sum);
+    }
+    if (i < nb_samples) {
+        sum += samples[i * ADC_STATS_NB_CHANNELS + 1];
+    }
+    return (int32_t)(sum - nb_samples * ADC_STATS_MID_SCALE);
+}
+
+void adc_stats_merge(struct adc_stats_s *stats, const struct adc_stats_s *other)
+{
+    if (other->nb_samples == 0) {
+        return;
+    }
+    if (stats->nb_samples == 0) {
+        *stats = *other;
+        return;
+    }
+    stats->nb_samples += other->nb_samples;
+    stats->current_sum += other->current_sum;
+    stats->current_sq_sum += other->current_sq_sum;
+    if (other->current_min < stats->current_min) {
+        stats->current_min = other->current_min;
+    }
+    if (other->current_max > stats->current_max) {
+        stats->current_max = other->current_max;
+    }
+    stats->battery_sum += other->battery_sum;
+    stats->aux_sum += other->aux_sum;
+}
@@ -0,0 +1,49 @@
+#ifndef ADC_STATS_H
+#define ADC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Statistics of a block of ADC conversions, computed in a single pass with
+ * the Cortex-M4 SIMD instructions (two 16bit samples per 32bit word).
+ *
+ * A conversion is 4 interleaved samples of the dual ADC:
+ * auxiliary input, motor current, auxiliary input, battery voltage.
+ */
+
+#define ADC_STATS_NB_CHANNELS   4
+#define ADC_STATS_MID_SCALE     2048        // zero motor current
+#define ADC_STATS_MAX_SAMPLES   511         // current_sq_sum fits 31 bits
+
+struct adc_stats_s {
+    uint32_t nb_samples;
+    int32_t current_sum;        // relative to mid scale
+    uint32_t current_sq_sum;    // relative to mid scale
+    uint16_t current_min;       // raw
+    uint16_t current_max;
+    uint32_t battery_sum;
+    uint32_t aux_sum;           // both auxiliary samples
+};
+
+/* statistics of nb_samples conversions */
+void adc_stats_compute(struct adc_stats_s *stats,
+                       const uint16_t *samples,
+                       size_t nb_samples);
+
+/* motor current sum of nb_samples conversions relative to mid scale, the
+ * same as current_sum of adc_stats_compute at a fraction of its cost */
+int32_t adc_stats_current_sum(const uint16_t *samples, size_t nb_samples);
+
+/* adds the samples of other to stats */
+void adc_stats_merge(struct adc_stats_s *stats, const struct adc_stats_s *other);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADC_STATS_H */
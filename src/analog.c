@@ -1,51 +1,193 @@
 #include <ch.h>
 #include <hal.h>
+#include <math.h>
 #include "motor_pwm.h" // to trigger charge pump recharge cycle
 #include "analog.h"
+#include "adc_stats.h"
+#include "thread_stats.h"
+#include "cycle_counter.h"
+#include "control.h"
 
 #define ADC_MAX         4096
 #define ADC_TO_AMPS     0.001611328125f // 3.3/4096/(0.01*50)
 #define ADC_TO_VOLTS    0.005281575521f // 3.3/4096/(18/(100+18))
 
 #define ADC_NB_CHANNELS 4
-#define DMA_BUFFER_SIZE (243*2)         // dual buffer of 243 (see adc timing below)
 
 #define PWM_RECHARGE_COUNTDOWN_RELOAD 4 // 2kHz / 500Hz (500Hz = recharge freq.)
+
+#ifdef ANALOG_PWM_TRIGGERED
+/* One conversion per PWM period, triggered by TIM1 CC3 at the current
+ * sample point set by motor_pwm. Disturbed periods are flagged by the PWM
+ * interrupt. */
+#define DMA_BUFFER_SIZE (ANALOG_PERIODS_PER_CONVERSION_EVENT*2)
+#define NB_SAMPLES_PER_PWM_PERIOD 1
+
+// bit i is set if the conversion i of the buffer is disturbed
+static uint32_t disturbed_conversions;
+#else
+#define DMA_BUFFER_SIZE (243*2)         // dual buffer of 243 (see adc timing below)
 #define IGNORE_NB_SAMPLES_WHEN_RECHARGING 111 // 486kHz sampling freq -> 19.5 samples / pwm period -> ignore first 3 periods + something because of LP
+#define NB_SAMPLES_PER_PWM_PERIOD 19    // 486kHz / 25kHz
+#endif
+
+#define HALF_BUFFER_EVENT   EVENT_MASK(0)
 
 event_source_t analog_event;
 
-static int32_t motor_current_accumulator=0;
-static int32_t motor_current_nb_samples=1;
-static int32_t battery_voltage;
-static int32_t aux_in;
+static adcsample_t adc_samples[ADC_NB_CHANNELS * DMA_BUFFER_SIZE];
+
+// motor current of the last half buffer, summed by the interrupt
+static int32_t motor_current_sum;
+static uint32_t motor_current_nb_samples;
+// statistics of the last half buffer, computed by the adc thread
+static struct adc_stats_s adc_stats;
+// averages, single words to be read from ISRs without lock
+static float battery_voltage;
+static float aux_in;
+
+/* Half buffer handed from the interrupt to the adc thread. The DMA rewrites
+ * it one half buffer later (~0.5ms), the thread runs right after the
+ * interrupt. */
+static thread_t *adc_thread;
+static struct {
+    const adcsample_t *samples;
+    size_t nb;
+#ifdef ANALOG_PWM_TRIGGERED
+    uint32_t disturbed;     // bit i is set if the conversion i is disturbed
+#endif
+} pending_half;
 
 
 float analog_get_battery_voltage(void)
 {
-    return (float)battery_voltage * ADC_TO_VOLTS;
+    return battery_voltage;
 }
 
 float analog_get_motor_current(void)
 {
     chSysLock();
-    int32_t accu = motor_current_accumulator;
-    int32_t nb = motor_current_nb_samples;
+    int32_t sum = motor_current_sum;
+    uint32_t nb = motor_current_nb_samples;
     chSysUnlock();
-    return -(((float)accu / nb) - ADC_MAX / 2) * ADC_TO_AMPS;
+    if (nb == 0) {
+        return 0;
+    }
+    return -((float)sum / nb) * ADC_TO_AMPS;
+}
+
+void analog_get_motor_current_stats(struct analog_current_stats_s *stats)
+{
+    chSysLock();
+    struct adc_stats_s s = adc_stats;
+    chSysUnlock();
+    if (s.nb_samples == 0) {
+        stats->mean = stats->min = stats->max = stats->rms = 0;
+        return;
+    }
+    // the current is inverted, the lowest sample is the highest current
+    stats->mean = -((float)s.current_sum / s.nb_samples) * ADC_TO_AMPS;
+    stats->min = -((float)s.current_max - ADC_MAX / 2) * ADC_TO_AMPS;
+    stats->max = -((float)s.current_min - ADC_MAX / 2) * ADC_TO_AMPS;
+    stats->rms = sqrtf((float)s.current_sq_sum / s.nb_samples) * ADC_TO_AMPS;
+}
+
+// index of the next conversion written to the buffer
+static int next_conversion_index(void)
+{
+    /* The DMA runs in dual mode and transfers one 32bit word (2 samples) at a
+     * time, find the last complete conversion from its remaining count. */
+    uint32_t remaining = dmaStreamGetTransactionSize(ADCD1.dmastp);
+    uint32_t words_done = DMA_BUFFER_SIZE * ADC_NB_CHANNELS / 2 - remaining;
+    return words_done / (ADC_NB_CHANNELS / 2);
+}
+
+int32_t analog_get_motor_current_raw_pwm_period_from_isr(void)
+{
+    int i = next_conversion_index();
+
+    int32_t accumulator = 0;
+    int k;
+    for (k = 0; k < NB_SAMPLES_PER_PWM_PERIOD; k++) {
+        i--;
+        if (i < 0) {
+            i += DMA_BUFFER_SIZE;
+        }
+        accumulator += adc_samples[i * ADC_NB_CHANNELS + 1];
+    }
+    return NB_SAMPLES_PER_PWM_PERIOD * ADC_MAX / 2 - accumulator;
+}
+
+float analog_get_motor_current_pwm_period_from_isr(void)
+{
+    return analog_get_motor_current_raw_pwm_period_from_isr() * ADC_TO_AMPS / NB_SAMPLES_PER_PWM_PERIOD;
 }
 
 float analog_get_auxiliary(void)
 {
-    return (float)aux_in / (ADC_MAX * 2);
+    return aux_in;
+}
+
+#ifdef ANALOG_PWM_TRIGGERED
+void analog_flag_pwm_period_from_isr(bool disturbed)
+{
+    // the conversion of this period has not started yet
+    uint32_t bit = 1u << next_conversion_index();
+    if (disturbed) {
+        disturbed_conversions |= bit;
+    } else {
+        disturbed_conversions &= ~bit;
+    }
+}
+
+// statistics of the undisturbed conversions of samples
+static void conversion_stats(struct adc_stats_s *stats, const adcsample_t *samples,
+                             size_t n, uint32_t disturbed)
+{
+    struct adc_stats_s run;
+    size_t i = 0;
+
+    stats->nb_samples = 0;
+    while (i < n) {
+        size_t start = i;
+        while (i < n && !(disturbed & (1u << i))) {
+            i++;
+        }
+        if (i > start) {
+            adc_stats_compute(&run, &samples[start * ADC_NB_CHANNELS], i - start);
+            adc_stats_merge(stats, &run);
+        }
+        i++;    // skip the disturbed conversion
+    }
 }
 
-static void adc_callback(ADCDriver *adcp, adcsample_t *adc_samples, size_t n)
+// motor current sum of the undisturbed conversions of samples
+static int32_t conversion_current_sum(const adcsample_t *samples, size_t n,
+                                      uint32_t disturbed, uint32_t *nb)
+{
+    int32_t sum = 0;
+    size_t i;
+
+    *nb = 0;
+    for (i = 0; i < n; i++) {
+        if (!(disturbed & (1u << i))) {
+            sum += samples[i * ADC_NB_CHANNELS + 1] - ADC_MAX / 2;
+            (*nb)++;
+        }
+    }
+    return sum;
+}
+#endif
+
+/* Only sums the motor current for the control loop, the statistics of the
+ * half buffer are computed by the adc thread. */
+static void adc_callback(ADCDriver *adcp, adcsample_t *samples, size_t n)
 {
     (void)adcp;
+    thread_stats_irq_enter();
+    uint32_t start = cycle_counter_get();
 
     static int pwm_charge_pump_recharge_countdown = 0;
-    bool ignore_first_samples = false;
 
     if (pwm_charge_pump_recharge_countdown == 0) {
         pwm_charge_pump_recharge_countdown = PWM_RECHARGE_COUNTDOWN_RELOAD;
@@ -53,49 +195,80 @@ static void adc_callback(ADCDriver *adcp, adcsample_t *adc_samples, size_t n)
     } else {
         motor_pwm_trigger_update_from_isr(false);
     }
+
+    int32_t sum;
+    uint32_t nb;
+#ifdef ANALOG_PWM_TRIGGERED
+    uint32_t disturbed = disturbed_conversions >> ((samples - adc_samples) / ADC_NB_CHANNELS);
+    sum = conversion_current_sum(samples, n, disturbed, &nb);
+#else
     if (pwm_charge_pump_recharge_countdown == PWM_RECHARGE_COUNTDOWN_RELOAD - 1) {
         // previous call triggered a recharge, ignore first samples
-        ignore_first_samples = true;
+        samples += IGNORE_NB_SAMPLES_WHEN_RECHARGING * ADC_NB_CHANNELS;
+        n -= IGNORE_NB_SAMPLES_WHEN_RECHARGING;
     }
+    sum = adc_stats_current_sum(samples, n);
+    nb = n;
+#endif
     pwm_charge_pump_recharge_countdown--;
 
-    int i, nb_samples;
-    if (ignore_first_samples) {
-        i = IGNORE_NB_SAMPLES_WHEN_RECHARGING * ADC_NB_CHANNELS;
-        nb_samples = n - IGNORE_NB_SAMPLES_WHEN_RECHARGING;
-    } else {
-        i = 0;
-        nb_samples = n;
-    }
-
-    uint32_t accumulator = 0;
-    for (; i < (int)(n * ADC_NB_CHANNELS); i += ADC_NB_CHANNELS) {
-        accumulator += adc_samples[i + 1];
-    }
     chSysLockFromISR();
-    motor_current_accumulator = accumulator;
-    motor_current_nb_samples = nb_samples;
+    if (nb > 0) {   // all disturbed, keep the previous value
+        motor_current_sum = sum;
+        motor_current_nb_samples = nb;
+    }
+    pending_half.samples = samples;
+    pending_half.nb = n;
+#ifdef ANALOG_PWM_TRIGGERED
+    pending_half.disturbed = disturbed;
+#endif
+    chEvtSignalI(adc_thread, HALF_BUFFER_EVENT);
     chSysUnlockFromISR();
 
-    battery_voltage = adc_samples[3];
-    aux_in = adc_samples[0] + adc_samples[2];
+    control_timing_probe(CONTROL_TIMING_ADC_ISR, start);
+    thread_stats_irq_exit();
+}
 
-    chSysLockFromISR();
-    chEvtBroadcastFlagsI(&analog_event, ANALOG_EVENT_CONVERSION_DONE);
-    chSysUnlockFromISR();
+static void half_buffer_process(void)
+{
+    chSysLock();
+    const adcsample_t *samples = pending_half.samples;
+    size_t n = pending_half.nb;
+#ifdef ANALOG_PWM_TRIGGERED
+    uint32_t disturbed = pending_half.disturbed;
+#endif
+    chSysUnlock();
+
+    struct adc_stats_s stats;
+#ifdef ANALOG_PWM_TRIGGERED
+    conversion_stats(&stats, samples, n, disturbed);
+#else
+    adc_stats_compute(&stats, samples, n);
+#endif
+    if (stats.nb_samples > 0) {     // all disturbed, keep the previous values
+        battery_voltage = (float)stats.battery_sum / stats.nb_samples * ADC_TO_VOLTS;
+        aux_in = (float)stats.aux_sum / stats.nb_samples / (ADC_MAX * 2);
+        chSysLock();
+        adc_stats = stats;
+        chSysUnlock();
+    }
+    chEvtBroadcastFlags(&analog_event, ANALOG_EVENT_CONVERSION_DONE);
 }
 
 static THD_FUNCTION(adc_task, arg)
 {
     (void)arg;
     chRegSetThreadName("adc read");
-    static adcsample_t adc_samples[ADC_NB_CHANNELS * DMA_BUFFER_SIZE];
     static const ADCConversionGroup adcgrpcfg1 = {
         TRUE,                   // circular
         ADC_NB_CHANNELS,        // nb channels
         adc_callback,           // callback fn
         NULL,                   // error callback fn
+#ifdef ANALOG_PWM_TRIGGERED
+        ADC_CFGR_EXTEN_0 | ADC_CFGR_EXTSEL_1, // CFGR : rising edge of TIM1_CC3
+#else
         ADC_CFGR_CONT,          // CFGR
+#endif
         0,                      // TR1
         6,                      // CCR : DUAL=regular,simultaneous
         /* ADC timing
@@ -111,10 +284,14 @@ static THD_FUNCTION(adc_task, arg)
         // Expected sampling frequence is 973kHz / 2 = 486kHz
     };
 
+    adc_thread = chThdGetSelfX();
     adcStart(&ADCD1, NULL);
+    adcStartConversion(&ADCD1, &adcgrpcfg1, adc_samples, DMA_BUFFER_SIZE);
 
-    adcConvert(&ADCD1, &adcgrpcfg1, adc_samples, DMA_BUFFER_SIZE); // should never return
-
+    while (true) {
+        chEvtWaitAny(HALF_BUFFER_EVENT);
+        half_buffer_process();
+    }
     return 0;
 }
 
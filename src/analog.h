@@ -1,6 +1,7 @@
 #ifndef ANALOG_H
 #define ANALOG_H
 
+#include <stdbool.h>
 #include <ch.h>
 
 #ifdef __cplusplus
@@ -10,13 +11,45 @@ extern "C" {
 #define ANALOG_EVENT_CONVERSION_DONE 1
 extern event_source_t analog_event;
 
+#ifdef ANALOG_PWM_TRIGGERED
+/* one current sample per PWM period, at the sample point of motor_pwm */
+#define ANALOG_PERIODS_PER_CONVERSION_EVENT 12
+#define ANALOG_CONVERSION_FREQUENCY 2083 // 25kHz / 12
+
+// ADC_TO_AMPS of analog.c
+#define ANALOG_MOTOR_CURRENT_RAW_LSB 0.001611328125f // [A]
+#else
 #define ANALOG_CONVERSION_FREQUENCY 2002 // frequency of the conversion event
 
+// ADC_TO_AMPS / NB_SAMPLES_PER_PWM_PERIOD of analog.c
+#define ANALOG_MOTOR_CURRENT_RAW_LSB (0.001611328125f / 19) // [A]
+#endif
+
+// motor current statistics of the last conversion event (~243 samples)
+struct analog_current_stats_s {
+    float mean;     // [A]
+    float min;
+    float max;
+    float rms;
+};
+
 float analog_get_motor_current(void);
+void analog_get_motor_current_stats(struct analog_current_stats_s *stats);
+// motor current averaged over the last PWM period (the sample at the sample
+// point if triggered by the PWM), must be called from an ISR
+float analog_get_motor_current_pwm_period_from_isr(void);
+// same in units of ANALOG_MOTOR_CURRENT_RAW_LSB, must be called from an ISR
+int32_t analog_get_motor_current_raw_pwm_period_from_isr(void);
 float analog_get_battery_voltage(void);
 float analog_get_auxiliary(void);
 void analog_init(void);
 
+#ifdef ANALOG_PWM_TRIGGERED
+/* called by the PWM interrupt at the start of every period, excludes the
+ * conversion of a disturbed period from the statistics */
+void analog_flag_pwm_period_from_isr(bool disturbed);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,45 @@
 
 namespace uavcan_stm32
 {
+/**
+ * RX fast path handler, called from the CAN RX interrupt for every received frame.
+ * The frame is consumed and not passed to libuavcan if the handler returns true.
+ * It must be short and interrupt safe; utc_usec is the hardware reception timestamp.
+ */
+typedef bool (*RxFastPathHandler)(const uavcan::CanFrame& frame, uavcan::uint64_t utc_usec);
+
+/**
+ * Installs the RX fast path handler, NULL to disable it.
+ */
+void setRxFastPathHandler(RxFastPathHandler handler);
+
+/**
+ * Frames aborted in a TX mailbox before their transmission.
+ */
+enum TxDropReason
+{
+    TxDropExpired,      ///< TX deadline passed
+    TxDropReplaced      ///< Superseded by a newer frame, see TxCoalescePredicate
+};
+
+/**
+ * TX drop handler, called from the TX interrupt for every frame whose abort took effect.
+ * A frame that was already being transmitted when aborted completes normally and is not reported.
+ */
+typedef void (*TxDropHandler)(const uavcan::CanFrame& frame, TxDropReason reason);
+
+void setTxDropHandler(TxDropHandler handler);
+
+/**
+ * TX coalescing predicate, called from a critical section.
+ * A frame for which it returns true replaces a pending frame with the same CAN ID still waiting in
+ * a TX mailbox ("latest value wins"). It must only accept frames that can be superseded, i.e. single
+ * frame transfers of periodic messages.
+ */
+typedef bool (*TxCoalescePredicate)(const uavcan::CanFrame& frame);
+
+void setTxCoalescePredicate(TxCoalescePredicate predicate);
+
 /**
  * RX queue item.
  * The application shall not use this directly.
@@ -18,14 +57,32 @@ namespace uavcan_stm32
 struct CanRxItem
 {
     uavcan::uint64_t utc_usec;
+    uavcan::uint64_t mono_usec;
     uavcan::CanFrame frame;
     uavcan::CanIOFlags flags;
     CanRxItem()
         : utc_usec(0)
+        , mono_usec(0)
         , flags(0)
     { }
 };
 
+/**
+ * Resource usage and error state of an iface, see CanIface::getStatus().
+ */
+struct CanIfaceStatus
+{
+    uavcan::uint8_t rx_queue_capacity;
+    uavcan::uint8_t rx_queue_peak;          ///< Highest number of frames in the RX queue
+    uavcan::uint32_t rx_queue_overflows;
+    uavcan::uint8_t tx_mailboxes_peak;      ///< Most frames waiting in the TX mailboxes at once, out of 3, aborted ones excluded
+    uavcan::uint32_t tx_mailboxes_full;     ///< Times all TX mailboxes became busy, frames waited in the TX queue
+    uavcan::uint64_t errors;                ///< Same as getErrorCount()
+    bool bus_off;
+    uavcan::uint8_t tx_error_counter;       ///< TEC, 8 LSBs
+    uavcan::uint8_t rx_error_counter;       ///< REC
+};
+
 /**
  * Single CAN iface.
  * The application shall not use this directly.
@@ -39,6 +96,7 @@ class CanIface : public uavcan::ICanIface, uavcan::Noncopyable
         uavcan::uint8_t in_;
         uavcan::uint8_t out_;
         uavcan::uint8_t len_;
+        uavcan::uint8_t peak_len_;
         uavcan::uint32_t overflow_cnt_;
 
         void registerOverflow();
@@ -50,13 +108,18 @@ class CanIface : public uavcan::ICanIface, uavcan::Noncopyable
             , in_(0)
             , out_(0)
             , len_(0)
+            , peak_len_(0)
             , overflow_cnt_(0)
         { }
 
-        void push(const uavcan::CanFrame& frame, const uint64_t& utc_usec, uavcan::CanIOFlags flags);
-        void pop(uavcan::CanFrame& out_frame, uavcan::uint64_t& out_utc_usec, uavcan::CanIOFlags& out_flags);
+        void push(const uavcan::CanFrame& frame, const uint64_t& utc_usec, const uint64_t& mono_usec,
+                  uavcan::CanIOFlags flags);
+        void pop(uavcan::CanFrame& out_frame, uavcan::uint64_t& out_utc_usec, uavcan::uint64_t& out_mono_usec,
+                 uavcan::CanIOFlags& out_flags);
 
         unsigned getLength() const { return len_; }
+        unsigned getPeakLength() const { return peak_len_; }
+        unsigned getCapacity() const { return capacity_; }
 
         uavcan::uint32_t getOverflowCount() const { return overflow_cnt_; }
     };
@@ -82,9 +145,13 @@ class CanIface : public uavcan::ICanIface, uavcan::Noncopyable
         uavcan::MonotonicTime deadline;
         bool pending;
         bool loopback;
+        bool abort_requested;       ///< Dropped only if the completion reports no TXOK
+        TxDropReason abort_reason;
         TxItem()
             : pending(false)
             , loopback(false)
+            , abort_requested(false)
+            , abort_reason(TxDropExpired)
         { }
     };
 
@@ -94,6 +161,10 @@ class CanIface : public uavcan::ICanIface, uavcan::Noncopyable
     RxQueue rx_queue_;
     bxcan::CanType* const can_;
     uavcan::uint64_t error_cnt_;
+    uavcan::uint32_t rx_frame_cnt_;
+    mutable uavcan::uint32_t tx_full_cnt_;  // Updated by isTxBufferFull(), once per busy period
+    mutable bool tx_was_full_;
+    uavcan::uint8_t tx_peak_pending_;
     BusEvent& update_event_;
     TxItem pending_tx_[NumTxMailboxes];
     uavcan::uint8_t last_hw_error_code_;
@@ -117,6 +188,10 @@ class CanIface : public uavcan::ICanIface, uavcan::Noncopyable
 
     void handleTxMailboxInterrupt(uavcan::uint8_t mailbox_index, bool txok, uavcan::uint64_t utc_usec);
 
+    void handleTxCompletions(uavcan::uint64_t utc_usec);
+
+    void abortTxMailbox(uavcan::uint8_t mailbox_index, TxDropReason reason);
+
     bool waitMsrINakBitStateChange(bool target_state);
 
 public:
@@ -127,6 +202,10 @@ public:
         : rx_queue_(rx_queue_buffer, rx_queue_capacity)
         , can_(can)
         , error_cnt_(0)
+        , rx_frame_cnt_(0)
+        , tx_full_cnt_(0)
+        , tx_was_full_(false)
+        , tx_peak_pending_(0)
         , update_event_(update_event)
         , last_hw_error_code_(0)
         , self_index_(self_index)
@@ -145,7 +224,7 @@ public:
     int init(uavcan::uint32_t bitrate);
 
     void handleTxInterrupt(uavcan::uint64_t utc_usec);
-    void handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t utc_usec);
+    void handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t utc_usec, uavcan::uint64_t mono_usec);
 
     void discardTimedOutTxMailboxes(uavcan::MonotonicTime current_time);
 
@@ -164,6 +243,17 @@ public:
      */
     unsigned getRxQueueLength() const;
 
+    /**
+     * Returns number of frames that passed the acceptance filters, i.e. RX interrupts.
+     * Frames rejected by the filters are not counted by the hardware.
+     */
+    uavcan::uint32_t getRxFrameCount() const;
+
+    /**
+     * Returns the queue and mailbox usage and the error state, to size the RX queue.
+     */
+    CanIfaceStatus getStatus() const;
+
     /**
      * Returns last hardware error code (LEC field in the register ESR).
      * The error code will be reset.
@@ -42,6 +42,7 @@ namespace clock
 {
 
 uavcan::uint64_t getUtcUSecFromCanInterrupt();
+uavcan::uint64_t getMonotonicUSecFromCanInterrupt();
 
 }
 
@@ -9,6 +9,7 @@
 #include "internal.hpp"
 
 #include <hal.h>
+#include <thread_stats.h>
 
 // STM32F3 name conflict
 #if defined(STM32F3XX)
@@ -29,6 +30,10 @@ CanIface* ifaces[UAVCAN_STM32_NUM_IFACES] =
 #endif
 };
 
+RxFastPathHandler volatile rx_fast_path_handler = NULL;
+TxDropHandler volatile tx_drop_handler = NULL;
+TxCoalescePredicate volatile tx_coalesce_predicate = NULL;
+
 inline void handleTxInterrupt(uavcan::uint8_t iface_index)
 {
     UAVCAN_ASSERT(iface_index < UAVCAN_STM32_NUM_IFACES);
@@ -55,9 +60,10 @@ inline void handleRxInterrupt(uavcan::uint8_t iface_index, uavcan::uint8_t fifo_
     {
         utc_usec--;
     }
+    const uavcan::uint64_t mono_usec = clock::getMonotonicUSecFromCanInterrupt();
     if (ifaces[iface_index] != NULL)
     {
-        ifaces[iface_index]->handleRxInterrupt(fifo_index, utc_usec);
+        ifaces[iface_index]->handleRxInterrupt(fifo_index, utc_usec, mono_usec);
     }
     else
     {
@@ -67,6 +73,21 @@ inline void handleRxInterrupt(uavcan::uint8_t iface_index, uavcan::uint8_t fifo_
 
 } // namespace
 
+void setRxFastPathHandler(RxFastPathHandler handler)
+{
+    rx_fast_path_handler = handler;
+}
+
+void setTxDropHandler(TxDropHandler handler)
+{
+    tx_drop_handler = handler;
+}
+
+void setTxCoalescePredicate(TxCoalescePredicate predicate)
+{
+    tx_coalesce_predicate = predicate;
+}
+
 /*
  * CanIface::RxQueue
  */
@@ -78,17 +99,23 @@ void CanIface::RxQueue::registerOverflow()
     }
 }
 
-void CanIface::RxQueue::push(const uavcan::CanFrame& frame, const uint64_t& utc_usec, uavcan::CanIOFlags flags)
+void CanIface::RxQueue::push(const uavcan::CanFrame& frame, const uint64_t& utc_usec, const uint64_t& mono_usec,
+                             uavcan::CanIOFlags flags)
 {
-    buf_[in_].frame    = frame;
-    buf_[in_].utc_usec = utc_usec;
-    buf_[in_].flags    = flags;
+    buf_[in_].frame     = frame;
+    buf_[in_].utc_usec  = utc_usec;
+    buf_[in_].mono_usec = mono_usec;
+    buf_[in_].flags     = flags;
     in_++;
     if (in_ >= capacity_)
     {
         in_ = 0;
     }
     len_++;
+    if (len_ > peak_len_ && len_ <= capacity_)
+    {
+        peak_len_ = len_;
+    }
     if (len_ > capacity_)
     {
         len_ = capacity_;
@@ -101,13 +128,15 @@ void CanIface::RxQueue::push(const uavcan::CanFrame& frame, const uint64_t& utc_
     }
 }
 
-void CanIface::RxQueue::pop(uavcan::CanFrame& out_frame, uavcan::uint64_t& out_utc_usec, uavcan::CanIOFlags& out_flags)
+void CanIface::RxQueue::pop(uavcan::CanFrame& out_frame, uavcan::uint64_t& out_utc_usec,
+                            uavcan::uint64_t& out_mono_usec, uavcan::CanIOFlags& out_flags)
 {
     if (len_ > 0)
     {
-        out_frame    = buf_[out_].frame;
-        out_utc_usec = buf_[out_].utc_usec;
-        out_flags    = buf_[out_].flags;
+        out_frame     = buf_[out_].frame;
+        out_utc_usec  = buf_[out_].utc_usec;
+        out_mono_usec = buf_[out_].mono_usec;
+        out_flags     = buf_[out_].flags;
         out_++;
         if (out_ >= capacity_)
         {
@@ -191,6 +220,36 @@ uavcan::int16_t CanIface::send(const uavcan::CanFrame& frame, uavcan::MonotonicT
 
     CriticalSectionLocker lock;
 
+    /*
+     * Aborting an older frame with the same ID, the new one takes the next free mailbox,
+     * which is the aborted one if the abort took effect right away.
+     * A frame already being transmitted will still complete.
+     * This only happens while a mailbox is free: libuavcan calls send() only after select()
+     * reported one, so a frame is never replaced while all three mailboxes are busy.
+     */
+    const TxCoalescePredicate coalesce = tx_coalesce_predicate;
+    if (coalesce != NULL && coalesce(frame))
+    {
+        for (uavcan::uint8_t i = 0; i < NumTxMailboxes; i++)
+        {
+            if (pending_tx_[i].pending && !pending_tx_[i].abort_requested &&
+                pending_tx_[i].frame.id == frame.id && coalesce(pending_tx_[i].frame))
+            {
+                abortTxMailbox(i, TxDropReplaced);
+            }
+        }
+    }
+
+    /*
+     * A mailbox reads empty as soon as its frame is sent or aborted, while the completion
+     * is still waiting for the TX interrupt. It is processed here before the mailbox is
+     * reused, else the interrupt would report it for the new frame.
+     */
+    if (can_->TSR & (bxcan::TSR_RQCP0 | bxcan::TSR_RQCP1 | bxcan::TSR_RQCP2))
+    {
+        handleTxCompletions(clock::getUtcUSecFromCanInterrupt());
+    }
+
     /*
      * Seeking for an empty slot
      */
@@ -207,7 +266,10 @@ uavcan::int16_t CanIface::send(const uavcan::CanFrame& frame, uavcan::MonotonicT
     {
         txmailbox = 2;
     }
-    else { return 0; } // No way
+    else
+    {
+        return 0;       // No way, select() reported the mailboxes as full
+    }
 
     /*
      * Setting up the mailbox
@@ -248,22 +310,35 @@ uavcan::int16_t CanIface::send(const uavcan::CanFrame& frame, uavcan::MonotonicT
     txi.frame    = frame;
     txi.loopback = (flags & uavcan::CanIOFlagLoopback) == uavcan::CanIOFlagLoopback;
     txi.pending  = true;
+    txi.abort_requested = false;
+
+    // frames waiting for the bus, an aborted frame only holds its mailbox until it is sent
+    uavcan::uint8_t num_pending = 0;
+    for (uavcan::uint8_t i = 0; i < NumTxMailboxes; i++)
+    {
+        num_pending += (pending_tx_[i].pending && !pending_tx_[i].abort_requested) ? 1 : 0;
+    }
+    if (num_pending > tx_peak_pending_)
+    {
+        tx_peak_pending_ = num_pending;
+    }
     return 1;
 }
 
 uavcan::int16_t CanIface::receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
                                   uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags)
 {
-    out_ts_monotonic = clock::getMonotonic();  // High precision is not required for monotonic timestamps
     uavcan::uint64_t utc_usec = 0;
+    uavcan::uint64_t mono_usec = 0;
     {
         CriticalSectionLocker lock;
         if (rx_queue_.getLength() == 0)
         {
             return 0;
         }
-        rx_queue_.pop(out_frame, utc_usec, out_flags);
+        rx_queue_.pop(out_frame, utc_usec, mono_usec, out_flags);
     }
+    out_ts_monotonic = uavcan::MonotonicTime::fromUSec(mono_usec);  // Reception time, also without a UTC master
     out_ts_utc = uavcan::UtcTime::fromUSec(utc_usec);
     return 1;
 }
@@ -271,11 +346,82 @@ uavcan::int16_t CanIface::receive(uavcan::CanFrame& out_frame, uavcan::Monotonic
 uavcan::int16_t CanIface::configureFilters(const uavcan::CanFilterConfig* filter_configs,
                                            uavcan::uint16_t num_configs)
 {
-    // TODO: Hardware filter support
+    if (num_configs > NumFilters)
+    {
+        return -1;
+    }
+
+    /*
+     * Filter banks are shared, CAN1 has the registers of both ifaces
+     */
+#if UAVCAN_STM32_NUM_IFACES > 1
+    bxcan::CanType* const master = bxcan::Can[0];
+    const unsigned first_filter = (self_index_ == 0) ? 0 : NumFilters;
+#else
+    bxcan::CanType* const master = can_;
+    const unsigned first_filter = 0;
+#endif
+
     CriticalSectionLocker lock;
-    (void)filter_configs;
-    (void)num_configs;
-    return -1;
+
+    master->FMR |= bxcan::FMR_FINIT;
+
+    for (unsigned i = 0; i < NumFilters; i++)
+    {
+        const uavcan::uint32_t bit = 1U << (first_filter + i);
+        master->FA1R &= ~bit;
+        master->FS1R |= bit;    // Single 32-bit scale, the init leaves the last bank in 16-bit
+        master->FM1R &= ~bit;   // Identifier mask mode
+        master->FFA1R &= ~bit;  // FIFO0
+
+        uavcan::uint32_t id = 0;
+        uavcan::uint32_t mask = 0;
+        if (num_configs == 0)
+        {
+            // No configuration: one filter accepting everything
+            if (i > 0)
+            {
+                continue;
+            }
+        }
+        else if (i < num_configs)
+        {
+            const uavcan::CanFilterConfig& cfg = filter_configs[i];
+            if ((cfg.id & uavcan::CanFrame::FlagEFF) || !(cfg.mask & uavcan::CanFrame::FlagEFF))
+            {
+                id   = ((cfg.id   & uavcan::CanFrame::MaskExtID) << 3) | bxcan::RIR_IDE;
+                mask =  (cfg.mask & uavcan::CanFrame::MaskExtID) << 3;
+            }
+            else
+            {
+                id   = (cfg.id   & uavcan::CanFrame::MaskStdID) << 21;
+                mask = (cfg.mask & uavcan::CanFrame::MaskStdID) << 21;
+            }
+            if (cfg.id & uavcan::CanFrame::FlagRTR)
+            {
+                id |= bxcan::RIR_RTR;
+            }
+            if (cfg.mask & uavcan::CanFrame::FlagEFF)
+            {
+                mask |= bxcan::RIR_IDE;
+            }
+            if (cfg.mask & uavcan::CanFrame::FlagRTR)
+            {
+                mask |= bxcan::RIR_RTR;
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        master->FilterRegister[first_filter + i].FR1 = id;
+        master->FilterRegister[first_filter + i].FR2 = mask;
+        master->FA1R |= bit;
+    }
+
+    master->FMR &= ~bxcan::FMR_FINIT;
+    return 0;
 }
 
 bool CanIface::waitMsrINakBitStateChange(bool target_state)
@@ -362,7 +508,7 @@ int CanIface::init(uavcan::uint32_t bitrate)
         can_->FilterRegister[NumFilters].FR2 = 0;
         can_->FA1R = 1 | (1 << NumFilters);        // One filter per each iface
 #else
-        can_->FS1R = 0x1fff;
+        can_->FS1R = 0x3fff;                       // Single 32-bit for all
         can_->FilterRegister[0].FR1 = 0;
         can_->FilterRegister[0].FR2 = 0;
         can_->FA1R = 1;
@@ -393,18 +539,49 @@ void CanIface::handleTxMailboxInterrupt(uavcan::uint8_t mailbox_index, bool txok
     had_activity_ = had_activity_ || txok;
 
     TxItem& txi = pending_tx_[mailbox_index];
-    if (txi.loopback && txok && txi.pending)
-    {
-        rx_queue_.push(txi.frame, utc_usec, uavcan::CanIOFlagLoopback);
-    }
-    if (!txok)
+    if (txi.pending)
     {
-        error_cnt_++;
+        if (txok)
+        {
+            // Also if an abort was requested, the frame was already on the wire
+            if (txi.loopback)
+            {
+                rx_queue_.push(txi.frame, utc_usec, clock::getMonotonicUSecFromCanInterrupt(),
+                               uavcan::CanIOFlagLoopback);
+            }
+        }
+        else if (txi.abort_requested)
+        {
+            if (txi.abort_reason == TxDropExpired)
+            {
+                error_cnt_++;
+            }
+            const TxDropHandler handler = tx_drop_handler;
+            if (handler != NULL)
+            {
+                handler(txi.frame, txi.abort_reason);
+            }
+        }
+        else
+        {
+            error_cnt_++;
+        }
     }
     txi.pending = false;
+    txi.abort_requested = false;
 }
 
-void CanIface::handleTxInterrupt(const uavcan::uint64_t utc_usec)
+void CanIface::abortTxMailbox(uavcan::uint8_t mailbox_index, TxDropReason reason)
+{
+    static const uavcan::uint32_t AbortFlags[NumTxMailboxes] = { bxcan::TSR_ABRQ0, bxcan::TSR_ABRQ1, bxcan::TSR_ABRQ2 };
+    TxItem& txi = pending_tx_[mailbox_index];
+    can_->TSR = AbortFlags[mailbox_index];
+    // Still pending until the completion interrupt tells whether the abort took effect
+    txi.abort_requested = true;
+    txi.abort_reason = reason;
+}
+
+void CanIface::handleTxCompletions(const uavcan::uint64_t utc_usec)
 {
     // TXOK == false means that there was a hardware failure
     if (can_->TSR & bxcan::TSR_RQCP0)
@@ -425,11 +602,17 @@ void CanIface::handleTxInterrupt(const uavcan::uint64_t utc_usec)
         can_->TSR = bxcan::TSR_RQCP2;
         handleTxMailboxInterrupt(2, txok, utc_usec);
     }
+}
+
+void CanIface::handleTxInterrupt(const uavcan::uint64_t utc_usec)
+{
+    handleTxCompletions(utc_usec);
     pollErrorState();
     update_event_.signalFromInterrupt();
 }
 
-void CanIface::handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t utc_usec)
+void CanIface::handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t utc_usec,
+                                 uavcan::uint64_t mono_usec)
 {
     UAVCAN_ASSERT(fifo_index < 2);
 
@@ -481,11 +664,23 @@ void CanIface::handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t ut
     frame.data[7] = uavcan::uint8_t(0xFF & (rf.RDHR >> 24));
 
     *rfr_reg = bxcan::RFR_RFOM | bxcan::RFR_FOVR | bxcan::RFR_FULL;  // Release FIFO entry we just read
+    rx_frame_cnt_++;
+
+    /*
+     * Frames consumed by the fast path never reach the RX queue
+     */
+    const RxFastPathHandler fast_path = rx_fast_path_handler;
+    if (fast_path != NULL && fast_path(frame, utc_usec))
+    {
+        had_activity_ = true;
+        pollErrorState();
+        return;
+    }
 
     /*
      * Store with timeout into the FIFO buffer and signal update event
      */
-    rx_queue_.push(frame, utc_usec, 0);
+    rx_queue_.push(frame, utc_usec, mono_usec, 0);
     had_activity_ = true;
     pollErrorState();
     update_event_.signalFromInterrupt();
@@ -493,23 +688,26 @@ void CanIface::handleRxInterrupt(uavcan::uint8_t fifo_index, uavcan::uint64_t ut
 
 void CanIface::discardTimedOutTxMailboxes(uavcan::MonotonicTime current_time)
 {
-    static const uavcan::uint32_t AbortFlags[NumTxMailboxes] = { bxcan::TSR_ABRQ0, bxcan::TSR_ABRQ1, bxcan::TSR_ABRQ2 };
     CriticalSectionLocker lock;
-    for (int i = 0; i < NumTxMailboxes; i++)
+    for (uavcan::uint8_t i = 0; i < NumTxMailboxes; i++)
     {
         TxItem& txi = pending_tx_[i];
-        if (txi.pending && txi.deadline < current_time)
+        if (txi.pending && !txi.abort_requested && txi.deadline < current_time)
         {
-            can_->TSR = AbortFlags[i];  // Goodnight sweet transmission
-            txi.pending = false;
-            error_cnt_++;
+            abortTxMailbox(i, TxDropExpired);  // Goodnight sweet transmission
         }
     }
 }
 
 bool CanIface::isTxBufferFull() const
 {
-    return (can_->TSR & (bxcan::TSR_TME0 | bxcan::TSR_TME1 | bxcan::TSR_TME2)) == 0;  // Interrupts enabled
+    const bool full = (can_->TSR & (bxcan::TSR_TME0 | bxcan::TSR_TME1 | bxcan::TSR_TME2)) == 0;  // Interrupts enabled
+    if (full && !tx_was_full_)
+    {
+        tx_full_cnt_++;     // select() keeps the frames in the libuavcan TX queue meanwhile
+    }
+    tx_was_full_ = full;
+    return full;
 }
 
 bool CanIface::isRxBufferEmpty() const
@@ -530,6 +728,29 @@ unsigned CanIface::getRxQueueLength() const
     return rx_queue_.getLength();
 }
 
+uavcan::uint32_t CanIface::getRxFrameCount() const
+{
+    return rx_frame_cnt_;
+}
+
+CanIfaceStatus CanIface::getStatus() const
+{
+    CanIfaceStatus status;
+    CriticalSectionLocker lock;
+    status.rx_queue_capacity  = uavcan::uint8_t(rx_queue_.getCapacity());
+    status.rx_queue_peak      = uavcan::uint8_t(rx_queue_.getPeakLength());
+    status.rx_queue_overflows = rx_queue_.getOverflowCount();
+    status.tx_mailboxes_peak  = tx_peak_pending_;
+    status.tx_mailboxes_full = tx_full_cnt_;
+    status.errors = error_cnt_ + rx_queue_.getOverflowCount();
+
+    const uavcan::uint32_t esr = can_->ESR;
+    status.bus_off          = (esr & bxcan::ESR_BOFF) != 0;
+    status.tx_error_counter = uavcan::uint8_t((esr & bxcan::ESR_TEC_MASK) >> bxcan::ESR_TEC_SHIFT);
+    status.rx_error_counter = uavcan::uint8_t((esr & bxcan::ESR_REC_MASK) >> bxcan::ESR_REC_SHIFT);
+    return status;
+}
+
 uavcan::uint8_t CanIface::yieldLastHardwareErrorCode()
 {
     CriticalSectionLocker lock;
@@ -698,21 +919,27 @@ extern "C"
 CH_IRQ_HANDLER(STM32_CAN1_TX_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleTxInterrupt(0);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
 CH_IRQ_HANDLER(STM32_CAN1_RX0_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleRxInterrupt(0, 0);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
 CH_IRQ_HANDLER(STM32_CAN1_RX1_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleRxInterrupt(0, 1);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
@@ -721,21 +948,27 @@ CH_IRQ_HANDLER(STM32_CAN1_RX1_HANDLER)
 CH_IRQ_HANDLER(STM32_CAN2_TX_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleTxInterrupt(1);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
 CH_IRQ_HANDLER(STM32_CAN2_RX0_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleRxInterrupt(1, 0);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
 CH_IRQ_HANDLER(STM32_CAN2_RX1_HANDLER)
 {
     CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
     uavcan_stm32::handleRxInterrupt(1, 1);
+    thread_stats_irq_exit();
     CH_IRQ_EPILOGUE();
 }
 
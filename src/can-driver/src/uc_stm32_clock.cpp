@@ -77,6 +77,11 @@ uint64_t getUtcUSecFromCanInterrupt()
     return utc_set ? sampleFromCriticalSection(&time_utc) : 0;
 }
 
+uint64_t getMonotonicUSecFromCanInterrupt()
+{
+    return sampleFromCriticalSection(&time_mono);
+}
+
 uavcan::MonotonicTime getMonotonic()
 {
     uint64_t usec = 0;
@@ -382,7 +382,7 @@
  *
  * @note    The default is @p FALSE.
  */
-#define CH_DBG_FILL_THREADS                 FALSE
+#define CH_DBG_FILL_THREADS                 TRUE
 
 /**
  * @brief   Debug option, threads profiling.
@@ -409,7 +409,10 @@
  * @details User fields added to the end of the @p thread_t structure.
  */
 #define CH_CFG_THREAD_EXTRA_FIELDS                                          \
-  /* Add threads custom fields here.*/
+    /* CPU time accounting, see thread_stats.h */                           \
+    uint32_t stats_cycles;                                                  \
+    uint32_t stats_last_cycles;                                             \
+    float stats_load;
 
 /**
  * @brief   Threads initialization hook.
@@ -419,7 +422,9 @@
  *          the threads creation APIs.
  */
 #define CH_CFG_THREAD_INIT_HOOK(tp) {                                       \
-  /* Add threads initialization code here.*/                                \
+    (tp)->stats_cycles = 0;                                                 \
+    (tp)->stats_last_cycles = 0;                                            \
+    (tp)->stats_load = 0;                                                   \
 }
 
 /**
@@ -439,7 +444,8 @@
  * @details This hook is invoked just before switching between threads.
  */
 #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
-  /* System halt code here.*/                                               \
+    void thread_stats_switch(thread_t *, thread_t *);                       \
+    thread_stats_switch(ntp, otp);                                          \
 }
 
 /**
@@ -0,0 +1,38 @@
+#include "command_mailbox.h"
+
+#define INDEX_MASK  0x03
+#define FRESH       0x04
+
+
+void command_mailbox_init(command_mailbox_t *mb)
+{
+    mb->write_index = 0;
+    mb->shared = 1;
+    mb->read_index = 2;
+}
+
+void command_mailbox_publish(command_mailbox_t *mb, const struct command_s *cmd)
+{
+    mb->buffer[mb->write_index] = *cmd;
+
+    // the release ordering makes the command visible before the index
+    uint8_t previous = __atomic_exchange_n(&mb->shared,
+                                           (uint8_t)(mb->write_index | FRESH),
+                                           __ATOMIC_ACQ_REL);
+    mb->write_index = previous & INDEX_MASK;
+}
+
+bool command_mailbox_fetch(command_mailbox_t *mb, struct command_s *cmd)
+{
+    if ((__atomic_load_n(&mb->shared, __ATOMIC_ACQUIRE) & FRESH) == 0) {
+        return false;
+    }
+
+    uint8_t previous = __atomic_exchange_n(&mb->shared,
+                                           mb->read_index,
+                                           __ATOMIC_ACQ_REL);
+    mb->read_index = previous & INDEX_MASK;
+
+    *cmd = mb->buffer[mb->read_index];
+    return true;
+}
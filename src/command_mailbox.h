@@ -0,0 +1,68 @@
+/**
+ * Command mailbox
+ * ===============
+ *
+ * Hands the newest setpoint command from the communication thread to the
+ * control loop without locks (triple buffering).
+ *
+ * The producer always writes into a buffer that nobody else uses and then
+ * atomically swaps it with the shared one, the consumer swaps the shared buffer
+ * with its own only if a new command was published. Neither side ever waits
+ * for the other one and the consumer always sees a complete command.
+ *
+ * There may be only one consumer. Several producers must be serialized by the
+ * caller (e.g. by calling publish from a critical section).
+ */
+
+#ifndef COMMAND_MAILBOX_H
+#define COMMAND_MAILBOX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timestamp/timestamp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum command_mode {
+    COMMAND_POSITION,
+    COMMAND_VELOCITY,
+    COMMAND_TORQUE,
+    COMMAND_TRAJECTORY,
+};
+
+struct command_s {
+    enum command_mode mode;
+    float position;
+    float velocity;
+    float acceleration;
+    float torque;
+    timestamp_t timestamp;
+    uint32_t rx_cycles;     // cycle counter at the reception, for statistics
+    uint32_t traj_mark;     // trajectory buffer position at the reception
+};
+
+typedef struct {
+    struct command_s buffer[3];
+    uint8_t shared;         // index of the published buffer and fresh flag
+    uint8_t write_index;    // owned by the producer
+    uint8_t read_index;     // owned by the consumer
+} command_mailbox_t;
+
+
+void command_mailbox_init(command_mailbox_t *mb);
+
+// publish a command, overwriting a previous one that has not been fetched yet
+void command_mailbox_publish(command_mailbox_t *mb, const struct command_s *cmd);
+
+// returns true and copies the newest command if one was published since the
+// last call, returns false otherwise
+bool command_mailbox_fetch(command_mailbox_t *mb, struct command_s *cmd);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMAND_MAILBOX_H */
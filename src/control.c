@@ -13,11 +13,28 @@
 #include "motor_protection.h"
 #include "feedback.h"
 #include "setpoint.h"
+#include "feedforward.h"
+#include "trajectory_buffer.h"
+#include "command_mailbox.h"
+#include "cycle_counter.h"
+#include "cycle_stats.h"
+#include "seqlock.h"
+#ifdef CONTROL_FIXED_POINT
+#include "fixed_point.h"
+#include "pid_cascade_q31.h"
+#endif
 
 #include "control.h"
 
 #define LOW_BATT_TH 12.f // [V]
 
+#define VELOCITY_LOOP_DIVIDER 12    // 25kHz / 12 = 2083Hz
+#define POSITION_LOOP_DIVIDER 1
+
+#define TRAJECTORY_PLAYOUT_DELAY 0.02f // [s]
+
+#define VELOCITY_FILTER_GAIN 0.1f   // IIR on the velocity from encoder deltas
+
 
 struct pid_param_s {
     parameter_t kp;
@@ -30,10 +47,25 @@ struct pid_param_s {
 
 struct feedback_s control_feedback;
 motor_protection_t control_motor_protection;
-
-binary_semaphore_t setpoint_interpolation_lock;
-static setpoint_interpolator_t setpoint_interpolation;
+event_source_t control_tick_event;
+
+static command_mailbox_t setpoint_mailbox;
+static struct control_config_s config_shadow; // staged configuration
+static bool config_pending = false;
+static setpoint_interpolator_t setpoint_interpolation; // owned by the control thread
+static feedforward_t feedforward;
+static trajectory_buffer_t trajectory_buffer;
+static uint32_t trajectory_playout_delay_us = TRAJECTORY_PLAYOUT_DELAY * 1000000;
 static struct pid_cascade_s ctrl;
+#ifdef CONTROL_FIXED_POINT
+/* Fixed point cascade, ctrl holds its configuration and a float copy of its
+ * signals for the getters. */
+static struct pid_cascade_q31_s ctrl_q31;
+static q31_gain_t current_raw_to_q31;
+static q31_gain_t velocity_ticks_to_q31;    // includes the filter gain
+static q31_t velocity_filter_retention;     // 1 - filter gain
+static q31_gain_t voltage_to_duty;          // updated every cycle, lock to access
+#endif
 
 // control loop parameters
 static parameter_namespace_t param_ns_control;
@@ -44,9 +76,23 @@ static parameter_t param_acc_limit;
 static parameter_namespace_t param_ns_pos_ctrl;
 static parameter_namespace_t param_ns_vel_ctrl;
 static parameter_namespace_t param_ns_cur_ctrl;
+#ifdef ANALOG_PWM_TRIGGERED
+static parameter_t param_current_sample_point;
+#endif
 static struct pid_param_s pos_pid_params;
 static struct pid_param_s vel_pid_params;
 static struct pid_param_s cur_pid_params;
+static parameter_t param_vel_divider;
+static parameter_t param_pos_divider;
+static parameter_namespace_t param_ns_trajectory;
+static parameter_t param_playout_delay;
+static parameter_namespace_t param_ns_feedforward;
+static parameter_t param_ff_inertia;
+static parameter_t param_ff_viscous;
+static parameter_t param_ff_coulomb;
+static parameter_t param_ff_coulomb_band;
+static parameter_t param_ff_offset;
+static parameter_t param_ff_gravity;
 static parameter_namespace_t param_ns_motor;
 static parameter_t param_torque_cst;
 static parameter_namespace_t param_ns_thermal;
@@ -54,6 +100,8 @@ static parameter_t param_current_gain;
 static parameter_t param_max_temp;
 static parameter_t param_Rth;
 static parameter_t param_Cth;
+static parameter_namespace_t param_ns_feedback;
+static parameter_t param_primary_edge_timing;
 
 
 static float low_batt_th = LOW_BATT_TH;
@@ -62,6 +110,47 @@ static bool control_en = false;
 static bool control_request_termination = false;
 static bool control_running = false;
 
+static thread_t *control_thread = NULL;
+static bool current_control_en = false;
+static struct encoder_edge_s primary_encoder_edge; // sampled by the PWM interrupt
+static int velocity_loop_divider = VELOCITY_LOOP_DIVIDER;
+static int position_loop_divider = POSITION_LOOP_DIVIDER;
+
+// execution time statistics, the current loop entry is written by the PWM
+// interrupt, all others by the control thread.
+static cycle_stats_t timing_stats[CONTROL_TIMING_NB_STAGES];
+static uint32_t wakeup_signal_cycles;
+
+// published at the end of each control cycle
+static struct control_state_s state;
+static seqlock_t state_lock;
+
+// capture of control signals, sampled by the control thread
+static scope_t scope;
+static struct control_scope_config_s scope_config;          // of the capture
+static struct control_scope_config_s scope_config_shadow;   // staged by arm
+static bool scope_arm_pending = false;
+static unsigned scope_holds = 0;        // readers of the capture, arming waits
+
+// batched telemetry, filled by the control thread
+static telemetry_batch_channel_t batch_channels[CONTROL_BATCH_NB_CHANNELS];
+static struct control_batch_config_s batch_config[CONTROL_BATCH_NB_CHANNELS];
+static struct control_batch_config_s batch_config_shadow[CONTROL_BATCH_NB_CHANNELS];
+static bool batch_config_pending[CONTROL_BATCH_NB_CHANNELS];
+
+// min/max/mean aggregates, the node thread requests the end of an interval
+static struct aggregate_channel_s {
+    int signal;                         // owned by the control thread
+    struct signal_aggregate_s acc;      // owned by the control thread
+    int signal_shadow;
+    bool select_pending;
+    bool request_pending;
+    bool ready;
+    struct signal_aggregate_s result;
+    int result_signal;
+    timestamp_t end;
+} aggregates[CONTROL_AGGREGATE_NB_CHANNELS];
+
 
 void control_enable(bool en)
 {
@@ -74,38 +163,148 @@ void control_enable(bool en)
     }
 }
 
+void control_update_setpoint(const struct command_s *cmd)
+{
+    // serializes the producers, the control loop never takes this lock
+    chSysLock();
+    control_update_setpoint_i(cmd);
+    chSysUnlock();
+}
+
+void control_update_setpoint_i(const struct command_s *cmd)
+{
+    // the command replaces the trajectory points queued until now
+    struct command_s c = *cmd;
+    c.traj_mark = trajectory_buffer_mark(&trajectory_buffer);
+    command_mailbox_publish(&setpoint_mailbox, &c);
+}
+
 void control_update_position_setpoint(float pos)
 {
-    float current_pos = ctrl.position;
-    float current_vel = ctrl.velocity;
-    chBSemWait(&setpoint_interpolation_lock);
-    setpoint_update_position(&setpoint_interpolation, pos, current_pos, current_vel);
-    chBSemSignal(&setpoint_interpolation_lock);
+    struct command_s cmd = {.mode = COMMAND_POSITION, .position = pos,
+                            .rx_cycles = cycle_counter_get()};
+    control_update_setpoint(&cmd);
 }
 
 void control_update_velocity_setpoint(float vel)
 {
-    float current_vel = ctrl.velocity;
-    chBSemWait(&setpoint_interpolation_lock);
-    setpoint_update_velocity(&setpoint_interpolation, vel, current_vel);
-    chBSemSignal(&setpoint_interpolation_lock);
+    struct command_s cmd = {.mode = COMMAND_VELOCITY, .velocity = vel,
+                            .rx_cycles = cycle_counter_get()};
+    control_update_setpoint(&cmd);
 }
 
 void control_update_torque_setpoint(float torque)
 {
-    chBSemWait(&setpoint_interpolation_lock);
-    setpoint_update_torque(&setpoint_interpolation, torque);
-    chBSemSignal(&setpoint_interpolation_lock);
+    struct command_s cmd = {.mode = COMMAND_TORQUE, .torque = torque,
+                            .rx_cycles = cycle_counter_get()};
+    control_update_setpoint(&cmd);
 }
 
 void control_update_trajectory_setpoint(float pos, float vel, float acc,
                                         float torque, timestamp_t ts)
 {
-    chBSemWait(&setpoint_interpolation_lock);
-    setpoint_update_trajectory(&setpoint_interpolation, pos, vel, acc, torque, ts);
-    chBSemSignal(&setpoint_interpolation_lock);
+    struct command_s cmd = {
+        .mode = COMMAND_TRAJECTORY,
+        .position = pos,
+        .velocity = vel,
+        .acceleration = acc,
+        .torque = torque,
+        .timestamp = ts,
+        .rx_cycles = cycle_counter_get()
+    };
+    control_update_setpoint(&cmd);
+}
+
+bool control_queue_trajectory_point(uint32_t time_us, float pos, float vel,
+                                    float acc, float torque, bool start)
+{
+    static bool time_offset_valid = false;
+    static uint32_t time_offset;    // from host to local time
+
+    if (start || !time_offset_valid || trajectory_buffer_count(&trajectory_buffer) == 0) {
+        time_offset = timestamp_get() + trajectory_playout_delay_us - time_us;
+        time_offset_valid = true;
+    }
+    return control_queue_trajectory_point_at(time_us + time_offset, pos, vel,
+                                             acc, torque);
+}
+
+bool control_queue_trajectory_point_at(timestamp_t time, float pos, float vel,
+                                       float acc, float torque)
+{
+    struct trajectory_point_s point = {
+        .time = time,
+        .position = pos,
+        .velocity = vel,
+        .acceleration = acc,
+        .torque = torque,
+    };
+    return trajectory_buffer_push(&trajectory_buffer, &point);
+}
+
+uint32_t control_get_trajectory_underruns(void)
+{
+    return setpoint_interpolation.traj_underruns;
+}
+
+// apply the newest setpoint command, called by the control loop
+static void setpoint_update_from_mailbox(void)
+{
+    struct command_s cmd;
+    if (!command_mailbox_fetch(&setpoint_mailbox, &cmd)) {
+        return;
+    }
+    cycle_stats_update(&timing_stats[CONTROL_TIMING_COMMAND_LATENCY],
+                       cycle_counter_get() - cmd.rx_cycles);
+    setpoint_discard_trajectory(&setpoint_interpolation, cmd.traj_mark);
+    switch (cmd.mode) {
+        case COMMAND_POSITION:
+            setpoint_update_position(&setpoint_interpolation, cmd.position,
+                                     ctrl.position, ctrl.velocity);
+            break;
+        case COMMAND_VELOCITY:
+            setpoint_update_velocity(&setpoint_interpolation, cmd.velocity,
+                                     ctrl.velocity);
+            break;
+        case COMMAND_TORQUE:
+            setpoint_update_torque(&setpoint_interpolation, cmd.torque);
+            break;
+        case COMMAND_TRAJECTORY:
+            setpoint_update_trajectory(&setpoint_interpolation, cmd.position,
+                                       cmd.velocity, cmd.acceleration,
+                                       cmd.torque, cmd.timestamp);
+            break;
+    }
+}
+
+
+void control_get_state(struct control_state_s *out)
+{
+    uint32_t sequence;
+    do {
+        sequence = seqlock_read_begin(&state_lock);
+        *out = state;
+    } while (seqlock_read_retry(&state_lock, sequence));
 }
 
+static void state_publish(timestamp_t sample_time)
+{
+    seqlock_write_begin(&state_lock);
+    state.cycle++;
+    state.timestamp = sample_time;
+    state.position = ctrl.position;
+    state.velocity = ctrl.velocity;
+    state.position_setpoint = ctrl.position_setpoint;
+    state.velocity_setpoint = ctrl.velocity_setpoint;
+    state.torque = ctrl.torque;
+    // written by the current loop in the PWM interrupt
+    chSysLock();
+    state.current = ctrl.current;
+    state.current_setpoint = ctrl.current_setpoint;
+    state.motor_voltage = ctrl.motor_voltage;
+    chSysUnlock();
+    seqlock_write_end(&state_lock);
+}
 
 float control_get_motor_voltage(void)
 {
@@ -173,6 +372,57 @@ float control_get_position_setpoint(void)
 }
 
 
+static const char *timing_stage_names[CONTROL_TIMING_NB_STAGES] = {
+    [CONTROL_TIMING_PARAMETERS] = "parameters",
+    [CONTROL_TIMING_FEEDBACK] = "feedback",
+    [CONTROL_TIMING_SETPOINT] = "setpoint",
+    [CONTROL_TIMING_CASCADE] = "cascade",
+    [CONTROL_TIMING_CURRENT_LOOP] = "current loop",
+    [CONTROL_TIMING_WAKEUP_LATENCY] = "wakeup latency",
+    [CONTROL_TIMING_CYCLE] = "cycle",
+    [CONTROL_TIMING_COMMAND_LATENCY] = "command latency",
+    [CONTROL_TIMING_UAVCAN_RX] = "uavcan rx",
+    [CONTROL_TIMING_TELEMETRY] = "telemetry",
+    [CONTROL_TIMING_ADC_ISR] = "adc isr",
+};
+
+const char *control_timing_stage_name(enum control_timing_stage stage)
+{
+    return timing_stage_names[stage];
+}
+
+// The lock makes the copy atomic with respect to the PWM interrupt and to
+// the control thread when called from a lower priority thread.
+void control_get_timing_stats(enum control_timing_stage stage, cycle_stats_t *stats)
+{
+    chSysLock();
+    *stats = timing_stats[stage];
+    chSysUnlock();
+}
+
+void control_reset_timing_stats(void)
+{
+    int i;
+    chSysLock();
+    for (i = 0; i < CONTROL_TIMING_NB_STAGES; i++) {
+        cycle_stats_reset(&timing_stats[i]);
+    }
+    chSysUnlock();
+}
+
+static uint32_t timing_probe(enum control_timing_stage stage, uint32_t start)
+{
+    uint32_t now = cycle_counter_get();
+    cycle_stats_update(&timing_stats[stage], now - start);
+    return now;
+}
+
+uint32_t control_timing_probe(enum control_timing_stage stage, uint32_t start)
+{
+    return timing_probe(stage, start);
+}
+
+
 static void set_motor_voltage(float u)
 {
     float u_batt = analog_get_battery_voltage();
@@ -188,21 +438,76 @@ static void pid_param_declare(struct pid_param_s *p, parameter_namespace_t *ns)
     parameter_scalar_declare_with_default(&p->i_limit, ns, "i_limit", INFINITY);
 }
 
+/*
+ * Changes the gains without a step in the output: the integrator is rescaled
+ * so that the integral term ki * integrator / frequency stays the same.
+ */
+static void pid_set_gains_bumpless(pid_ctrl_t *pid, float kp, float ki, float kd)
+{
+    float old_kp, old_ki, old_kd;
+    pid_get_gains(pid, &old_kp, &old_ki, &old_kd);
+    pid_set_gains(pid, kp, ki, kd);
+    if (ki != 0) {
+        pid->integrator *= old_ki / ki;
+    } else {
+        pid_reset_integral(pid);
+    }
+}
+
+static void pid_set_frequency_bumpless(pid_ctrl_t *pid, float frequency)
+{
+    pid->integrator *= frequency / pid_get_frequency(pid);
+    pid_set_frequency(pid, frequency);
+}
+
+// the lock protects the current controller which runs in the PWM interrupt
 static void pid_param_update(struct pid_param_s *p, pid_ctrl_t *ctrl)
 {
     if (parameter_changed(&p->kp) ||
         parameter_changed(&p->ki) ||
         parameter_changed(&p->kd)) {
-        pid_set_gains(ctrl, parameter_scalar_get(&p->kp),
-                            parameter_scalar_get(&p->ki),
-                            parameter_scalar_get(&p->kd));
-        pid_reset_integral(ctrl);
+        float kp = parameter_scalar_get(&p->kp);
+        float ki = parameter_scalar_get(&p->ki);
+        float kd = parameter_scalar_get(&p->kd);
+        chSysLock();
+        pid_set_gains_bumpless(ctrl, kp, ki, kd);
+        chSysUnlock();
     }
     if (parameter_changed(&p->i_limit)) {
-        pid_set_integral_limit(ctrl, parameter_scalar_get(&p->i_limit));
+        float i_limit = parameter_scalar_get(&p->i_limit);
+        chSysLock();
+        pid_set_integral_limit(ctrl, i_limit);
+        chSysUnlock();
     }
 }
 
+static void pid_param_set(struct pid_param_s *p, const struct control_pid_config_s *cfg)
+{
+    parameter_scalar_set(&p->kp, cfg->kp);
+    parameter_scalar_set(&p->ki, cfg->ki);
+    parameter_scalar_set(&p->kd, cfg->kd);
+    parameter_scalar_set(&p->i_limit, cfg->i_limit);
+}
+
+static void set_loop_frequencies(void)
+{
+    float velocity_loop_frequency = MOTOR_PWM_FREQUENCY / (float)velocity_loop_divider;
+    chSysLock();
+    pid_set_frequency(&ctrl.current_pid, MOTOR_PWM_FREQUENCY);
+    chSysUnlock();
+    pid_set_frequency_bumpless(&ctrl.velocity_pid, velocity_loop_frequency);
+    pid_set_frequency_bumpless(&ctrl.position_pid, velocity_loop_frequency / position_loop_divider);
+}
+
+static int divider_get(parameter_t *p)
+{
+    int divider = (int)parameter_scalar_get(p);
+    if (divider < 1) {
+        return 1;
+    }
+    return divider;
+}
+
 
 static void declare_parameters(void)
 {
@@ -214,12 +519,33 @@ static void declare_parameters(void)
 
     parameter_namespace_declare(&param_ns_pos_ctrl, &param_ns_control, "position");
     pid_param_declare(&pos_pid_params, &param_ns_pos_ctrl);
+    // position loop rate = velocity loop rate / divider
+    parameter_scalar_declare_with_default(&param_pos_divider, &param_ns_pos_ctrl, "divider", POSITION_LOOP_DIVIDER);
 
     parameter_namespace_declare(&param_ns_vel_ctrl, &param_ns_control, "velocity");
     pid_param_declare(&vel_pid_params, &param_ns_vel_ctrl);
+    // velocity loop rate = PWM frequency / divider
+    parameter_scalar_declare_with_default(&param_vel_divider, &param_ns_vel_ctrl, "divider", VELOCITY_LOOP_DIVIDER);
 
     parameter_namespace_declare(&param_ns_cur_ctrl, &param_ns_control, "current");
     pid_param_declare(&cur_pid_params, &param_ns_cur_ctrl);
+#ifdef ANALOG_PWM_TRIGGERED
+    // current sample point in the applied voltage phase, 0.5 is the center
+    parameter_scalar_declare_with_default(&param_current_sample_point, &param_ns_cur_ctrl, "sample_point", 0.5);
+#endif
+
+    parameter_namespace_declare(&param_ns_trajectory, &param_ns_control, "trajectory");
+    // [s] between reception and playout of the first buffered point
+    parameter_scalar_declare_with_default(&param_playout_delay, &param_ns_trajectory, "playout_delay", TRAJECTORY_PLAYOUT_DELAY);
+
+    // torque model added to the planned motion, see feedforward.h
+    parameter_namespace_declare(&param_ns_feedforward, &param_ns_control, "feedforward");
+    parameter_scalar_declare_with_default(&param_ff_inertia, &param_ns_feedforward, "inertia", 0);
+    parameter_scalar_declare_with_default(&param_ff_viscous, &param_ns_feedforward, "viscous", 0);
+    parameter_scalar_declare_with_default(&param_ff_coulomb, &param_ns_feedforward, "coulomb", 0);
+    parameter_scalar_declare_with_default(&param_ff_coulomb_band, &param_ns_feedforward, "coulomb_band", 0.1);
+    parameter_scalar_declare_with_default(&param_ff_offset, &param_ns_feedforward, "offset", 0);
+    parameter_scalar_declare_with_default(&param_ff_gravity, &param_ns_feedforward, "gravity", 0);
 
 
     parameter_namespace_declare(&param_ns_motor, &parameter_root_ns, "motor");
@@ -230,11 +556,16 @@ static void declare_parameters(void)
     parameter_scalar_declare(&param_max_temp, &param_ns_thermal, "max_temp");
     parameter_scalar_declare(&param_Rth, &param_ns_thermal, "Rth");
     parameter_scalar_declare(&param_Cth, &param_ns_thermal, "Cth");
+
+    parameter_namespace_declare(&param_ns_feedback, &parameter_root_ns, "feedback");
+    // velocity from encoder edge timing (1) or from count deltas (0)
+    parameter_scalar_declare_with_default(&param_primary_edge_timing, &param_ns_feedback, "primary_encoder_edge_timing", 0);
 }
 
 
 void control_init(void)
 {
+    unsigned i;
     declare_parameters();
 
     ctrl.motor_current_constant = 1;
@@ -244,12 +575,29 @@ void control_init(void)
     pid_init(&ctrl.current_pid);
     pid_init(&ctrl.velocity_pid);
     pid_init(&ctrl.position_pid);
-    pid_set_frequency(&ctrl.current_pid, ANALOG_CONVERSION_FREQUENCY);
-    pid_set_frequency(&ctrl.velocity_pid, ANALOG_CONVERSION_FREQUENCY);
-    pid_set_frequency(&ctrl.position_pid, ANALOG_CONVERSION_FREQUENCY);
+    set_loop_frequencies();
+#ifdef CONTROL_FIXED_POINT
+    pid_q31_init(&ctrl_q31.current_pid);
+    pid_q31_init(&ctrl_q31.velocity_pid);
+    pid_q31_init(&ctrl_q31.position_pid);
+#endif
 
     setpoint_init(&setpoint_interpolation);
-    chBSemObjectInit(&setpoint_interpolation_lock, false);
+    trajectory_buffer_init(&trajectory_buffer);
+    setpoint_set_trajectory_buffer(&setpoint_interpolation, &trajectory_buffer);
+    feedforward_init(&feedforward);
+    command_mailbox_init(&setpoint_mailbox);
+    control_reset_timing_stats();
+    seqlock_init(&state_lock);
+    scope_init(&scope);
+    for (i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        telemetry_batch_channel_init(&batch_channels[i]);
+    }
+    for (i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+        aggregates[i].signal = -1;
+        signal_aggregate_reset(&aggregates[i].acc);
+    }
+    chEvtObjectInit(&control_tick_event);
 
     control_feedback.output.position = 0;
     control_feedback.output.velocity = 0;
@@ -257,36 +605,131 @@ void control_init(void)
     control_feedback.secondary_encoder.accumulator = 0;
 }
 
+// the edge timed velocity is used unfiltered, the IIR would add ~5ms of lag
+static float velocity_filter_gain(void)
+{
+    if (feedback_velocity_is_edge_timed(&control_feedback)) {
+        return 1;
+    }
+    return VELOCITY_FILTER_GAIN;
+}
+
+static void encoder_velocity_reset(void)
+{
+    velocity_estimator_reset(&control_feedback.primary_encoder.velocity_estimator);
+    velocity_estimator_reset(&control_feedback.secondary_encoder.velocity_estimator);
+}
+
+
+#ifdef CONTROL_FIXED_POINT
+
+static void pid_q31_copy_gains(pid_q31_t *dst, const pid_q31_t *src)
+{
+    dst->kp = src->kp;
+    dst->ki = src->ki;
+    dst->kd = src->kd;
+    dst->integrator_limit = src->integrator_limit;
+}
+
+// converts the float configuration, keeps the controller states
+static void fixed_point_configure(void)
+{
+    float delta_t = velocity_loop_divider / (float)MOTOR_PWM_FREQUENCY;
+    static struct pid_cascade_q31_s cfg;
+    pid_cascade_q31_configure(&cfg, &ctrl, feedback_position_lsb(&control_feedback));
+    q31_gain_t current_gain = q31_gain_from_float(ANALOG_MOTOR_CURRENT_RAW_LSB
+                                                  / PID_CASCADE_Q31_CURRENT_LSB);
+
+    chSysLock();
+    pid_q31_copy_gains(&ctrl_q31.current_pid, &cfg.current_pid);
+    current_raw_to_q31 = current_gain;
+    chSysUnlock();
+
+    // the rest is only used by the control thread
+    pid_q31_copy_gains(&ctrl_q31.velocity_pid, &cfg.velocity_pid);
+    pid_q31_copy_gains(&ctrl_q31.position_pid, &cfg.position_pid);
+    ctrl_q31.position_lsb = cfg.position_lsb;
+    ctrl_q31.position_period = cfg.position_period;
+    ctrl_q31.torque_to_current = cfg.torque_to_current;
+    ctrl_q31.velocity_limit = cfg.velocity_limit;
+    ctrl_q31.torque_limit = cfg.torque_limit;
+    ctrl_q31.current_limit = cfg.current_limit;
+    float filter_gain = velocity_filter_gain();
+    velocity_filter_retention = q31_from_float(1 - filter_gain, 1 / 2147483648.f);
+    velocity_ticks_to_q31 = q31_gain_from_float(filter_gain
+            * feedback_velocity_lsb(&control_feedback) / delta_t
+            / PID_CASCADE_Q31_VELOCITY_LSB);
+}
+#endif
 
+// the sample period changed, batches being filled are restarted by batch_update()
+static void batch_restart_all(void)
+{
+    unsigned i;
+    chSysLock();
+    for (i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        if (!batch_config_pending[i]) {
+            batch_config_shadow[i] = batch_config[i];
+            batch_config_pending[i] = true;
+        }
+    }
+    chSysUnlock();
+}
 
 static void update_parameters(void)
 {
+#ifdef CONTROL_FIXED_POINT
+    bool changed = parameter_namespace_contains_changed(&param_ns_control)
+                   || parameter_namespace_contains_changed(&param_ns_motor)
+                   || parameter_namespace_contains_changed(&param_ns_feedback);
+#endif
     if (parameter_namespace_contains_changed(&param_ns_control)) {
         if (parameter_namespace_contains_changed(&param_ns_pos_ctrl)) {
             pid_param_update(&pos_pid_params, &ctrl.position_pid);
+            if (parameter_changed(&param_pos_divider)) {
+                position_loop_divider = divider_get(&param_pos_divider);
+                set_loop_frequencies();
+            }
         }
         if (parameter_namespace_contains_changed(&param_ns_vel_ctrl)) {
             pid_param_update(&vel_pid_params, &ctrl.velocity_pid);
+            if (parameter_changed(&param_vel_divider)) {
+                velocity_loop_divider = divider_get(&param_vel_divider);
+                set_loop_frequencies();
+                batch_restart_all();
+            }
         }
         if (parameter_namespace_contains_changed(&param_ns_cur_ctrl)) {
             pid_param_update(&cur_pid_params, &ctrl.current_pid);
+#ifdef ANALOG_PWM_TRIGGERED
+            if (parameter_changed(&param_current_sample_point)) {
+                motor_pwm_set_current_sample_point(parameter_scalar_get(&param_current_sample_point));
+            }
+#endif
+        }
+        if (parameter_changed(&param_playout_delay)) {
+            trajectory_playout_delay_us = parameter_scalar_get(&param_playout_delay) * 1000000;
+        }
+        if (parameter_namespace_contains_changed(&param_ns_feedforward)) {
+            feedforward.inertia = parameter_scalar_get(&param_ff_inertia);
+            feedforward.viscous = parameter_scalar_get(&param_ff_viscous);
+            feedforward.coulomb = parameter_scalar_get(&param_ff_coulomb);
+            feedforward.coulomb_band = parameter_scalar_get(&param_ff_coulomb_band);
+            feedforward.offset = parameter_scalar_get(&param_ff_offset);
+            feedforward.gravity = parameter_scalar_get(&param_ff_gravity);
         }
         if (parameter_changed(&param_low_batt_th)) {
             low_batt_th = parameter_scalar_get(&param_low_batt_th);
         }
         if (parameter_changed(&param_vel_limit)) {
             ctrl.velocity_limit = parameter_scalar_get(&param_vel_limit);
-            chBSemWait(&setpoint_interpolation_lock);
             setpoint_set_velocity_limit(&setpoint_interpolation, ctrl.velocity_limit);
-            chBSemSignal(&setpoint_interpolation_lock);
         }
         if (parameter_changed(&param_torque_limit)) {
             ctrl.torque_limit = parameter_scalar_get(&param_torque_limit);
         }
         if (parameter_changed(&param_acc_limit)) {
-            chBSemWait(&setpoint_interpolation_lock);
             setpoint_set_acceleration_limit(&setpoint_interpolation, parameter_scalar_get(&param_acc_limit));
-            chBSemSignal(&setpoint_interpolation_lock);
         }
     }
     if (parameter_namespace_contains_changed(&param_ns_motor)) {
@@ -301,11 +744,494 @@ static void update_parameters(void)
                               parameter_scalar_get(&param_Cth),
                               parameter_scalar_get(&param_current_gain));
     }
+    if (parameter_namespace_contains_changed(&param_ns_feedback)) {
+        control_feedback.primary_encoder.velocity_edge_timing =
+            (parameter_scalar_get(&param_primary_edge_timing) != 0);
+        encoder_velocity_reset();
+    }
+#ifdef CONTROL_FIXED_POINT
+    if (changed) {
+        fixed_point_configure();
+    }
+#endif
+}
+
+/*
+ * Applies a staged configuration, runs at the start of a control cycle.
+ * The parameters are written through their handles and picked up by
+ * update_parameters() in the same cycle.
+ */
+static void config_apply(const struct control_config_s *cfg)
+{
+    parameter_scalar_set(&param_acc_limit, cfg->acceleration_limit);
+    parameter_scalar_set(&param_vel_limit, cfg->velocity_limit);
+    parameter_scalar_set(&param_torque_limit, cfg->torque_limit);
+    parameter_scalar_set(&param_low_batt_th, cfg->low_batt_th);
+    pid_param_set(&cur_pid_params, &cfg->current_pid);
+    pid_param_set(&vel_pid_params, &cfg->velocity_pid);
+    pid_param_set(&pos_pid_params, &cfg->position_pid);
+    parameter_scalar_set(&param_torque_cst, cfg->torque_constant);
+    parameter_scalar_set(&param_current_gain, cfg->thermal_current_gain);
+    parameter_scalar_set(&param_max_temp, cfg->max_temperature);
+    parameter_scalar_set(&param_Rth, cfg->thermal_resistance);
+    parameter_scalar_set(&param_Cth, cfg->thermal_capacity);
+
+    if (control_feedback.input_selection != cfg->input_selection) {
+        control_feedback.input_selection = cfg->input_selection;
+        control_feedback.primary_encoder.previous = encoder_get_primary();
+        control_feedback.secondary_encoder.previous = encoder_get_secondary();
+        encoder_velocity_reset();
+    }
+    control_feedback.primary_encoder.transmission_p = cfg->primary_encoder.transmission_p;
+    control_feedback.primary_encoder.transmission_q = cfg->primary_encoder.transmission_q;
+    control_feedback.primary_encoder.ticks_per_rev = cfg->primary_encoder.ticks_per_rev;
+    control_feedback.secondary_encoder.transmission_p = cfg->secondary_encoder.transmission_p;
+    control_feedback.secondary_encoder.transmission_q = cfg->secondary_encoder.transmission_q;
+    control_feedback.secondary_encoder.ticks_per_rev = cfg->secondary_encoder.ticks_per_rev;
+    control_feedback.potentiometer.gain = cfg->potentiometer_gain;
+    control_feedback.potentiometer.zero = cfg->potentiometer_zero;
+    control_feedback.rpm.phase = cfg->rpm_phase;
+}
+
+static void config_update(void)
+{
+    static struct control_config_s cfg;
+    bool pending;
+    chSysLock();
+    pending = config_pending;
+    if (pending) {
+        cfg = config_shadow;
+        config_pending = false;
+    }
+    chSysUnlock();
+    if (pending) {
+        config_apply(&cfg);
+    }
+}
+
+void control_configure(const struct control_config_s *config)
+{
+    chSysLock();
+    config_shadow = *config;
+    config_pending = true;
+    chSysUnlock();
+    control_start();
 }
 
+static const char *signal_names[CONTROL_NB_SIGNALS] = {
+    [CONTROL_SIGNAL_POSITION] = "position",
+    [CONTROL_SIGNAL_VELOCITY] = "velocity",
+    [CONTROL_SIGNAL_POSITION_SETPOINT] = "position_setpoint",
+    [CONTROL_SIGNAL_VELOCITY_SETPOINT] = "velocity_setpoint",
+    [CONTROL_SIGNAL_ACCELERATION_SETPOINT] = "acceleration_setpoint",
+    [CONTROL_SIGNAL_POSITION_ERROR] = "position_error",
+    [CONTROL_SIGNAL_VELOCITY_ERROR] = "velocity_error",
+    [CONTROL_SIGNAL_POSITION_CTRL_OUT] = "position_ctrl_out",
+    [CONTROL_SIGNAL_VELOCITY_CTRL_OUT] = "velocity_ctrl_out",
+    [CONTROL_SIGNAL_TORQUE] = "torque",
+    [CONTROL_SIGNAL_FEEDFORWARD_TORQUE] = "feedforward_torque",
+    [CONTROL_SIGNAL_CURRENT] = "current",
+    [CONTROL_SIGNAL_CURRENT_SETPOINT] = "current_setpoint",
+    [CONTROL_SIGNAL_CURRENT_ERROR] = "current_error",
+    [CONTROL_SIGNAL_CURRENT_AVERAGE] = "current_average",
+    [CONTROL_SIGNAL_MOTOR_VOLTAGE] = "motor_voltage",
+    [CONTROL_SIGNAL_PWM_DUTY] = "pwm_duty",
+    [CONTROL_SIGNAL_BATTERY_VOLTAGE] = "battery_voltage",
+    [CONTROL_SIGNAL_PRIMARY_ENCODER] = "primary_encoder",
+    [CONTROL_SIGNAL_SECONDARY_ENCODER] = "secondary_encoder",
+    [CONTROL_SIGNAL_SETPOINT_MODE] = "setpoint_mode",
+    [CONTROL_SIGNAL_FAULT] = "fault",
+};
+
+const char *control_signal_name(enum control_signal signal)
+{
+    if (signal >= CONTROL_NB_SIGNALS) {
+        return "";
+    }
+    return signal_names[signal];
+}
+
+static int control_faults(void)
+{
+    int faults = 0;
+    if (analog_get_battery_voltage() < low_batt_th) {
+        faults |= CONTROL_FAULT_LOW_BATTERY;
+    }
+    if (!control_en) {
+        faults |= CONTROL_FAULT_DISABLED;
+    }
+    if (control_motor_protection.t >= control_motor_protection.t_max) {
+        faults |= CONTROL_FAULT_OVERHEAT;
+    }
+    return faults;
+}
+
+static float control_signal_value(enum control_signal signal)
+{
+    switch (signal) {
+        case CONTROL_SIGNAL_POSITION: return ctrl.position;
+        case CONTROL_SIGNAL_VELOCITY: return ctrl.velocity;
+        case CONTROL_SIGNAL_POSITION_SETPOINT: return ctrl.position_setpoint;
+        case CONTROL_SIGNAL_VELOCITY_SETPOINT: return ctrl.velocity_setpoint;
+        case CONTROL_SIGNAL_ACCELERATION_SETPOINT: return ctrl.setpts.acceleration_setpt;
+        case CONTROL_SIGNAL_POSITION_ERROR: return ctrl.position_error;
+        case CONTROL_SIGNAL_VELOCITY_ERROR: return ctrl.velocity_error;
+        case CONTROL_SIGNAL_POSITION_CTRL_OUT: return ctrl.position_ctrl_out;
+        case CONTROL_SIGNAL_VELOCITY_CTRL_OUT: return ctrl.velocity_ctrl_out;
+        case CONTROL_SIGNAL_TORQUE: return ctrl.torque;
+        case CONTROL_SIGNAL_FEEDFORWARD_TORQUE: return ctrl.setpts.feedforward_torque;
+        case CONTROL_SIGNAL_CURRENT: return ctrl.current;
+        case CONTROL_SIGNAL_CURRENT_SETPOINT: return ctrl.current_setpoint;
+        case CONTROL_SIGNAL_CURRENT_ERROR: return ctrl.current_error;
+        case CONTROL_SIGNAL_CURRENT_AVERAGE: return analog_get_motor_current();
+        case CONTROL_SIGNAL_MOTOR_VOLTAGE: return ctrl.motor_voltage;
+        case CONTROL_SIGNAL_PWM_DUTY: return ctrl.motor_voltage / analog_get_battery_voltage();
+        case CONTROL_SIGNAL_BATTERY_VOLTAGE: return analog_get_battery_voltage();
+        case CONTROL_SIGNAL_PRIMARY_ENCODER: return encoder_get_primary();
+        case CONTROL_SIGNAL_SECONDARY_ENCODER: return encoder_get_secondary();
+        case CONTROL_SIGNAL_SETPOINT_MODE: return setpoint_interpolation.setpt_mode;
+        case CONTROL_SIGNAL_FAULT: return control_faults();
+        default: return 0;
+    }
+}
+
+bool control_scope_arm(const struct control_scope_config_s *config)
+{
+    unsigned i;
+    if (config->nb_channels == 0 || config->nb_channels > SCOPE_NB_CHANNELS
+        || config->trigger_signal >= CONTROL_NB_SIGNALS) {
+        return false;
+    }
+    for (i = 0; i < config->nb_channels; i++) {
+        if (config->signals[i] >= CONTROL_NB_SIGNALS) {
+            return false;
+        }
+    }
+    chSysLock();
+    scope_config_shadow = *config;
+    scope_arm_pending = true;
+    chSysUnlock();
+    return true;
+}
+
+void control_scope_trigger(void)
+{
+    scope_force_trigger(&scope);
+}
+
+const scope_t *control_scope_get(void)
+{
+    return &scope;
+}
+
+void control_scope_hold(void)
+{
+    chSysLock();
+    scope_holds++;
+    chSysUnlock();
+}
+
+void control_scope_release(void)
+{
+    chSysLock();
+    scope_holds--;
+    chSysUnlock();
+}
+
+void control_scope_get_config(struct control_scope_config_s *config)
+{
+    chSysLock();
+    *config = scope_config;
+    chSysUnlock();
+}
+
+float control_scope_sample_period(void)
+{
+    return scope.divider * velocity_loop_divider / (float)MOTOR_PWM_FREQUENCY;
+}
+
+// records the scope signals, called every control cycle
+static void scope_update(void)
+{
+    unsigned i;
+    float values[SCOPE_NB_CHANNELS];
+
+    chSysLock();
+    bool arm = scope_arm_pending && scope_holds == 0;
+    if (arm) {
+        scope_config = scope_config_shadow;
+        scope_arm_pending = false;
+    }
+    chSysUnlock();
+    if (arm) {
+        scope_arm(&scope, scope_config.nb_channels, scope_config.pretrigger,
+                  scope_config.divider, scope_config.trigger_mode,
+                  scope_config.trigger_level);
+    }
+
+    enum scope_state state = scope_get_state(&scope);
+    if (state != SCOPE_ARMED && state != SCOPE_TRIGGERED) {
+        return;
+    }
+    for (i = 0; i < scope_config.nb_channels; i++) {
+        values[i] = control_signal_value(scope_config.signals[i]);
+    }
+    scope_sample(&scope, values, control_signal_value(scope_config.trigger_signal));
+}
+
+bool control_batch_configure(unsigned channel, const struct control_batch_config_s *config)
+{
+    if (channel >= CONTROL_BATCH_NB_CHANNELS || config->signal >= CONTROL_NB_SIGNALS
+        || config->divider == 0) {
+        return false;
+    }
+    chSysLock();
+    batch_config_shadow[channel] = *config;
+    batch_config_pending[channel] = true;
+    chSysUnlock();
+    return true;
+}
+
+void control_batch_get_config(unsigned channel, struct control_batch_config_s *config)
+{
+    chSysLock();
+    *config = batch_config[channel];
+    chSysUnlock();
+}
+
+telemetry_batch_channel_t *control_batch_channel(unsigned channel)
+{
+    return &batch_channels[channel];
+}
+
+float control_batch_sample_period(unsigned channel)
+{
+    return batch_config[channel].divider * control_cycle_period();
+}
+
+float control_cycle_period(void)
+{
+    return velocity_loop_divider / (float)MOTOR_PWM_FREQUENCY;
+}
+
+// records the batched telemetry signals, called every control cycle
+static void batch_update(void)
+{
+    static unsigned divider_count[CONTROL_BATCH_NB_CHANNELS];
+    unsigned i;
+    timestamp_t now = timestamp_get();
+
+    for (i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        chSysLock();
+        if (batch_config_pending[i]) {
+            batch_config[i] = batch_config_shadow[i];
+            batch_config_pending[i] = false;
+            telemetry_batch_restart(&batch_channels[i], batch_config[i].signal,
+                                    control_batch_sample_period(i));
+            divider_count[i] = 0;
+        }
+        chSysUnlock();
+
+        if (!batch_config[i].enabled) {
+            continue;
+        }
+        if (divider_count[i] == 0) {
+            telemetry_batch_add(&batch_channels[i],
+                                control_signal_value(batch_config[i].signal), now);
+        }
+        divider_count[i]++;
+        if (divider_count[i] >= batch_config[i].divider) {
+            divider_count[i] = 0;
+        }
+    }
+}
+
+void control_aggregate_select(unsigned channel, int signal)
+{
+    if (signal >= CONTROL_NB_SIGNALS) {
+        signal = -1;
+    }
+    chSysLock();
+    aggregates[channel].signal_shadow = signal;
+    aggregates[channel].select_pending = true;
+    chSysUnlock();
+}
+
+void control_aggregate_request(unsigned channel)
+{
+    chSysLock();
+    aggregates[channel].request_pending = true;
+    chSysUnlock();
+}
+
+bool control_aggregate_get(unsigned channel, struct signal_aggregate_s *result,
+                           int *signal, timestamp_t *end)
+{
+    struct aggregate_channel_s *a = &aggregates[channel];
+    bool ready;
+    chSysLock();
+    ready = a->ready;
+    if (ready) {
+        *result = a->result;
+        *signal = a->result_signal;
+        *end = a->end;
+        a->ready = false;
+    }
+    chSysUnlock();
+    return ready;
+}
+
+// accumulates the aggregated signals, called every control cycle
+static void aggregate_update(timestamp_t now)
+{
+    unsigned i;
+    for (i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+        struct aggregate_channel_s *a = &aggregates[i];
+        chSysLock();
+        if (a->select_pending) {
+            a->signal = a->signal_shadow;
+            a->select_pending = false;
+            signal_aggregate_reset(&a->acc);
+        }
+        chSysUnlock();
+
+        if (a->signal < 0) {
+            continue;
+        }
+        signal_aggregate_add(&a->acc, control_signal_value(a->signal));
+
+        chSysLock();
+        if (a->request_pending) {
+            a->result = a->acc;
+            a->result_signal = a->signal;
+            a->end = now;
+            a->ready = true;
+            a->request_pending = false;
+            signal_aggregate_reset(&a->acc);
+        }
+        chSysUnlock();
+    }
+}
 
 #define CONTROL_WAKEUP_EVENT 1
 
+#ifdef CONTROL_FIXED_POINT
+
+static void current_loop_measure(void)
+{
+    ctrl_q31.current = q31_gain_apply(current_raw_to_q31,
+                                      analog_get_motor_current_raw_pwm_period_from_isr());
+}
+
+static void current_loop_run(void)
+{
+    pid_cascade_q31_current_control(&ctrl_q31);
+    motor_pwm_set_q31(q31_gain_apply(voltage_to_duty, ctrl_q31.motor_voltage));
+}
+
+static void current_loop_reset(void)
+{
+    pid_q31_reset_integral(&ctrl_q31.current_pid);
+}
+
+static void outer_loops_run(bool run_position_loop)
+{
+    ctrl_q31.periodic_actuator = control_feedback.output.actuator_is_periodic;
+    ctrl_q31.position = control_feedback.output.position_ticks;
+    ctrl_q31.velocity = q31_add(q31_mul(ctrl_q31.velocity, velocity_filter_retention),
+                                q31_gain_apply(velocity_ticks_to_q31,
+                                               control_feedback.output.velocity_ticks));
+    pid_cascade_q31_set_setpoints(&ctrl_q31, &ctrl.setpts);
+
+    if (run_position_loop) {
+        pid_cascade_q31_position_control(&ctrl_q31);
+    }
+    pid_cascade_q31_velocity_control(&ctrl_q31);
+
+    float u_batt = analog_get_battery_voltage();
+    q31_gain_t duty_gain = q31_gain_from_float(u_batt > 1 ? PID_CASCADE_Q31_VOLTAGE_SCALE / u_batt : 0);
+    chSysLock();
+    voltage_to_duty = duty_gain;
+    chSysUnlock();
+
+    pid_cascade_q31_to_float(&ctrl_q31, &ctrl);
+}
+
+static void outer_loops_reset(void)
+{
+    pid_q31_reset_integral(&ctrl_q31.velocity_pid);
+    pid_q31_reset_integral(&ctrl_q31.position_pid);
+}
+
+#else
+
+static void current_loop_measure(void)
+{
+    ctrl.current = analog_get_motor_current_pwm_period_from_isr();
+}
+
+static void current_loop_run(void)
+{
+    pid_cascade_current_control(&ctrl);
+    set_motor_voltage(ctrl.motor_voltage);
+}
+
+static void current_loop_reset(void)
+{
+    pid_reset_integral(&ctrl.current_pid);
+}
+
+static void outer_loops_run(bool run_position_loop)
+{
+    if (run_position_loop) {
+        pid_cascade_position_control(&ctrl);
+    }
+    pid_cascade_velocity_control(&ctrl);
+}
+
+static void outer_loops_reset(void)
+{
+    pid_reset_integral(&ctrl.velocity_pid);
+    pid_reset_integral(&ctrl.position_pid);
+}
+
+#endif
+
+/*
+ * Current control, runs at the PWM frequency from the PWM timer interrupt.
+ * It also wakes up the control thread every velocity_loop_divider periods.
+ */
+static void current_control(bool recharging)
+{
+    encoder_edge_sample(&primary_encoder_edge, encoder_get_primary(), cycle_counter_get());
+
+    // the current measurement is disturbed by charge pump recharge cycles,
+    // keep the previous output until it settled.
+    if (!recharging) {
+        current_loop_measure();
+        if (current_control_en) {
+            uint32_t start = cycle_counter_get();
+            current_loop_run();
+            timing_probe(CONTROL_TIMING_CURRENT_LOOP, start);
+        } else {
+            current_loop_reset();
+        }
+    }
+
+    static int velocity_loop_counter = 0;
+    velocity_loop_counter++;
+    if (velocity_loop_counter >= velocity_loop_divider) {
+        velocity_loop_counter = 0;
+        chSysLockFromISR();
+        if (control_thread != NULL) {
+            wakeup_signal_cycles = cycle_counter_get();
+            chEvtSignalI(control_thread, CONTROL_WAKEUP_EVENT);
+        }
+        chEvtBroadcastFlagsI(&control_tick_event, CONTROL_EVENT_TICK);
+        chSysUnlockFromISR();
+    }
+}
+
 static THD_FUNCTION(control_loop, arg)
 {
     (void)arg;
@@ -313,22 +1239,28 @@ static THD_FUNCTION(control_loop, arg)
 
     control_feedback.primary_encoder.previous = encoder_get_primary();
     control_feedback.secondary_encoder.previous = encoder_get_secondary();
+    encoder_velocity_reset();
+#ifdef CONTROL_FIXED_POINT
+    // the feedback configuration may have changed while stopped
+    fixed_point_configure();
+#endif
 
-    static event_listener_t analog_event_listener;
-    chEvtRegisterMaskWithFlags(&analog_event, &analog_event_listener,
-                               (eventmask_t)CONTROL_WAKEUP_EVENT,
-                               (eventflags_t)ANALOG_EVENT_CONVERSION_DONE);
-
-
-    const float delta_t = 1/(float)ANALOG_CONVERSION_FREQUENCY;
+    int position_loop_counter = 0;
     while (!control_request_termination) {
+        uint32_t cycle_start = cycle_counter_get();
+        uint32_t t = cycle_start;
 
+        config_update();
         update_parameters();
+        setpoint_update_from_mailbox();
+        t = timing_probe(CONTROL_TIMING_PARAMETERS, t);
+
+        const float delta_t = velocity_loop_divider / (float)MOTOR_PWM_FREQUENCY;
+        timestamp_t sample_time = timestamp_get();
 
         if (!control_en || analog_get_battery_voltage() < low_batt_th) {
-            pid_reset_integral(&ctrl.current_pid);
-            pid_reset_integral(&ctrl.velocity_pid);
-            pid_reset_integral(&ctrl.position_pid);
+            current_control_en = false;
+            outer_loops_reset();
             motor_protection_update(&control_motor_protection, analog_get_motor_current(), delta_t);
         } else {
 
@@ -337,42 +1269,72 @@ static THD_FUNCTION(control_loop, arg)
             control_feedback.input.primary_encoder = encoder_get_primary();
             control_feedback.input.secondary_encoder = encoder_get_secondary();
             control_feedback.input.delta_t = delta_t;
+            chSysLock();
+            control_feedback.input.primary_encoder_edge = primary_encoder_edge;
+            chSysUnlock();
+            control_feedback.input.time = cycle_counter_get();
+            control_feedback.input.time_lsb = 1.f / STM32_SYSCLK;
 
+            t = cycle_counter_get();
             feedback_compute(&control_feedback);
+            t = timing_probe(CONTROL_TIMING_FEEDBACK, t);
 
             ctrl.periodic_actuator = control_feedback.output.actuator_is_periodic;
             ctrl.position = control_feedback.output.position;
-            ctrl.velocity = ctrl.velocity * 0.9 + control_feedback.output.velocity * 0.1;
-            ctrl.current = analog_get_motor_current();
+            float filter_gain = velocity_filter_gain();
+            ctrl.velocity = ctrl.velocity * (1 - filter_gain)
+                            + control_feedback.output.velocity * filter_gain;
 
             // ctrl.current_limit = motor_protection_update(&control_motor_protection, ctrl.current, delta_t);
 
             // setpoints
-            chBSemWait(&setpoint_interpolation_lock);
+            t = cycle_counter_get();
             setpoint_compute(&setpoint_interpolation, &ctrl.setpts, delta_t);
-            chBSemSignal(&setpoint_interpolation_lock);
-
-            // run control step
-            pid_cascade_control(&ctrl);
-
-            set_motor_voltage(ctrl.motor_voltage);
+            ctrl.setpts.feedforward_torque += feedforward_torque(&feedforward, &ctrl.setpts);
+            t = timing_probe(CONTROL_TIMING_SETPOINT, t);
+
+            // run the outer control loops, the current loop runs in the PWM interrupt
+            position_loop_counter++;
+            bool run_position_loop = (position_loop_counter >= position_loop_divider);
+            if (run_position_loop) {
+                position_loop_counter = 0;
+            }
+            outer_loops_run(run_position_loop);
+            timing_probe(CONTROL_TIMING_CASCADE, t);
+
+            current_control_en = true;
         }
+        state_publish(sample_time);
+        scope_update();
+        batch_update();
+        aggregate_update(sample_time);
+        timing_probe(CONTROL_TIMING_CYCLE, cycle_start);
 
         chEvtWaitAny(CONTROL_WAKEUP_EVENT);
-        chEvtGetAndClearFlags(&analog_event_listener);
+        timing_probe(CONTROL_TIMING_WAKEUP_LATENCY, wakeup_signal_cycles);
     }
 
+    current_control_en = false;
     set_motor_voltage(0);
-    chEvtUnregister(&analog_event, &analog_event_listener);
+    chSysLock();
+    control_thread = NULL;
+    chSysUnlock();
     control_running = false;
     return 0;
 }
 
 void control_start(void)
 {
+    if (control_running) {
+        return;
+    }
     control_running = true;
     static THD_WORKING_AREA(control_loop_wa, 256);
-    chThdCreateStatic(control_loop_wa, sizeof(control_loop_wa), HIGHPRIO, control_loop, NULL);
+    thread_t *tp = chThdCreateStatic(control_loop_wa, sizeof(control_loop_wa), HIGHPRIO, control_loop, NULL);
+    chSysLock();
+    control_thread = tp;
+    chSysUnlock();
+    motor_pwm_set_period_callback(current_control);
 }
 
 void control_stop(void)
@@ -381,5 +1343,6 @@ void control_stop(void)
     while (control_running) {
         chThdSleepMilliseconds(1);
     }
+    motor_pwm_set_period_callback(NULL);
     control_request_termination = false;
 }
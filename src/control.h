@@ -6,18 +6,126 @@
 extern "C" {
 #endif
 
+#include <ch.h>
 #include "timestamp/timestamp.h"
 #include "motor_protection.h"
 #include "feedback.h"
+#include "cycle_stats.h"
+#include "scope.h"
+#include "telemetry_batch.h"
+#include "signal_aggregate.h"
+#include "command_mailbox.h"
 
 extern struct feedback_s control_feedback;
 extern motor_protection_t control_motor_protection;
 
+/* broadcast every velocity loop period while the control runs */
+#define CONTROL_EVENT_TICK 1
+extern event_source_t control_tick_event;
+
+struct control_pid_config_s {
+    float kp;
+    float ki;
+    float kd;
+    float i_limit;
+};
+
+/* Complete control configuration, see control_configure() */
+struct control_config_s {
+    float acceleration_limit;
+    float velocity_limit;
+    float torque_limit;
+    float low_batt_th;
+    struct control_pid_config_s current_pid;
+    struct control_pid_config_s velocity_pid;
+    struct control_pid_config_s position_pid;
+    float torque_constant;
+    float thermal_current_gain;
+    float max_temperature;
+    float thermal_resistance;
+    float thermal_capacity;
+    // feedback
+    enum feedback_input_selection input_selection;
+    struct {
+        uint16_t transmission_p;
+        uint16_t transmission_q;
+        uint32_t ticks_per_rev;
+    } primary_encoder, secondary_encoder;
+    float potentiometer_gain;
+    float potentiometer_zero;
+    float rpm_phase;
+};
+
+/* Signals of the control loop that can be captured by the scope */
+enum control_signal {
+    CONTROL_SIGNAL_POSITION,
+    CONTROL_SIGNAL_VELOCITY,
+    CONTROL_SIGNAL_POSITION_SETPOINT,
+    CONTROL_SIGNAL_VELOCITY_SETPOINT,
+    CONTROL_SIGNAL_ACCELERATION_SETPOINT,
+    CONTROL_SIGNAL_POSITION_ERROR,
+    CONTROL_SIGNAL_VELOCITY_ERROR,
+    CONTROL_SIGNAL_POSITION_CTRL_OUT,
+    CONTROL_SIGNAL_VELOCITY_CTRL_OUT,
+    CONTROL_SIGNAL_TORQUE,
+    CONTROL_SIGNAL_FEEDFORWARD_TORQUE,
+    CONTROL_SIGNAL_CURRENT,             // current loop measurement
+    CONTROL_SIGNAL_CURRENT_SETPOINT,
+    CONTROL_SIGNAL_CURRENT_ERROR,
+    CONTROL_SIGNAL_CURRENT_AVERAGE,     // ADC half buffer average
+    CONTROL_SIGNAL_MOTOR_VOLTAGE,
+    CONTROL_SIGNAL_PWM_DUTY,
+    CONTROL_SIGNAL_BATTERY_VOLTAGE,
+    CONTROL_SIGNAL_PRIMARY_ENCODER,     // raw counts
+    CONTROL_SIGNAL_SECONDARY_ENCODER,
+    CONTROL_SIGNAL_SETPOINT_MODE,       // SETPT_MODE_*
+    CONTROL_SIGNAL_FAULT,               // CONTROL_FAULT_* flags
+    CONTROL_NB_SIGNALS
+};
+
+#define CONTROL_FAULT_LOW_BATTERY   1
+#define CONTROL_FAULT_DISABLED      2
+#define CONTROL_FAULT_OVERHEAT      4
+
+/* Scope capture, see scope.h */
+struct control_scope_config_s {
+    unsigned nb_channels;
+    enum control_signal signals[SCOPE_NB_CHANNELS];
+    unsigned divider;               // of the velocity loop rate
+    float pretrigger;               // fraction of the capture
+    enum control_signal trigger_signal;
+    enum scope_trigger_mode trigger_mode;
+    float trigger_level;
+};
+
+/* Control loop stages instrumented with the CPU cycle counter */
+enum control_timing_stage {
+    CONTROL_TIMING_PARAMETERS,      // update_parameters
+    CONTROL_TIMING_FEEDBACK,        // feedback_compute
+    CONTROL_TIMING_SETPOINT,        // setpoint_compute
+    CONTROL_TIMING_CASCADE,         // position & velocity loop
+    CONTROL_TIMING_CURRENT_LOOP,    // current loop & set_motor_voltage (PWM ISR)
+    CONTROL_TIMING_WAKEUP_LATENCY,  // PWM ISR signal to control thread running
+    CONTROL_TIMING_CYCLE,           // complete control thread cycle
+    CONTROL_TIMING_COMMAND_LATENCY, // setpoint reception to control thread
+    CONTROL_TIMING_UAVCAN_RX,       // UAVCAN RX thread wakeup, incl. node lock wait
+    CONTROL_TIMING_TELEMETRY,       // telemetry thread pass, incl. node lock wait
+    CONTROL_TIMING_ADC_ISR,         // ADC half buffer interrupt
+    CONTROL_TIMING_NB_STAGES
+};
+
 
 void control_init(void);
 void control_start(void);
 void control_stop(void);
 
+/*
+ * Stages a new configuration, the control loop swaps it in at the start of
+ * its next cycle without stopping. The integrators are rescaled to keep the
+ * controller outputs continuous. Starts the control loop if not running.
+ */
+void control_configure(const struct control_config_s *config);
+
 void control_enable(bool en);
 
 void control_update_position_setpoint(float pos);
@@ -25,6 +133,45 @@ void control_update_velocity_setpoint(float vel);
 void control_update_torque_setpoint(float torque);
 void control_update_trajectory_setpoint(float pos, float vel, float acc,
                                         float torque, timestamp_t ts);
+/* Publishes a setpoint command, applied at the next control cycle. The time
+ * from cmd->rx_cycles to the control cycle goes to the command latency
+ * statistics. */
+void control_update_setpoint(const struct command_s *cmd);
+/* the same from a locked state, for the CAN receive interrupt */
+void control_update_setpoint_i(const struct command_s *cmd);
+
+/*
+ * Queues a point of a buffered trajectory, time is in the host's time base.
+ * The first point of a trajectory (start set or empty buffer) is played out
+ * after the playout delay, the following ones relative to it.
+ * Returns false if the buffer is full. Only one thread may queue points.
+ */
+bool control_queue_trajectory_point(uint32_t time_us, float pos, float vel,
+                                    float acc, float torque, bool start);
+/*
+ * Queues a point of a buffered trajectory at a local time, for senders in
+ * the synchronized network time base. There is no playout delay.
+ */
+bool control_queue_trajectory_point_at(timestamp_t time, float pos, float vel,
+                                       float acc, float torque);
+uint32_t control_get_trajectory_underruns(void);
+
+/* State of one control cycle, all values are from the same cycle. */
+struct control_state_s {
+    uint32_t cycle;             // control cycle counter
+    timestamp_t timestamp;      // feedback sample time
+    float position;
+    float velocity;
+    float position_setpoint;
+    float velocity_setpoint;
+    float torque;
+    float current;
+    float current_setpoint;
+    float motor_voltage;
+};
+
+/* coherent copy of the state of the last control cycle */
+void control_get_state(struct control_state_s *state);
 
 float control_get_motor_voltage(void);
 float control_get_vel_ctrl_out(void);
@@ -40,6 +187,62 @@ float control_get_current_setpoint(void);
 float control_get_velocity_setpoint(void);
 float control_get_position_setpoint(void);
 
+const char *control_signal_name(enum control_signal signal);
+
+/*
+ * Arms the scope at the next control cycle, a running capture is discarded.
+ * Returns false if the configuration is invalid.
+ */
+bool control_scope_arm(const struct control_scope_config_s *config);
+/* triggers the armed scope, the capture runs even if the motor is disabled */
+void control_scope_trigger(void);
+/* the capture, only read it while its state is SCOPE_DONE */
+const scope_t *control_scope_get(void);
+/* defers arming while another thread reads the capture, calls may nest */
+void control_scope_hold(void);
+void control_scope_release(void);
+void control_scope_get_config(struct control_scope_config_s *config);
+float control_scope_sample_period(void); // [s]
+
+#define CONTROL_BATCH_NB_CHANNELS 4
+
+/* batched telemetry of a signal, see telemetry_batch.h */
+struct control_batch_config_s {
+    bool enabled;
+    enum control_signal signal;
+    unsigned divider;       // a sample every divider velocity loop cycles
+};
+
+/* applied at the next control cycle, returns false if invalid */
+bool control_batch_configure(unsigned channel, const struct control_batch_config_s *config);
+void control_batch_get_config(unsigned channel, struct control_batch_config_s *config);
+/* the consumer side of the channel */
+telemetry_batch_channel_t *control_batch_channel(unsigned channel);
+float control_batch_sample_period(unsigned channel); // [s]
+/* velocity loop period, the unit of the batch and scope dividers [s] */
+float control_cycle_period(void);
+
+#define CONTROL_AGGREGATE_NB_CHANNELS 4
+
+/*
+ * Aggregates a signal at every control cycle, a negative signal disables the
+ * channel. Applied at the next cycle.
+ */
+void control_aggregate_select(unsigned channel, int signal);
+/* ends the current interval at the next control cycle */
+void control_aggregate_request(unsigned channel);
+/* returns true once per request, with the aggregate, the signal it was
+ * computed from and the end of its interval */
+bool control_aggregate_get(unsigned channel, struct signal_aggregate_s *result,
+                           int *signal, timestamp_t *end);
+
+const char *control_timing_stage_name(enum control_timing_stage stage);
+void control_get_timing_stats(enum control_timing_stage stage, cycle_stats_t *stats);
+void control_reset_timing_stats(void);
+/* Adds the cycles since start to a stage, for stages measured outside of the
+ * control loop. A stage must only be updated by one thread. Returns now. */
+uint32_t control_timing_probe(enum control_timing_stage stage, uint32_t start);
+
 #ifdef __cplusplus
 }
 #endif
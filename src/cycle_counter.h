@@ -0,0 +1,33 @@
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include <stdint.h>
+#include <ch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cortex-M DWT cycle counter, runs at the core clock and wraps around every
+ * 2^32 cycles (~60s at 72MHz). Differences of two readings are valid across
+ * a wrap around.
+ */
+
+static inline void cycle_counter_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycle_counter_get(void)
+{
+    return DWT->CYCCNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CYCLE_COUNTER_H */
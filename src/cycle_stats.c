@@ -0,0 +1,50 @@
+#include "cycle_stats.h"
+
+
+void cycle_stats_reset(cycle_stats_t *s)
+{
+    int i;
+    s->count = 0;
+    s->min = UINT32_MAX;
+    s->max = 0;
+    s->sum = 0;
+    for (i = 0; i < CYCLE_STATS_NB_BUCKETS; i++) {
+        s->histogram[i] = 0;
+    }
+}
+
+unsigned cycle_stats_bucket(uint32_t cycles)
+{
+    if (cycles == 0) {
+        return 0;
+    }
+    unsigned bucket = 32 - __builtin_clz(cycles);
+    if (bucket >= CYCLE_STATS_NB_BUCKETS) {
+        return CYCLE_STATS_NB_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+void cycle_stats_update(cycle_stats_t *s, uint32_t cycles)
+{
+    if (s->count == UINT32_MAX) {
+        return; // saturated
+    }
+    s->count++;
+    s->sum += cycles;
+    if (cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->histogram[cycle_stats_bucket(cycles)]++;
+}
+
+uint32_t cycle_stats_mean(const cycle_stats_t *s)
+{
+    if (s->count == 0) {
+        return 0;
+    }
+    return s->sum / s->count;
+}
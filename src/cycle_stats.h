@@ -0,0 +1,35 @@
+#ifndef CYCLE_STATS_H
+#define CYCLE_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CYCLE_STATS_NB_BUCKETS 20   // up to 2^19 cycles (7ms at 72MHz)
+
+/*
+ * Execution time statistics in CPU cycles with a log2 histogram.
+ * histogram[0] counts zero durations, histogram[i] durations in
+ * [2^(i-1), 2^i), the last bucket also counts everything above.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t histogram[CYCLE_STATS_NB_BUCKETS];
+} cycle_stats_t;
+
+
+void cycle_stats_reset(cycle_stats_t *s);
+void cycle_stats_update(cycle_stats_t *s, uint32_t cycles);
+uint32_t cycle_stats_mean(const cycle_stats_t *s);
+unsigned cycle_stats_bucket(uint32_t cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CYCLE_STATS_H */
@@ -0,0 +1,179 @@
+#include <ch.h>
+#include <hal.h>
+#include <chprintf.h>
+#include "parameter/parameter.h"
+#include "main.h"
+#include "control.h"
+#include "cycle_stats.h"
+#include "uavcan_node.h"
+#include "thread_stats.h"
+
+#include "diagnostics.h"
+
+#define CYCLES_PER_US (STM32_SYSCLK / 1000000)
+#define THREAD_STATS_PERIOD MS2ST(1000)
+
+static parameter_namespace_t param_ns_diagnostics;
+static parameter_t param_uart_dump_period;
+static parameter_t param_scope_uart_dump;
+
+
+static void print_cycle_stats(BaseSequentialStream *out, const char *name,
+                              const cycle_stats_t *s)
+{
+    int i;
+    if (s->count == 0) {
+        chprintf(out, "%-16s no samples\n", name);
+        return;
+    }
+    chprintf(out, "%-16s n %9u min %6u max %6u mean %6u cycles (max %5u us)\n",
+             name, s->count, s->min, s->max, cycle_stats_mean(s),
+             s->max / CYCLES_PER_US);
+    chprintf(out, "%-16s log2 hist:", "");
+    for (i = 0; i < CYCLE_STATS_NB_BUCKETS; i++) {
+        if (s->histogram[i] != 0) {
+            chprintf(out, " %d:%u", i, s->histogram[i]);
+        }
+    }
+    chprintf(out, "\n");
+}
+
+static void print_control_timing(BaseSequentialStream *out)
+{
+    int i;
+    cycle_stats_t stats;
+    chprintf(out, "control loop timing\n");
+    for (i = 0; i < CONTROL_TIMING_NB_STAGES; i++) {
+        control_get_timing_stats((enum control_timing_stage)i, &stats);
+        print_cycle_stats(out, control_timing_stage_name((enum control_timing_stage)i), &stats);
+    }
+}
+
+static void print_can_rx_stats(BaseSequentialStream *out)
+{
+    struct uavcan_rx_stats_s stats;
+    uavcan_node_get_rx_stats(&stats);
+    chprintf(out, "can rx frames %u fast path %u software rejected %u\n",
+             stats.frames, stats.fast_path, stats.software_rejects);
+}
+
+static void print_can_comm_stats(BaseSequentialStream *out)
+{
+    unsigned i;
+    struct uavcan_comm_stats_s s;
+    for (i = 0; uavcan_node_get_comm_stats(i, &s); i++) {
+        chprintf(out, "can%u pool %u/%u peak %u, rx queue peak %u/%u overflows %u, "
+                 "tx mailboxes peak %u full %u times\n",
+                 i, s.pool_used, s.pool_capacity, s.pool_peak,
+                 s.rx_queue_peak, s.rx_queue_capacity, s.rx_queue_overflows,
+                 s.tx_mailboxes_peak, s.tx_mailboxes_full);
+        chprintf(out, "can%u errors %u bus off %u tec %u rec %u, "
+                 "transfers rx %f/s tx %f/s errors %u\n",
+                 i, s.errors, s.bus_off, s.tx_error_counter, s.rx_error_counter,
+                 s.rx_transfers_per_s, s.tx_transfers_per_s, s.transfer_errors);
+    }
+}
+
+static void print_can_tx_stats(BaseSequentialStream *out)
+{
+    unsigned i;
+    struct uavcan_tx_stats_s stats;
+    for (i = 0; uavcan_node_get_tx_stats(i, &stats); i++) {
+        chprintf(out, "can tx %-16s expired %u replaced %u\n",
+                 stats.name, stats.expired, stats.replaced);
+    }
+}
+
+static void print_thread_stats(BaseSequentialStream *out)
+{
+    struct thread_stats_s stats;
+    thread_t *tp = chRegFirstThread();
+    while (tp != NULL) {
+        thread_stats_get(tp, &stats);
+        chprintf(out, "thread %-16s load %5.1f%% stack free %5d bytes\n",
+                 stats.name, stats.cpu_load * 100, stats.stack_free);
+        tp = chRegNextThread(tp);
+    }
+    chprintf(out, "thread %-16s load %5.1f%%\n", "(irq)", thread_stats_irq_load() * 100);
+}
+
+// prints a frozen scope capture as CSV, one row per sample
+static void print_scope_capture(BaseSequentialStream *out)
+{
+    unsigned sample, channel;
+    struct control_scope_config_s cfg;
+    const scope_t *scope = control_scope_get();
+
+    control_scope_get_config(&cfg);
+    chprintf(out, "scope capture %u, period %f s, trigger at sample %u\n",
+             scope->sequence, control_scope_sample_period(),
+             scope_trigger_sample(scope));
+    chprintf(out, "sample");
+    for (channel = 0; channel < scope->nb_channels; channel++) {
+        chprintf(out, ",%s", control_signal_name(cfg.signals[channel]));
+    }
+    chprintf(out, "\n");
+    for (sample = 0; sample < scope_nb_samples(scope); sample++) {
+        chprintf(out, "%u", sample);
+        for (channel = 0; channel < scope->nb_channels; channel++) {
+            chprintf(out, ",%f", scope_read(scope, sample, channel));
+        }
+        chprintf(out, "\n");
+    }
+}
+
+static void print_uart_stats(BaseSequentialStream *out, const DMAUARTDriver *uart)
+{
+    chprintf(out, "uart rx errors %u overruns %u\n", uart->rx_errors, uart->rx_overruns);
+}
+
+// chprintf with floats, see the stack headroom in print_thread_stats
+static THD_WORKING_AREA(diagnostics_wa, 1024);
+static THD_FUNCTION(diagnostics, arg)
+{
+    const DMAUARTDriver *uart = (const DMAUARTDriver *)arg;
+    chRegSetThreadName("diagnostics");
+    systime_t last_timing_dump = chVTGetSystemTime();
+    systime_t last_thread_stats = chVTGetSystemTime();
+    uint32_t scope_dumped = control_scope_get()->sequence;
+
+    while (1) {
+        if (chVTTimeElapsedSinceX(last_thread_stats) >= THREAD_STATS_PERIOD) {
+            last_thread_stats += THREAD_STATS_PERIOD;
+            thread_stats_sample();
+        }
+
+        if (parameter_scalar_get(&param_scope_uart_dump) != 0) {
+            // a new capture is armed once this one is printed
+            control_scope_hold();
+            const scope_t *scope = control_scope_get();
+            if (scope_get_state(scope) == SCOPE_DONE && scope->sequence != scope_dumped) {
+                scope_dumped = scope->sequence;
+                print_scope_capture(ch_stdout);
+            }
+            control_scope_release();
+        }
+
+        float period = parameter_scalar_get(&param_uart_dump_period);
+        if (period > 0 && chVTTimeElapsedSinceX(last_timing_dump) >= MS2ST(period * 1000)) {
+            last_timing_dump = chVTGetSystemTime();
+            print_control_timing(ch_stdout);
+            print_can_rx_stats(ch_stdout);
+            print_can_tx_stats(ch_stdout);
+            print_can_comm_stats(ch_stdout);
+            print_thread_stats(ch_stdout);
+            print_uart_stats(ch_stdout, uart);
+        }
+        chThdSleepMilliseconds(100);
+    }
+    return 0;
+}
+
+void diagnostics_start(DMAUARTDriver *uart)
+{
+    parameter_namespace_declare(&param_ns_diagnostics, &parameter_root_ns, "diagnostics");
+    parameter_scalar_declare_with_default(&param_uart_dump_period, &param_ns_diagnostics, "uart_dump_period", 0);
+    parameter_scalar_declare_with_default(&param_scope_uart_dump, &param_ns_diagnostics, "scope_uart_dump", 0);
+
+    chThdCreateStatic(diagnostics_wa, sizeof(diagnostics_wa), LOWPRIO, diagnostics, uart);
+}
@@ -0,0 +1,23 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "dma_uart_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Periodic human readable dump of the runtime statistics to the UART.
+ * The period is set by the parameter diagnostics/uart_dump_period [s],
+ * 0 disables the dump. The reception errors of uart are part of it.
+ */
+void diagnostics_start(DMAUARTDriver *uart);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIAGNOSTICS_H */
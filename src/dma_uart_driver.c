@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <string.h>
+#include <ch.h>
+#include <hal.h>
+#include "thread_stats.h"
+#include "dma_uart_driver.h"
+
+// DMA1 request mapping of USART3
+#define USART3_RX_DMA_STREAM    STM32_DMA1_STREAM3
+#define USART3_TX_DMA_STREAM    STM32_DMA1_STREAM2
+
+#define RX_DMA_MODE (STM32_DMA_CR_PL(2) | STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC \
+                     | STM32_DMA_CR_CIRC | STM32_DMA_CR_HTIE | STM32_DMA_CR_TCIE)
+#define TX_DMA_MODE (STM32_DMA_CR_PL(1) | STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC \
+                     | STM32_DMA_CR_TCIE)
+
+#define USART_RX_ERRORS (USART_ISR_ORE | USART_ISR_NE | USART_ISR_FE | USART_ISR_PE)
+
+// bytes copied per critical section
+#define TX_COPY_CHUNK   64
+
+#define RX_HALF (DMA_UART_RX_BUFFER_SIZE / 2)
+
+#if DMA_UART_RX_BUFFER_SIZE % 2 != 0
+#error "DMA_UART_RX_BUFFER_SIZE must be even"
+#endif
+
+static DMAUARTDriver *usart3_driver;
+
+// Virtual Methods Table
+const struct BaseSequentialStreamVMT dma_uart_vmt = {
+    dma_uart_write,
+    dma_uart_read,
+    dma_uart_put,
+    dma_uart_get,
+};
+
+// position of the DMA in the RX buffer
+static size_t rx_head(DMAUARTDriver *d)
+{
+    size_t head = DMA_UART_RX_BUFFER_SIZE - dmaStreamGetTransactionSize(d->rx_dma);
+    if (head == DMA_UART_RX_BUFFER_SIZE) {
+        head = 0;
+    }
+    return head;
+}
+
+/*
+ * Bytes written by the DMA since start, modulo 2^32. Assumes the half and
+ * full transfer interrupts are served within half a buffer.
+ */
+static uint32_t rx_written(DMAUARTDriver *d, size_t *head)
+{
+    uint32_t halves;
+    do {
+        halves = d->rx_halves;
+        *head = rx_head(d);
+    } while (halves != d->rx_halves);
+    // the interrupt of the half the DMA just left may still be pending
+    if ((*head >= RX_HALF) != (halves % 2)) {
+        halves++;
+    }
+    return halves * RX_HALF + *head % RX_HALF;
+}
+
+size_t dma_uart_read_timeout(DMAUARTDriver *d, uint8_t *bp, size_t n, systime_t timeout)
+{
+    uint32_t available;
+    while (1) {
+        size_t head;
+        uint32_t written = rx_written(d, &head);
+        available = written - d->rx_read;
+        if (available > DMA_UART_RX_BUFFER_SIZE) {
+            // lapped by the DMA, resume at its position
+            d->rx_overruns++;
+            d->rx_read = written;
+            d->rx_tail = head;
+            continue;
+        }
+        if (available > 0) {
+            break;
+        }
+        if (chBSemWaitTimeout(&d->rx_sem, timeout) == MSG_TIMEOUT) {
+            return 0;
+        }
+    }
+
+    if (n > available) {
+        n = available;
+    }
+    size_t count = 0;
+    while (count < n) {
+        size_t len = DMA_UART_RX_BUFFER_SIZE - d->rx_tail;
+        if (len > n - count) {
+            len = n - count;
+        }
+        memcpy(&bp[count], &d->rx_buf[d->rx_tail], len);
+        count += len;
+        d->rx_tail = (d->rx_tail + len) % DMA_UART_RX_BUFFER_SIZE;
+    }
+    d->rx_read += count;
+    return count;
+}
+
+size_t dma_uart_read(void *instance, uint8_t *bp, size_t n)
+{
+    size_t count = 0;
+    while (count < n) {
+        count += dma_uart_read_timeout(instance, &bp[count], n - count, TIME_INFINITE);
+    }
+    return n;
+}
+
+msg_t dma_uart_get(void *instance)
+{
+    uint8_t b;
+    dma_uart_read(instance, &b, 1);
+    return b;
+}
+
+// sends the fill buffer and swaps, called from a locked state
+static void tx_start(DMAUARTDriver *d)
+{
+    dmaStreamSetMemory0(d->tx_dma, d->tx_buf[d->tx_fill]);
+    dmaStreamSetTransactionSize(d->tx_dma, d->tx_len);
+    dmaStreamSetMode(d->tx_dma, TX_DMA_MODE);
+    dmaStreamEnable(d->tx_dma);
+    d->tx_fill ^= 1;
+    d->tx_len = 0;
+    d->tx_busy = true;
+}
+
+size_t dma_uart_write(void *instance, const uint8_t *bp, size_t n)
+{
+    DMAUARTDriver *d = instance;
+    size_t count = 0;
+    while (count < n) {
+        chSysLock();
+        size_t len = DMA_UART_TX_BUFFER_SIZE - d->tx_len;
+        if (len == 0) {
+            // both buffers full, wait for the transfer to end
+            chBSemWaitTimeoutS(&d->tx_sem, TIME_INFINITE);
+            chSysUnlock();
+            continue;
+        }
+        if (len > n - count) {
+            len = n - count;
+        }
+        if (len > TX_COPY_CHUNK) {
+            len = TX_COPY_CHUNK;
+        }
+        memcpy(&d->tx_buf[d->tx_fill][d->tx_len], &bp[count], len);
+        d->tx_len += len;
+        count += len;
+        if (!d->tx_busy) {
+            tx_start(d);
+        }
+        chSysUnlock();
+    }
+    return n;
+}
+
+msg_t dma_uart_put(void *instance, uint8_t b)
+{
+    dma_uart_write(instance, &b, 1);
+    return MSG_OK;
+}
+
+static void rx_dma_callback(void *p, uint32_t flags)
+{
+    DMAUARTDriver *d = p;
+    thread_stats_irq_enter();
+    if (flags & (STM32_DMA_ISR_HTIF | STM32_DMA_ISR_TCIF)) {
+        d->rx_halves++;
+    }
+    chSysLockFromISR();
+    chBSemSignalI(&d->rx_sem);
+    chSysUnlockFromISR();
+    thread_stats_irq_exit();
+}
+
+static void tx_dma_callback(void *p, uint32_t flags)
+{
+    (void)flags;
+    DMAUARTDriver *d = p;
+    thread_stats_irq_enter();
+    chSysLockFromISR();
+    dmaStreamDisable(d->tx_dma);
+    d->tx_busy = false;
+    if (d->tx_len > 0) {
+        tx_start(d);
+    }
+    chBSemSignalI(&d->tx_sem);
+    chSysUnlockFromISR();
+    thread_stats_irq_exit();
+}
+
+CH_IRQ_HANDLER(STM32_USART3_HANDLER)
+{
+    CH_IRQ_PROLOGUE();
+    thread_stats_irq_enter();
+
+    DMAUARTDriver *d = usart3_driver;
+    uint32_t isr = d->dev->ISR;
+    // the ICR clear bits are at the same position as the ISR flags
+    d->dev->ICR = isr & (USART_ISR_IDLE | USART_RX_ERRORS);
+    if (isr & USART_RX_ERRORS) {
+        d->rx_errors++;
+    }
+    if (isr & USART_ISR_IDLE) {
+        chSysLockFromISR();
+        chBSemSignalI(&d->rx_sem);
+        chSysUnlockFromISR();
+    }
+
+    thread_stats_irq_exit();
+    CH_IRQ_EPILOGUE();
+}
+
+void dma_uart_start(DMAUARTDriver *d, USART_TypeDef *uart, uint32_t baud)
+{
+    osalDbgAssert(uart == USART3, "only USART3 has a DMA mapping");
+
+    d->vmt = &dma_uart_vmt;
+    d->dev = uart;
+    d->rx_dma = USART3_RX_DMA_STREAM;
+    d->tx_dma = USART3_TX_DMA_STREAM;
+    d->rx_tail = 0;
+    d->rx_read = 0;
+    d->rx_halves = 0;
+    d->rx_errors = 0;
+    d->rx_overruns = 0;
+    d->tx_fill = 0;
+    d->tx_len = 0;
+    d->tx_busy = false;
+    chBSemObjectInit(&d->rx_sem, true);
+    chBSemObjectInit(&d->tx_sem, true);
+    usart3_driver = d;
+
+    rccEnableUSART3(FALSE); // FALSE = disable low power flag
+
+    bool err;
+    err = dmaStreamAllocate(d->rx_dma, DMA_UART_IRQ_PRIORITY, rx_dma_callback, d);
+    osalDbgAssert(!err, "RX DMA stream already allocated");
+    err = dmaStreamAllocate(d->tx_dma, DMA_UART_IRQ_PRIORITY, tx_dma_callback, d);
+    osalDbgAssert(!err, "TX DMA stream already allocated");
+    (void)err;
+    dmaStreamSetPeripheral(d->rx_dma, &uart->RDR);
+    dmaStreamSetPeripheral(d->tx_dma, &uart->TDR);
+
+    // baud rate, (with rounding)
+    uart->BRR = ((2 * STM32_PCLK1) + baud) / (2 * baud);
+
+    // 1 stop bit
+    uart->CR2 = 0;
+
+    // DMA on both directions, error interrupt
+    uart->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE;
+
+    // clear all flags
+    uart->ICR = 0xFFFFFFFF;
+
+    dmaStreamSetMemory0(d->rx_dma, d->rx_buf);
+    dmaStreamSetTransactionSize(d->rx_dma, DMA_UART_RX_BUFFER_SIZE);
+    dmaStreamSetMode(d->rx_dma, RX_DMA_MODE);
+    dmaStreamEnable(d->rx_dma);
+
+    nvicEnableVector(STM32_USART3_NUMBER, DMA_UART_IRQ_PRIORITY);
+
+    // tx/rx, 8bits, no parity, idle line interrupt & enable uart
+    uart->CR1 = USART_CR1_UE | USART_CR1_RE | USART_CR1_TE | USART_CR1_IDLEIE;
+}
@@ -0,0 +1,78 @@
+#ifndef DMA_UART_DRIVER_H
+#define DMA_UART_DRIVER_H
+
+#include <stdint.h>
+#include <ch.h>
+#include <hal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * UART stream with circular DMA reception and double buffered DMA
+ * transmission, only USART3 is supported.
+ *
+ * The reader is woken by the idle line and the DMA half and full transfer
+ * interrupts, so a whole datagram is read at once. The RX buffer must hold
+ * what arrives between two reads. If the DMA laps the reader, the unread
+ * bytes are dropped and counted in rx_overruns.
+ *
+ * Writes are copied to the free TX buffer while the other one is sent, the
+ * next transfer starts from the DMA interrupt, so byte-wise writes
+ * (chprintf) are sent in bulk without a flush.
+ */
+
+#ifndef DMA_UART_RX_BUFFER_SIZE
+#define DMA_UART_RX_BUFFER_SIZE     1024
+#endif
+
+#ifndef DMA_UART_TX_BUFFER_SIZE
+#define DMA_UART_TX_BUFFER_SIZE     256     // per buffer, two buffers
+#endif
+
+#ifndef DMA_UART_IRQ_PRIORITY
+#define DMA_UART_IRQ_PRIORITY       12
+#endif
+
+extern const struct BaseSequentialStreamVMT dma_uart_vmt;
+
+typedef struct {
+    const struct BaseSequentialStreamVMT *vmt;
+    USART_TypeDef *dev;
+    const stm32_dma_stream_t *rx_dma;
+    const stm32_dma_stream_t *tx_dma;
+
+    uint8_t rx_buf[DMA_UART_RX_BUFFER_SIZE];
+    size_t rx_tail;             // next byte to read
+    uint32_t rx_read;           // bytes read since start, modulo 2^32
+    volatile uint32_t rx_halves;    // half buffers written by the DMA
+    binary_semaphore_t rx_sem;  // signaled when data arrived
+    uint32_t rx_errors;         // overrun, noise and framing errors
+    uint32_t rx_overruns;       // the DMA overwrote unread bytes
+
+    uint8_t tx_buf[2][DMA_UART_TX_BUFFER_SIZE];
+    unsigned tx_fill;           // buffer written to, the other one is sent
+    size_t tx_len;              // bytes in the fill buffer
+    bool tx_busy;
+    binary_semaphore_t tx_sem;  // signaled at the end of a transfer
+} DMAUARTDriver;
+
+msg_t dma_uart_put(void *instance, uint8_t b);
+msg_t dma_uart_get(void *instance);
+size_t dma_uart_write(void *instance, const uint8_t *bp, size_t n);
+size_t dma_uart_read(void *instance, uint8_t *bp, size_t n);
+
+/*
+ * Returns the bytes already received, up to n, or waits for at least one.
+ * Returns 0 after timeout.
+ */
+size_t dma_uart_read_timeout(DMAUARTDriver *driver, uint8_t *bp, size_t n, systime_t timeout);
+
+void dma_uart_start(DMAUARTDriver *driver, USART_TypeDef *uart, uint32_t baud);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DMA_UART_DRIVER_H */
@@ -2,6 +2,9 @@
 #include <math.h>
 #include <rpm.h>
 
+#define ANALOG_POSITION_LSB (2 * (float)M_PI / 65536) // RPM & potentiometer ticks
+#define EDGE_TIMING_VELOCITY_SUBTICKS 256 // velocity_ticks per accumulator tick
+
 
 static int32_t compute_delta_accumulator_periodic(uint16_t encoder,
                                                   uint16_t previous,
@@ -33,7 +36,7 @@ static float compute_encoder_position_periodic(int32_t accumulator,
                                                uint32_t ticks_per_rev,
                                                uint16_t q)
 {
-    return (float)accumulator / ticks_per_rev / q * 2 * M_PI;
+    return (float)accumulator / ticks_per_rev / q * 2 * (float)M_PI;
 }
 
 static float compute_encoder_position_bounded(int32_t accumulator,
@@ -41,24 +44,60 @@ static float compute_encoder_position_bounded(int32_t accumulator,
                                               uint16_t p,
                                               uint16_t q)
 {
-    return (float)accumulator / ticks_per_rev * p / q * 2 * M_PI;
+    return (float)accumulator / ticks_per_rev * p / q * 2 * (float)M_PI;
 }
 
-static float compute_encoder_velocity_periodic(int32_t delta_accumulator,
+static float compute_encoder_velocity_periodic(float delta_accumulator,
                                                uint32_t ticks_per_rev,
                                                uint16_t q,
                                                float delta_t)
 {
-    return (float)delta_accumulator / ticks_per_rev / q * 2 * M_PI / delta_t;
+    return delta_accumulator / ticks_per_rev / q * 2 * (float)M_PI / delta_t;
 }
 
-static float compute_encoder_velocity_bounded(int32_t delta_accumulator,
+static float compute_encoder_velocity_bounded(float delta_accumulator,
                                                uint32_t ticks_per_rev,
                                                uint16_t p,
                                                uint16_t q,
                                                float delta_t)
 {
-    return (float)delta_accumulator / ticks_per_rev * p / q * 2 * M_PI / delta_t;
+    return delta_accumulator / ticks_per_rev * p / q * 2 * (float)M_PI / delta_t;
+}
+
+/*
+ * Position change of the accumulator during delta_t, from the encoder edge
+ * timing if enabled, p is the accumulator ticks per encoder count.
+ */
+static float compute_velocity_delta(struct encoder_s *encoder,
+                                    int32_t delta_accumulator,
+                                    uint16_t p,
+                                    const struct feedback_s *feedback)
+{
+    if (!encoder->velocity_edge_timing) {
+        return delta_accumulator;
+    }
+    float counts_per_s = velocity_estimator_update(&encoder->velocity_estimator,
+                                                   &feedback->input.primary_encoder_edge,
+                                                   feedback->input.time,
+                                                   feedback->input.time_lsb);
+    return counts_per_s * p * feedback->input.delta_t;
+}
+
+static int32_t velocity_ticks_from_delta(const struct encoder_s *encoder,
+                                         float velocity_delta)
+{
+    if (encoder->velocity_edge_timing) {
+        return lrintf(velocity_delta * EDGE_TIMING_VELOCITY_SUBTICKS);
+    }
+    return lrintf(velocity_delta);
+}
+
+static void analog_ticks_from_float(struct feedback_s *feedback)
+{
+    feedback->output.position_ticks =
+        lrintf(feedback->output.position / ANALOG_POSITION_LSB);
+    feedback->output.velocity_ticks =
+        lrintf(feedback->output.velocity * feedback->input.delta_t / ANALOG_POSITION_LSB);
 }
 
 
@@ -81,6 +120,7 @@ void feedback_compute(struct feedback_s *feedback)
                                           &position);
             feedback->output.position = position - feedback->rpm.phase;
             feedback->output.actuator_is_periodic = true;
+            analog_ticks_from_float(feedback);
             break;
         }
         case FEEDBACK_PRIMARY_ENCODER_PERIODIC : {
@@ -97,6 +137,16 @@ void feedback_compute(struct feedback_s *feedback)
                                           feedback->primary_encoder.ticks_per_rev,
                                           feedback->primary_encoder.transmission_q);
 
+            float velocity_delta = compute_velocity_delta(
+                    &feedback->primary_encoder,
+                    delta_accumulator,
+                    feedback->primary_encoder.transmission_p,
+                    feedback);
+
+            feedback->output.position_ticks = feedback->primary_encoder.accumulator;
+            feedback->output.velocity_ticks = velocity_ticks_from_delta(
+                    &feedback->primary_encoder, velocity_delta);
+
             // position
             feedback->output.position = compute_encoder_position_periodic(
                     feedback->primary_encoder.accumulator,
@@ -107,7 +157,7 @@ void feedback_compute(struct feedback_s *feedback)
 
             // velocity
             feedback->output.velocity = compute_encoder_velocity_periodic(
-                    delta_accumulator,
+                    velocity_delta,
                     feedback->primary_encoder.ticks_per_rev,
                     feedback->primary_encoder.transmission_q,
                     feedback->input.delta_t
@@ -125,6 +175,16 @@ void feedback_compute(struct feedback_s *feedback)
             feedback->primary_encoder.accumulator += delta_accumulator;
             feedback->primary_encoder.previous = feedback->input.primary_encoder;
 
+            float velocity_delta = compute_velocity_delta(
+                    &feedback->primary_encoder,
+                    delta_accumulator,
+                    1,
+                    feedback);
+
+            feedback->output.position_ticks = feedback->primary_encoder.accumulator;
+            feedback->output.velocity_ticks = velocity_ticks_from_delta(
+                    &feedback->primary_encoder, velocity_delta);
+
             // position
             feedback->output.position = compute_encoder_position_bounded(
                     feedback->primary_encoder.accumulator,
@@ -135,7 +195,7 @@ void feedback_compute(struct feedback_s *feedback)
 
             // velocity
             feedback->output.velocity = compute_encoder_velocity_bounded(
-                    delta_accumulator,
+                    velocity_delta,
                     feedback->primary_encoder.ticks_per_rev,
                     feedback->primary_encoder.transmission_p,
                     feedback->primary_encoder.transmission_q,
@@ -171,6 +231,16 @@ void feedback_compute(struct feedback_s *feedback)
                                           feedback->secondary_encoder.ticks_per_rev,
                                           feedback->secondary_encoder.transmission_q);
 
+            float velocity_delta = compute_velocity_delta(
+                    &feedback->primary_encoder,
+                    delta_accumulator_primary,
+                    feedback->primary_encoder.transmission_p,
+                    feedback);
+
+            feedback->output.position_ticks = feedback->secondary_encoder.accumulator;
+            feedback->output.velocity_ticks = velocity_ticks_from_delta(
+                    &feedback->primary_encoder, velocity_delta);
+
             // position
             feedback->output.position = compute_encoder_position_periodic(
                     feedback->secondary_encoder.accumulator,
@@ -181,7 +251,7 @@ void feedback_compute(struct feedback_s *feedback)
 
             // velocity
             feedback->output.velocity = compute_encoder_velocity_periodic(
-                    delta_accumulator_primary,
+                    velocity_delta,
                     feedback->primary_encoder.ticks_per_rev,
                     feedback->primary_encoder.transmission_q,
                     feedback->input.delta_t
@@ -201,7 +271,55 @@ void feedback_compute(struct feedback_s *feedback)
 
             feedback->output.position = position;
             feedback->output.actuator_is_periodic = false;
+            analog_ticks_from_float(feedback);
             break;
         }
     }
 }
+
+float feedback_position_lsb(const struct feedback_s *feedback)
+{
+    switch (feedback->input_selection) {
+        case FEEDBACK_PRIMARY_ENCODER_PERIODIC :
+            return compute_encoder_position_periodic(1,
+                    feedback->primary_encoder.ticks_per_rev,
+                    feedback->primary_encoder.transmission_q);
+        case FEEDBACK_PRIMARY_ENCODER_BOUNDED :
+            return compute_encoder_position_bounded(1,
+                    feedback->primary_encoder.ticks_per_rev,
+                    feedback->primary_encoder.transmission_p,
+                    feedback->primary_encoder.transmission_q);
+        case FEEDBACK_TWO_ENCODERS_PERIODIC :
+            return compute_encoder_position_periodic(1,
+                    feedback->secondary_encoder.ticks_per_rev,
+                    feedback->secondary_encoder.transmission_q);
+        default :
+            return ANALOG_POSITION_LSB;
+    }
+}
+
+float feedback_velocity_lsb(const struct feedback_s *feedback)
+{
+    float lsb = feedback_position_lsb(feedback);
+    if (feedback->input_selection == FEEDBACK_TWO_ENCODERS_PERIODIC) {
+        lsb = compute_encoder_position_periodic(1,
+                feedback->primary_encoder.ticks_per_rev,
+                feedback->primary_encoder.transmission_q);
+    }
+    if (feedback_velocity_is_edge_timed(feedback)) {
+        lsb /= EDGE_TIMING_VELOCITY_SUBTICKS;
+    }
+    return lsb;
+}
+
+bool feedback_velocity_is_edge_timed(const struct feedback_s *feedback)
+{
+    switch (feedback->input_selection) {
+        case FEEDBACK_PRIMARY_ENCODER_PERIODIC :
+        case FEEDBACK_PRIMARY_ENCODER_BOUNDED :
+        case FEEDBACK_TWO_ENCODERS_PERIODIC :
+            return feedback->primary_encoder.velocity_edge_timing;
+        default :
+            return false;
+    }
+}
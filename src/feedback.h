@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "velocity_estimator.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,6 +40,9 @@ struct encoder_s {
     uint16_t transmission_q;    // is p / q (i.e. working_end_pos = accumulator / q)
 
     uint32_t ticks_per_rev;     // one physical revolution of the encoder (datasheet)
+
+    bool velocity_edge_timing;  // velocity from edge timing instead of deltas
+    velocity_estimator_t velocity_estimator;
 };
 
 struct potentiometer_s {
@@ -57,6 +61,10 @@ struct feedback_s {
         float position; // between 0 and 2*PI for periodic actuators
         float velocity;
         bool actuator_is_periodic;
+        // integer outputs for the fixed point control loop
+        int32_t position_ticks; // in units of feedback_position_lsb()
+        int32_t velocity_ticks; // position change during delta_t, in units
+                                // of feedback_velocity_lsb()
     } output;
 
     struct {
@@ -64,6 +72,10 @@ struct feedback_s {
         uint16_t primary_encoder;
         uint16_t secondary_encoder;
         float delta_t;
+        // last primary encoder edge for edge timing velocity estimation
+        struct encoder_edge_s primary_encoder_edge;
+        uint32_t time;      // current time in units of time_lsb
+        float time_lsb;     // [s]
     } input;
 
     struct encoder_s primary_encoder;
@@ -77,6 +89,13 @@ struct feedback_s {
 
 void feedback_compute(struct feedback_s *feedback);
 
+// [rad] per tick of the integer outputs, depends on the input configuration
+float feedback_position_lsb(const struct feedback_s *feedback);
+float feedback_velocity_lsb(const struct feedback_s *feedback);
+
+// true if the velocity output comes from the encoder edge timing
+bool feedback_velocity_is_edge_timed(const struct feedback_s *feedback);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,39 @@
+#include <math.h>
+#include "feedforward.h"
+
+
+void feedforward_init(feedforward_t *ff)
+{
+    ff->inertia = 0;
+    ff->viscous = 0;
+    ff->coulomb = 0;
+    ff->coulomb_band = 0;
+    ff->offset = 0;
+    ff->gravity = 0;
+}
+
+static float coulomb_friction(const feedforward_t *ff, float vel)
+{
+    if (fabsf(vel) <= ff->coulomb_band) {
+        if (ff->coulomb_band == 0) {
+            return 0;
+        }
+        return ff->coulomb * vel / ff->coulomb_band;
+    }
+    return copysignf(ff->coulomb, vel);
+}
+
+float feedforward_torque(const feedforward_t *ff, const struct setpoint_s *setpts)
+{
+    if (!setpts->velocity_control_enabled) {
+        return 0; // torque control
+    }
+    float torque = ff->inertia * setpts->acceleration_setpt
+                   + ff->viscous * setpts->velocity_setpt
+                   + coulomb_friction(ff, setpts->velocity_setpt)
+                   + ff->offset;
+    if (setpts->position_control_enabled) {
+        torque += ff->gravity * cosf(setpts->position_setpt);
+    }
+    return torque;
+}
@@ -0,0 +1,34 @@
+#ifndef FEEDFORWARD_H
+#define FEEDFORWARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "setpoint.h"
+
+/*
+ * Torque feedforward model of the actuator, all at the output:
+ * torque = inertia * acc + viscous * vel + coulomb * sign(vel)
+ *          + offset + gravity * cos(pos)
+ * The sign is linear within +-coulomb_band to avoid chattering at rest.
+ */
+typedef struct {
+    float inertia;      // [Nm/(rad/s^2)]
+    float viscous;      // [Nm/(rad/s)]
+    float coulomb;      // [Nm]
+    float coulomb_band; // [rad/s]
+    float offset;       // [Nm]
+    float gravity;      // [Nm] at position 0
+} feedforward_t;
+
+void feedforward_init(feedforward_t *ff);
+
+// returns the model torque for the planned motion, 0 if there is none
+float feedforward_torque(const feedforward_t *ff, const struct setpoint_s *setpts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FEEDFORWARD_H */
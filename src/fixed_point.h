@@ -0,0 +1,137 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed point helpers
+ * ===================
+ *
+ * Signals are int32_t with a unit per LSB, Q31 values are fractions of a
+ * full scale (value = q * full_scale / 2^31). All arithmetic saturates.
+ * On Cortex-M4 the saturating instructions of the DSP extension are used.
+ *
+ * Arbitrary real factors (gains, unit conversions) are stored as a Q31
+ * mantissa and a power of two exponent, computed once from a float.
+ */
+
+typedef int32_t q31_t;
+
+typedef struct {
+    q31_t mantissa;     // in [0.5, 1) or (-1, -0.5], 0 for a zero gain
+    int8_t exponent;    // gain = mantissa / 2^31 * 2^exponent
+} q31_gain_t;
+
+
+static inline q31_t q31_saturate(int64_t x)
+{
+    if (x > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (x < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (q31_t)x;
+}
+
+static inline q31_t q31_add(q31_t a, q31_t b)
+{
+#if defined(__ARM_FEATURE_DSP)
+    q31_t r;
+    __asm__ ("qadd %0, %1, %2" : "=r" (r) : "r" (a), "r" (b));
+    return r;
+#else
+    return q31_saturate((int64_t)a + b);
+#endif
+}
+
+static inline q31_t q31_sub(q31_t a, q31_t b)
+{
+#if defined(__ARM_FEATURE_DSP)
+    q31_t r;
+    __asm__ ("qsub %0, %1, %2" : "=r" (r) : "r" (a), "r" (b));
+    return r;
+#else
+    return q31_saturate((int64_t)a - b);
+#endif
+}
+
+static inline q31_t q31_neg(q31_t a)
+{
+    return q31_sub(0, a);
+}
+
+static inline q31_t q31_limit_sym(q31_t x, q31_t limit)
+{
+    if (x > limit) {
+        return limit;
+    }
+    if (x < -limit) {
+        return -limit;
+    }
+    return x;
+}
+
+// a * b / 2^31, rounded
+static inline q31_t q31_mul(q31_t a, q31_t b)
+{
+    return q31_saturate(((int64_t)a * b + (1 << 30)) >> 31);
+}
+
+// x * gain, rounded and saturated
+static inline int32_t q31_gain_apply(q31_gain_t gain, int32_t x)
+{
+    int64_t product = (int64_t)x * gain.mantissa;
+    int shift = 31 - gain.exponent;     // in [0, 62] by construction
+    if (shift == 0) {
+        return q31_saturate(product);
+    }
+    return q31_saturate((product + ((int64_t)1 << (shift - 1))) >> shift);
+}
+
+static inline q31_gain_t q31_gain_from_float(float gain)
+{
+    q31_gain_t g = {0, 0};
+    int exponent;
+    float mantissa = frexpf(gain, &exponent);
+    if (mantissa == 0 || exponent < -31) {
+        return g;   // too small, or zero
+    }
+    if (exponent > 31) {
+        exponent = 31;
+        mantissa = copysignf(1, mantissa);
+    }
+    // llrintf: the clamped mantissa of 1 does not fit in a 32 bit long
+    g.mantissa = q31_saturate(llrintf(mantissa * 2147483648.f));
+    g.exponent = exponent;
+    return g;
+}
+
+// x / lsb, saturated
+static inline int32_t q31_from_float(float x, float lsb)
+{
+    float q = x / lsb;
+    if (q >= 2147483647.f) {
+        return INT32_MAX;
+    }
+    if (q <= -2147483648.f) {
+        return INT32_MIN;
+    }
+    return lrintf(q);
+}
+
+static inline float q31_to_float(int32_t q, float lsb)
+{
+    return q * lsb;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FIXED_POINT_H */
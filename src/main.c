@@ -2,6 +2,7 @@
 #include <hal.h>
 #include <chprintf.h>
 #include <blocking_uart_driver.h>
+#include "dma_uart_driver.h"
 #include "motor_pwm.h"
 #include "control.h"
 #include "setpoint.h"
@@ -17,10 +18,23 @@
 #include "uavcan_node.h"
 #include "timestamp/timestamp_stm32.h"
 #include "index.h"
+#include "cycle_counter.h"
+#include "thread_stats.h"
+#include "diagnostics.h"
+
+#ifndef UART_BAUDRATE
+#define UART_BAUDRATE 115200
+#endif
+
+#ifndef PARAMETER_DATAGRAM_BUFFER_SIZE
+#define PARAMETER_DATAGRAM_BUFFER_SIZE 1024
+#endif
 
 BaseSequentialStream* ch_stdout;
 parameter_namespace_t parameter_root_ns;
 
+static DMAUARTDriver uart;
+
 
 static void _stream_sndfn(void *arg, const void *p, size_t len)
 {
@@ -78,12 +92,22 @@ static void parameter_decode_cb(const void *dtgrm, size_t len)
 static THD_WORKING_AREA(parameter_listener_wa, 512);
 static THD_FUNCTION(parameter_listener, arg)
 {
-    static char rcv_buf[200];
+    static char rcv_buf[PARAMETER_DATAGRAM_BUFFER_SIZE];
+    static uint8_t chunk[128];
     static serial_datagram_rcv_handler_t rcv_handler;
     serial_datagram_rcv_handler_init(&rcv_handler, &rcv_buf, sizeof(rcv_buf), parameter_decode_cb);
+    DMAUARTDriver *port = (DMAUARTDriver*)arg;
+    uint32_t rx_overruns = 0;
     while (1) {
-        char c = chSequentialStreamGet((BaseSequentialStream*)arg);
-        int ret = serial_datagram_receive(&rcv_handler, &c, 1);
+        // everything received since the last read, woken at the end of a datagram
+        size_t n = dma_uart_read_timeout(port, chunk, sizeof(chunk), TIME_INFINITE);
+        if (port->rx_overruns != rx_overruns) {
+            // the datagram being received lost bytes, drop it
+            rx_overruns = port->rx_overruns;
+            serial_datagram_rcv_handler_init(&rcv_handler, &rcv_buf, sizeof(rcv_buf), parameter_decode_cb);
+            chprintf(ch_stdout, "uart rx overrun %u\n", rx_overruns);
+        }
+        int ret = serial_datagram_receive(&rcv_handler, chunk, n);
         if (ret != SERIAL_DATAGRAM_RCV_NO_ERROR) {
             chprintf(ch_stdout, "serial datagram error %d\n", ret);
         }
@@ -97,7 +121,7 @@ void panic_hook(const char* reason)
 {
     palClearPad(GPIOA, GPIOA_LED);      // turn on LED (active low)
     static BlockingUARTDriver blocking_uart_stream;
-    blocking_uart_init(&blocking_uart_stream, USART3, 115200);
+    blocking_uart_init(&blocking_uart_stream, USART3, UART_BAUDRATE);
     BaseSequentialStream* uart = (BaseSequentialStream*)&blocking_uart_stream;
     int i;
     while(42){
@@ -179,8 +203,11 @@ int main(void) {
     timestamp_stm32_init();
     chSysUnlock();
 
-    sdStart(&SD3, NULL);
-    ch_stdout = (BaseSequentialStream*)&SD3;
+    cycle_counter_init();
+    thread_stats_init();
+
+    dma_uart_start(&uart, USART3, UART_BAUDRATE);
+    ch_stdout = (BaseSequentialStream*)&uart;
 
     parameter_namespace_declare(&parameter_root_ns, NULL, NULL);
 
@@ -201,8 +228,10 @@ int main(void) {
     index_init();
 
     // chThdCreateStatic(stream_task_wa, sizeof(stream_task_wa), LOWPRIO, stream_task, NULL);
-    chThdCreateStatic(parameter_listener_wa, sizeof(parameter_listener_wa), LOWPRIO, parameter_listener, &SD3);
+    // above the telemetry, the RX buffer holds ~11ms at 921600 baud
+    chThdCreateStatic(parameter_listener_wa, sizeof(parameter_listener_wa), NORMALPRIO, parameter_listener, &uart);
     chThdCreateStatic(led_thread_wa, sizeof(led_thread_wa), LOWPRIO, led_thread, NULL);
+    diagnostics_start(&uart);
 
     static struct uavcan_node_arg node_arg;
     node_arg.node_id = config.ID;
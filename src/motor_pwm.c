@@ -2,6 +2,11 @@
 #include <hal.h>
 #include <stdlib.h>
 #include <math.h>
+#include "motor_pwm.h"
+#include "thread_stats.h"
+#ifdef ANALOG_PWM_TRIGGERED
+#include "analog.h"
+#endif
 
 
 #define PWM_PERIOD                  2880
@@ -13,6 +18,13 @@
 #define DIRECTION_DC_RECHARGE       (0.75 * PWM_PERIOD)     // 10us
 #define POWR_DC_RECHARGE_CORRECTION (PWM_PERIOD - DIRECTION_DC_RECHARGE)
 
+#define RECHARGE_HOLDOFF_PERIODS    6   // current sense settling after a recharge
+
+#define PWM_ADC_TRIGGER_CHANNEL     2
+#define ADC_TRIGGER_MIN             72  // 1us after the switching edge
+#define ADC_TRIGGER_MAX             (PWM_PERIOD - 216) // 2 conversions before the period end
+#define RECHARGE_SETTLING_PERIODS   3   // disturbed periods after a recharge period
+
 
 
 /*
@@ -27,21 +39,117 @@
  * of 25kHz) for a single cycle, to recharge the charge pump.
  *
  * This recharge cycle is triggered externally by the ADC (the ADC will ignore
- * samples taken during the recharge cycle)
+ * samples taken during the recharge cycle, or the periods flagged disturbed
+ * when it is triggered by the PWM)
+ *
+ * When a period callback is registered, the update interrupt stays enabled and
+ * the callback is run at the start of every PWM period, before the new duty
+ * cycle is written to the timer.
  */
 
 
 static int32_t power_pwm;
 static bool recharge_flag = false;
+static int recharge_holdoff = 0;
+static motor_pwm_period_cb_t period_callback = NULL;
+
+#ifdef ANALOG_PWM_TRIGGERED
+/*
+ * The ADC is triggered by TIM1 CC3 at the sample point of the phase where
+ * the motor voltage is applied, where the current equals its period average.
+ * The update interrupt runs every period to move the trigger with the duty
+ * cycle and to flag the periods disturbed by a recharge. As the compare
+ * registers are preloaded, the values written in the interrupt apply to the
+ * next period.
+ */
+static int32_t sample_point = 128;      // in the applied voltage phase, /256
+static int disturbed_periods = 0;       // including the running period
+static bool recharge_next_period = false;
+
+static void disable_period_notification_from_isr(void)
+{
+}
+
+static void set_adc_trigger(PWMDriver *pwmd, int32_t start, int32_t end)
+{
+    int32_t t = start + (((end - start) * sample_point) >> 8);
+    if (t < ADC_TRIGGER_MIN) {
+        t = ADC_TRIGGER_MIN;
+    } else if (t > ADC_TRIGGER_MAX) {
+        t = ADC_TRIGGER_MAX;
+    }
+    pwmd->tim->CCR[PWM_ADC_TRIGGER_CHANNEL] = t;
+}
+
+// returns true if the measurement of the previous period was disturbed
+static bool update_disturbed_periods(void)
+{
+    bool previous_disturbed = disturbed_periods > 0;
+    if (disturbed_periods > 0) {
+        disturbed_periods--;
+    }
+    if (recharge_next_period) {
+        recharge_next_period = false;
+        disturbed_periods = 1 + RECHARGE_SETTLING_PERIODS;
+    }
+    analog_flag_pwm_period_from_isr(disturbed_periods > 0);
+    return previous_disturbed;
+}
+
+void motor_pwm_set_current_sample_point(float point)
+{
+    if (point < 0) {
+        point = 0;
+    } else if (point > 1) {
+        point = 1;
+    }
+    sample_point = point * 256;
+}
+#else
+static void disable_period_notification_from_isr(void)
+{
+    if (period_callback == NULL) {
+        pwmDisablePeriodicNotificationI(&PWMD1);
+    }
+}
+
+static void set_adc_trigger(PWMDriver *pwmd, int32_t start, int32_t end)
+{
+    (void)pwmd;
+    (void)start;
+    (void)end;
+}
+
+static bool update_disturbed_periods(void)
+{
+    if (recharge_holdoff > 0) {
+        recharge_holdoff--;
+    }
+    return recharge_holdoff > 0;
+}
+
+void motor_pwm_set_current_sample_point(float point)
+{
+    (void)point;
+}
+#endif
 
 void pwm_counter_reset(PWMDriver *pwmd)
 {
+    thread_stats_irq_enter();
+    bool disturbed = update_disturbed_periods();
+
+    if (period_callback != NULL) {
+        period_callback(disturbed);
+    }
+
     if (power_pwm >= 0) { // forward direction (no magic)
         pwmd->tim->CCR[PWM_DIRECTION_CHANNEL] = DIRECTION_DC_LOW;
         pwmd->tim->CCR[PWM_POWER_CHANNEL] = power_pwm;
+        set_adc_trigger(pwmd, 0, power_pwm);
         chSysLockFromISR();
         recharge_flag = false;
-        pwmDisablePeriodicNotificationI(&PWMD1);
+        disable_period_notification_from_isr();
         chSysUnlockFromISR();
 
     } else { // reverse direction (charge pump recharge)
@@ -52,28 +160,34 @@ void pwm_counter_reset(PWMDriver *pwmd)
             // correct power duty cycle to compensate for recharge
             rev_power_pwm -= POWR_DC_RECHARGE_CORRECTION;
             if (rev_power_pwm < 0) {
-                pwmd->tim->CCR[PWM_POWER_CHANNEL] = 0;
-            } else {
-                pwmd->tim->CCR[PWM_POWER_CHANNEL] = rev_power_pwm;
+                rev_power_pwm = 0;
             }
+            pwmd->tim->CCR[PWM_POWER_CHANNEL] = rev_power_pwm;
+            set_adc_trigger(pwmd, rev_power_pwm, DIRECTION_DC_RECHARGE);
 
             recharge_flag = false;
+            recharge_holdoff = RECHARGE_HOLDOFF_PERIODS;
+#ifdef ANALOG_PWM_TRIGGERED
+            recharge_next_period = true;
+#endif
 
         } else { // no recharge cycle / normal operation after recharge cycle
             pwmd->tim->CCR[PWM_DIRECTION_CHANNEL] = DIRECTION_DC_HIGH;
             pwmd->tim->CCR[PWM_POWER_CHANNEL] = rev_power_pwm;
+            set_adc_trigger(pwmd, rev_power_pwm, PWM_PERIOD);
             recharge_flag = false;
             chSysLockFromISR();
-            pwmDisablePeriodicNotificationI(&PWMD1);
+            disable_period_notification_from_isr();
             chSysUnlockFromISR();
         }
 
     }
+    thread_stats_irq_exit();
 }
 
 static const PWMConfig pwm_cfg = {
     72000000,
-    PWM_PERIOD,           // 25kHz
+    PWM_PERIOD,           // 25kHz (MOTOR_PWM_FREQUENCY)
     pwm_counter_reset,
     // activate channel 1 and 2
     {
@@ -89,6 +203,10 @@ static const PWMConfig pwm_cfg = {
 void motor_pwm_setup(void)
 {
     pwmStart(&PWMD1, &pwm_cfg);
+#ifdef ANALOG_PWM_TRIGGERED
+    PWMD1.tim->CCR[PWM_ADC_TRIGGER_CHANNEL] = ADC_TRIGGER_MIN;
+    pwmEnablePeriodicNotification(&PWMD1);
+#endif
 }
 
 void motor_pwm_set(float dc)
@@ -102,6 +220,18 @@ void motor_pwm_set(float dc)
     power_pwm = dc * PWM_PERIOD;
 }
 
+void motor_pwm_set_q31(int32_t dc)
+{
+    const int32_t dc_max = 0.95 * 2147483648.0;
+    if (dc > dc_max) {
+        dc = dc_max;
+    } else if (dc < -dc_max) {
+        dc = -dc_max;
+    }
+
+    power_pwm = ((int64_t)dc * PWM_PERIOD) >> 31;
+}
+
 void motor_pwm_enable(void)
 {
     palSetPad(GPIOA, GPIOA_MOTOR_EN_A);
@@ -115,6 +245,16 @@ void motor_pwm_disable(void)
     palClearPad(GPIOA, GPIOA_MOTOR_EN_B);
 }
 
+void motor_pwm_set_period_callback(motor_pwm_period_cb_t cb)
+{
+    chSysLock();
+    period_callback = cb;
+    if (cb != NULL) {
+        pwmEnablePeriodicNotificationI(&PWMD1);
+    }
+    chSysUnlock();
+}
+
 void motor_pwm_trigger_update_from_isr(bool recharge)
 {
     chSysLockFromISR();
@@ -1,10 +1,22 @@
 #ifndef MOTOR_PWM_H
 #define MOTOR_PWM_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define MOTOR_PWM_FREQUENCY 25000 // 72MHz / 2880
+
+/*
+ * called at the start of every PWM period (from the timer interrupt)
+ * recharging : true while the current measurement is disturbed by a charge
+ *              pump recharge cycle
+ */
+typedef void (*motor_pwm_period_cb_t)(bool recharging);
+
 
 void motor_pwm_setup(void);
 
@@ -13,6 +25,11 @@ void motor_pwm_setup(void);
  */
 void motor_pwm_set(float dc);
 
+/*
+ * dc : duty cycle in Q31 (-2^31 .. 2^31 for -1 .. +1)
+ */
+void motor_pwm_set_q31(int32_t dc);
+
 /*
  * drive the motor voltage
  */
@@ -23,6 +40,17 @@ void motor_pwm_enable(void);
  */
 void motor_pwm_disable(void);
 
+/*
+ * run cb at the start of every PWM period (NULL to disable)
+ */
+void motor_pwm_set_period_callback(motor_pwm_period_cb_t cb);
+
+/*
+ * point of the phase where the motor voltage is applied at which the current
+ * is sampled, 0 to 1, 0.5 (center) by default. Only with ANALOG_PWM_TRIGGERED.
+ */
+void motor_pwm_set_current_sample_point(float point);
+
 /*
  * trigger charge pump recharge cycle (must be called every 2ms)
  */
@@ -14,10 +14,8 @@ float periodic_error(float err)
     return err;
 }
 
-void pid_cascade_control(struct pid_cascade_s *ctrl)
+void pid_cascade_position_control(struct pid_cascade_s *ctrl)
 {
-    // position control
-    float pos_ctrl_vel;
     if (ctrl->setpts.position_control_enabled) {
         ctrl->position_setpoint = ctrl->setpts.position_setpt;
         float position_error = ctrl->position - ctrl->setpts.position_setpt;
@@ -25,17 +23,18 @@ void pid_cascade_control(struct pid_cascade_s *ctrl)
             position_error = periodic_error(position_error);
         }
         ctrl->position_error = position_error;
-        pos_ctrl_vel = pid_process(&ctrl->position_pid, ctrl->position_error);
-        ctrl->position_ctrl_out = pos_ctrl_vel;
+        ctrl->position_ctrl_out = pid_process(&ctrl->position_pid, ctrl->position_error);
     } else {
         pid_reset_integral(&ctrl->position_pid);
-        pos_ctrl_vel = 0;
+        ctrl->position_ctrl_out = 0;
     }
+}
 
-    // velocity control
+void pid_cascade_velocity_control(struct pid_cascade_s *ctrl)
+{
     float vel_ctrl_torque;
     if (ctrl->setpts.velocity_control_enabled) {
-        float velocity_setpt = ctrl->setpts.velocity_setpt + pos_ctrl_vel;
+        float velocity_setpt = ctrl->setpts.velocity_setpt + ctrl->position_ctrl_out;
         velocity_setpt = filter_limit_sym(velocity_setpt, ctrl->velocity_limit);
         ctrl->velocity_setpoint = velocity_setpt;
         ctrl->velocity_error = ctrl->velocity - velocity_setpt;
@@ -44,15 +43,27 @@ void pid_cascade_control(struct pid_cascade_s *ctrl)
     } else {
         pid_reset_integral(&ctrl->velocity_pid);
         vel_ctrl_torque = 0;
+        ctrl->velocity_ctrl_out = 0;
     }
 
-    // torque control
+    // torque to current
     float torque_setpt = vel_ctrl_torque + ctrl->setpts.feedforward_torque;
     torque_setpt = filter_limit_sym(torque_setpt, ctrl->torque_limit);
     float current_setpt = torque_setpt * ctrl->motor_current_constant;
     current_setpt = filter_limit_sym(current_setpt, ctrl->current_limit);
     ctrl->current_setpoint = current_setpt;
-    ctrl->current_error = ctrl->current - current_setpt;
+}
+
+void pid_cascade_current_control(struct pid_cascade_s *ctrl)
+{
+    ctrl->current_error = ctrl->current - ctrl->current_setpoint;
     ctrl->motor_voltage = pid_process(&ctrl->current_pid, ctrl->current_error);
 }
 
+void pid_cascade_control(struct pid_cascade_s *ctrl)
+{
+    pid_cascade_position_control(ctrl);
+    pid_cascade_velocity_control(ctrl);
+    pid_cascade_current_control(ctrl);
+}
+
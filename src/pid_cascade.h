@@ -42,6 +42,18 @@ struct pid_cascade_s {
 };
 
 
+/*
+ * The three stages can run at different rates, each one using the latest
+ * output of the outer stage:
+ * position -> position_ctrl_out (velocity correction)
+ * velocity -> current_setpoint (includes feedforward torque and limits)
+ * current  -> motor_voltage
+ */
+void pid_cascade_position_control(struct pid_cascade_s *ctrl);
+void pid_cascade_velocity_control(struct pid_cascade_s *ctrl);
+void pid_cascade_current_control(struct pid_cascade_s *ctrl);
+
+// runs all three stages
 void pid_cascade_control(struct pid_cascade_s *ctrl);
 
 
@@ -0,0 +1,121 @@
+#include <math.h>
+#include "pid_cascade_q31.h"
+
+
+static int32_t limit_from_float(float limit, float lsb)
+{
+    return q31_from_float(fabsf(limit), lsb);
+}
+
+void pid_cascade_q31_configure(struct pid_cascade_q31_s *q,
+                               const struct pid_cascade_s *ref,
+                               float position_lsb)
+{
+    q->position_lsb = position_lsb;
+    q->position_period = q31_from_float(2 * (float)M_PI, position_lsb);
+    q->periodic_actuator = ref->periodic_actuator;
+
+    pid_q31_configure(&q->position_pid, &ref->position_pid,
+                      position_lsb, PID_CASCADE_Q31_VELOCITY_LSB);
+    pid_q31_configure(&q->velocity_pid, &ref->velocity_pid,
+                      PID_CASCADE_Q31_VELOCITY_LSB, PID_CASCADE_Q31_TORQUE_LSB);
+    pid_q31_configure(&q->current_pid, &ref->current_pid,
+                      PID_CASCADE_Q31_CURRENT_LSB, PID_CASCADE_Q31_VOLTAGE_LSB);
+
+    q->torque_to_current = q31_gain_from_float(ref->motor_current_constant
+            * PID_CASCADE_Q31_TORQUE_LSB / PID_CASCADE_Q31_CURRENT_LSB);
+    q->velocity_limit = limit_from_float(ref->velocity_limit, PID_CASCADE_Q31_VELOCITY_LSB);
+    q->torque_limit = limit_from_float(ref->torque_limit, PID_CASCADE_Q31_TORQUE_LSB);
+    q->current_limit = limit_from_float(ref->current_limit, PID_CASCADE_Q31_CURRENT_LSB);
+}
+
+void pid_cascade_q31_set_setpoints(struct pid_cascade_q31_s *q,
+                                   const struct setpoint_s *setpts)
+{
+    q->position_control_enabled = setpts->position_control_enabled;
+    q->velocity_control_enabled = setpts->velocity_control_enabled;
+    q->position_setpt = q31_from_float(setpts->position_setpt, q->position_lsb);
+    q->velocity_setpt = q31_from_float(setpts->velocity_setpt, PID_CASCADE_Q31_VELOCITY_LSB);
+    q->feedforward_torque = q31_from_float(setpts->feedforward_torque, PID_CASCADE_Q31_TORQUE_LSB);
+}
+
+void pid_cascade_q31_to_float(const struct pid_cascade_q31_s *q,
+                              struct pid_cascade_s *out)
+{
+    out->position = q31_to_float(q->position, q->position_lsb);
+    out->velocity = q31_to_float(q->velocity, PID_CASCADE_Q31_VELOCITY_LSB);
+    out->current = q31_to_float(q->current, PID_CASCADE_Q31_CURRENT_LSB);
+    out->motor_voltage = q31_to_float(q->motor_voltage, PID_CASCADE_Q31_VOLTAGE_LSB);
+    out->position_setpoint = q31_to_float(q->position_setpt, q->position_lsb);
+    out->position_error = q31_to_float(q->position_error, q->position_lsb);
+    out->position_ctrl_out = q31_to_float(q->position_ctrl_out, PID_CASCADE_Q31_VELOCITY_LSB);
+    out->velocity_setpoint = q31_to_float(q->velocity_setpoint, PID_CASCADE_Q31_VELOCITY_LSB);
+    out->velocity_error = q31_to_float(q->velocity_error, PID_CASCADE_Q31_VELOCITY_LSB);
+    out->velocity_ctrl_out = q31_to_float(q->velocity_ctrl_out, PID_CASCADE_Q31_TORQUE_LSB);
+    out->current_setpoint = q31_to_float(q->current_setpoint, PID_CASCADE_Q31_CURRENT_LSB);
+    out->current_error = q31_to_float(q->current_error, PID_CASCADE_Q31_CURRENT_LSB);
+}
+
+// wraps the position error to [-period/2, period/2)
+static int32_t periodic_error_ticks(int32_t error, int32_t period)
+{
+    error %= period;
+    if (error >= period / 2) {
+        return error - period;
+    }
+    if (error < -period / 2) {
+        return error + period;
+    }
+    return error;
+}
+
+void pid_cascade_q31_position_control(struct pid_cascade_q31_s *q)
+{
+    if (q->position_control_enabled) {
+        int32_t position_error = q31_sub(q->position, q->position_setpt);
+        if (q->periodic_actuator) {
+            position_error = periodic_error_ticks(position_error, q->position_period);
+        }
+        q->position_error = position_error;
+        q->position_ctrl_out = pid_q31_process(&q->position_pid, position_error);
+    } else {
+        pid_q31_reset_integral(&q->position_pid);
+        q->position_ctrl_out = 0;
+    }
+}
+
+void pid_cascade_q31_velocity_control(struct pid_cascade_q31_s *q)
+{
+    int32_t vel_ctrl_torque;
+    if (q->velocity_control_enabled) {
+        int32_t velocity_setpt = q31_add(q->velocity_setpt, q->position_ctrl_out);
+        velocity_setpt = q31_limit_sym(velocity_setpt, q->velocity_limit);
+        q->velocity_setpoint = velocity_setpt;
+        q->velocity_error = q31_sub(q->velocity, velocity_setpt);
+        vel_ctrl_torque = pid_q31_process(&q->velocity_pid, q->velocity_error);
+        q->velocity_ctrl_out = vel_ctrl_torque;
+    } else {
+        pid_q31_reset_integral(&q->velocity_pid);
+        vel_ctrl_torque = 0;
+        q->velocity_ctrl_out = 0;
+    }
+
+    // torque to current
+    int32_t torque_setpt = q31_add(vel_ctrl_torque, q->feedforward_torque);
+    torque_setpt = q31_limit_sym(torque_setpt, q->torque_limit);
+    int32_t current_setpt = q31_gain_apply(q->torque_to_current, torque_setpt);
+    q->current_setpoint = q31_limit_sym(current_setpt, q->current_limit);
+}
+
+void pid_cascade_q31_current_control(struct pid_cascade_q31_s *q)
+{
+    q->current_error = q31_sub(q->current, q->current_setpoint);
+    q->motor_voltage = pid_q31_process(&q->current_pid, q->current_error);
+}
+
+void pid_cascade_q31_control(struct pid_cascade_q31_s *q)
+{
+    pid_cascade_q31_position_control(q);
+    pid_cascade_q31_velocity_control(q);
+    pid_cascade_q31_current_control(q);
+}
@@ -0,0 +1,94 @@
+#ifndef PID_CASCADE_Q31_H
+#define PID_CASCADE_Q31_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "pid_q31.h"
+#include "pid_cascade.h"
+#include "setpoint.h"
+
+/*
+ * Fixed point variant of the PID cascade
+ * ======================================
+ *
+ * The position is kept in encoder ticks (see feedback_position_lsb), all
+ * other signals are Q31 fractions of the full scales below.
+ * The float cascade structure is used for the configuration (gains, limits)
+ * and as the floating point view of the signals for telemetry.
+ */
+
+#define PID_CASCADE_Q31_VELOCITY_SCALE  1024.f  // [rad/s]
+#define PID_CASCADE_Q31_TORQUE_SCALE    256.f   // [Nm]
+#define PID_CASCADE_Q31_CURRENT_SCALE   64.f    // [A]
+#define PID_CASCADE_Q31_VOLTAGE_SCALE   64.f    // [V]
+
+#define PID_CASCADE_Q31_VELOCITY_LSB    (PID_CASCADE_Q31_VELOCITY_SCALE / 2147483648.f)
+#define PID_CASCADE_Q31_TORQUE_LSB      (PID_CASCADE_Q31_TORQUE_SCALE / 2147483648.f)
+#define PID_CASCADE_Q31_CURRENT_LSB     (PID_CASCADE_Q31_CURRENT_SCALE / 2147483648.f)
+#define PID_CASCADE_Q31_VOLTAGE_LSB     (PID_CASCADE_Q31_VOLTAGE_SCALE / 2147483648.f)
+
+struct pid_cascade_q31_s {
+    // controllers:
+    pid_q31_t current_pid;
+    pid_q31_t velocity_pid;
+    pid_q31_t position_pid;
+    // parameters:
+    float position_lsb;             // [rad] per tick
+    int32_t position_period;        // ticks per turn of periodic actuators
+    q31_gain_t torque_to_current;
+    int32_t velocity_limit;
+    int32_t torque_limit;
+    int32_t current_limit;
+    // setpoints:
+    bool position_control_enabled;
+    bool velocity_control_enabled;
+    int32_t position_setpt;         // [ticks]
+    int32_t velocity_setpt;
+    int32_t feedforward_torque;
+    // inputs:
+    bool periodic_actuator;
+    int32_t position;               // [ticks]
+    int32_t velocity;
+    int32_t current;
+    // outputs:
+    int32_t motor_voltage;
+    // PID tuning outputs:
+    int32_t position_error;         // [ticks]
+    int32_t position_ctrl_out;
+    int32_t velocity_setpoint;
+    int32_t velocity_error;
+    int32_t velocity_ctrl_out;
+    int32_t current_setpoint;
+    int32_t current_error;
+};
+
+
+/* takes the gains, frequencies and limits of the float cascade */
+void pid_cascade_q31_configure(struct pid_cascade_q31_s *q,
+                               const struct pid_cascade_s *ref,
+                               float position_lsb);
+
+/* converts the interpolated setpoints */
+void pid_cascade_q31_set_setpoints(struct pid_cascade_q31_s *q,
+                                   const struct setpoint_s *setpts);
+
+/* writes signals and tuning outputs to the float cascade structure */
+void pid_cascade_q31_to_float(const struct pid_cascade_q31_s *q,
+                              struct pid_cascade_s *out);
+
+void pid_cascade_q31_position_control(struct pid_cascade_q31_s *q);
+void pid_cascade_q31_velocity_control(struct pid_cascade_q31_s *q);
+void pid_cascade_q31_current_control(struct pid_cascade_q31_s *q);
+
+// runs all three stages
+void pid_cascade_q31_control(struct pid_cascade_q31_s *q);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PID_CASCADE_Q31_H */
@@ -0,0 +1,52 @@
+#include <math.h>
+#include "pid_q31.h"
+
+
+void pid_q31_init(pid_q31_t *pid)
+{
+    pid->kp = q31_gain_from_float(0);
+    pid->ki = q31_gain_from_float(0);
+    pid->kd = q31_gain_from_float(0);
+    pid->integrator = 0;
+    pid->integrator_limit = INT32_MAX;
+    pid->previous_error = 0;
+}
+
+void pid_q31_configure(pid_q31_t *pid, const pid_ctrl_t *ref,
+                       float input_lsb, float output_lsb)
+{
+    float kp, ki, kd;
+    pid_get_gains(ref, &kp, &ki, &kd);
+    float frequency = pid_get_frequency(ref);
+    float scale = input_lsb / output_lsb;
+
+    pid->kp = q31_gain_from_float(kp * scale);
+    pid->ki = q31_gain_from_float(ki / frequency * scale);
+    pid->kd = q31_gain_from_float(kd * frequency * scale);
+
+    // the float controller limits sum(e), we limit ki / f * sum(e)
+    float limit = fabsf(pid_get_integral_limit(ref) * ki / frequency) / output_lsb;
+    if (isnan(limit) || limit >= 2147483647.f) {
+        pid->integrator_limit = INT32_MAX;
+    } else {
+        pid->integrator_limit = limit;
+    }
+}
+
+int32_t pid_q31_process(pid_q31_t *pid, int32_t error)
+{
+    int32_t integrator = q31_add(pid->integrator, q31_gain_apply(pid->ki, error));
+    pid->integrator = q31_limit_sym(integrator, pid->integrator_limit);
+
+    int32_t output = q31_gain_apply(pid->kp, error);
+    output = q31_add(output, pid->integrator);
+    output = q31_add(output, q31_gain_apply(pid->kd, q31_sub(error, pid->previous_error)));
+    pid->previous_error = error;
+
+    return q31_neg(output);
+}
+
+void pid_q31_reset_integral(pid_q31_t *pid)
+{
+    pid->integrator = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef PID_Q31_H
+#define PID_Q31_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "pid/pid.h"
+#include "fixed_point.h"
+
+/*
+ * Fixed point PID with the same behaviour as the float pid library:
+ * output = -(kp * e + ki / f * sum(e) + kd * f * (e - e_prev))
+ * The integral term is accumulated in output units, the integral limit is
+ * scaled accordingly.
+ */
+typedef struct {
+    q31_gain_t kp;          // input to output LSB
+    q31_gain_t ki;          // ki / frequency, input to output LSB
+    q31_gain_t kd;          // kd * frequency, input to output LSB
+    int32_t integrator;     // output LSB
+    int32_t integrator_limit;
+    int32_t previous_error;
+} pid_q31_t;
+
+
+void pid_q31_init(pid_q31_t *pid);
+
+/* takes gains, frequency and integral limit of a float controller,
+ * the input and output are integers in units of input_lsb and output_lsb */
+void pid_q31_configure(pid_q31_t *pid, const pid_ctrl_t *ref,
+                       float input_lsb, float output_lsb);
+
+int32_t pid_q31_process(pid_q31_t *pid, int32_t error);
+void pid_q31_reset_integral(pid_q31_t *pid);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PID_Q31_H */
@@ -0,0 +1,133 @@
+#include <math.h>
+#include "scope.h"
+
+
+void scope_init(scope_t *s)
+{
+    s->nb_channels = 1;
+    s->depth = SCOPE_BUFFER_SIZE;
+    s->pretrigger = 0;
+    s->divider = 1;
+    s->trigger_mode = SCOPE_TRIGGER_MANUAL;
+    s->trigger_level = 0;
+    s->state = SCOPE_IDLE;
+    s->force = false;
+    s->sequence = 0;
+    s->count = 0;
+}
+
+bool scope_arm(scope_t *s, unsigned nb_channels, float pretrigger,
+               unsigned divider, enum scope_trigger_mode mode, float level)
+{
+    if (nb_channels == 0 || nb_channels > SCOPE_NB_CHANNELS) {
+        return false;
+    }
+    if (pretrigger < 0) {
+        pretrigger = 0;
+    } else if (pretrigger > 1) {
+        pretrigger = 1;
+    }
+    s->nb_channels = nb_channels;
+    s->depth = SCOPE_BUFFER_SIZE / nb_channels;
+    s->pretrigger = pretrigger * (s->depth - 1);
+    s->divider = divider > 0 ? divider : 1;
+    s->trigger_mode = mode;
+    s->trigger_level = level;
+
+    s->force = false;
+    s->sequence++;
+    s->divider_count = 0;
+    s->write = 0;
+    s->count = 0;
+    s->state = SCOPE_ARMED;
+    return true;
+}
+
+void scope_force_trigger(scope_t *s)
+{
+    s->force = true;
+}
+
+static bool trigger_condition(const scope_t *s, float value)
+{
+    switch (s->trigger_mode) {
+        case SCOPE_TRIGGER_RISING:
+            return s->previous < s->trigger_level && value >= s->trigger_level;
+        case SCOPE_TRIGGER_FALLING:
+            return s->previous > s->trigger_level && value <= s->trigger_level;
+        case SCOPE_TRIGGER_ABOVE:
+            return fabsf(value) >= s->trigger_level;
+        case SCOPE_TRIGGER_CHANGE:
+            return value != s->previous;
+        default:
+            return false;
+    }
+}
+
+void scope_sample(scope_t *s, const float *values, float trigger_value)
+{
+    unsigned i;
+
+    if (s->state != SCOPE_ARMED && s->state != SCOPE_TRIGGERED) {
+        return;
+    }
+    if (++s->divider_count < s->divider) {
+        return;
+    }
+    s->divider_count = 0;
+
+    float *sample = &s->buffer[s->write * s->nb_channels];
+    for (i = 0; i < s->nb_channels; i++) {
+        sample[i] = values[i];
+    }
+    unsigned pos = s->write;
+    s->write = (s->write + 1) % s->depth;
+    if (s->count < s->depth) {
+        s->count++;
+    }
+
+    if (s->state == SCOPE_TRIGGERED) {
+        s->remaining--;
+    } else {
+        // the trigger needs the previous value and the pretrigger samples
+        bool triggered = s->force
+            || (s->count > 1 && s->count > s->pretrigger
+                && trigger_condition(s, trigger_value));
+        s->previous = trigger_value;
+        if (!triggered) {
+            return;
+        }
+        s->trigger_pos = pos;
+        s->remaining = s->depth - 1 - s->pretrigger;
+        s->state = SCOPE_TRIGGERED;
+    }
+    if (s->remaining == 0) {
+        s->state = SCOPE_DONE;
+    }
+}
+
+enum scope_state scope_get_state(const scope_t *s)
+{
+    return s->state;
+}
+
+unsigned scope_nb_samples(const scope_t *s)
+{
+    return s->count;
+}
+
+static unsigned oldest_pos(const scope_t *s)
+{
+    return (s->write + s->depth - s->count) % s->depth;
+}
+
+unsigned scope_trigger_sample(const scope_t *s)
+{
+    return (s->trigger_pos + s->depth - oldest_pos(s)) % s->depth;
+}
+
+float scope_read(const scope_t *s, unsigned sample, unsigned channel)
+{
+    unsigned pos = (oldest_pos(s) + sample) % s->depth;
+    return s->buffer[pos * s->nb_channels + channel];
+}
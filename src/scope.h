@@ -0,0 +1,90 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Oscilloscope like capture of up to SCOPE_NB_CHANNELS signals into a RAM
+ * ring buffer, with pre-trigger samples.
+ *
+ * Once armed, every call to scope_sample records one sample of each channel
+ * (or every divider-th call) and evaluates the trigger. After the trigger
+ * the capture continues until the buffer holds the requested number of
+ * samples before the trigger, then it is frozen and can be read out.
+ *
+ * scope_sample must only be called by one thread. The capture may be read
+ * by another thread once it is frozen (SCOPE_DONE).
+ */
+
+#define SCOPE_NB_CHANNELS   8
+#define SCOPE_BUFFER_SIZE   2048    // samples of all channels, 8kB
+
+enum scope_state {
+    SCOPE_IDLE,
+    SCOPE_ARMED,        // recording, waiting for the trigger
+    SCOPE_TRIGGERED,    // recording the samples after the trigger
+    SCOPE_DONE,         // capture frozen
+};
+
+enum scope_trigger_mode {
+    SCOPE_TRIGGER_RISING,   // crosses the level upwards
+    SCOPE_TRIGGER_FALLING,  // crosses the level downwards
+    SCOPE_TRIGGER_ABOVE,    // absolute value at or above the level
+    SCOPE_TRIGGER_CHANGE,   // value changes, for modes and flags
+    SCOPE_TRIGGER_MANUAL,   // only scope_force_trigger
+};
+
+typedef struct {
+    float buffer[SCOPE_BUFFER_SIZE];
+    unsigned nb_channels;
+    unsigned depth;         // samples per channel
+    unsigned pretrigger;    // samples before the trigger
+    unsigned divider;
+    enum scope_trigger_mode trigger_mode;
+    float trigger_level;
+
+    volatile enum scope_state state;
+    volatile bool force;
+    uint32_t sequence;      // incremented for every capture
+    unsigned divider_count;
+    unsigned write;         // next sample of the ring buffer
+    unsigned count;         // samples recorded, up to depth
+    unsigned remaining;     // samples to record after the trigger
+    unsigned trigger_pos;   // ring buffer position of the trigger sample
+    float previous;         // trigger value of the last sample
+} scope_t;
+
+void scope_init(scope_t *s);
+
+/*
+ * Sets the channels and trigger and arms the scope. pretrigger is the
+ * fraction of the capture before the trigger (0 to 1).
+ * Returns false if nb_channels is invalid.
+ */
+bool scope_arm(scope_t *s, unsigned nb_channels, float pretrigger,
+               unsigned divider, enum scope_trigger_mode mode, float level);
+
+/* triggers an armed scope at the next sample */
+void scope_force_trigger(scope_t *s);
+
+/* records values[0..nb_channels-1], trigger_value is the trigger signal */
+void scope_sample(scope_t *s, const float *values, float trigger_value);
+
+enum scope_state scope_get_state(const scope_t *s);
+
+/* the following are valid for a frozen capture */
+unsigned scope_nb_samples(const scope_t *s);
+unsigned scope_trigger_sample(const scope_t *s);
+/* sample 0 is the oldest */
+float scope_read(const scope_t *s, unsigned sample, unsigned channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCOPE_H */
@@ -0,0 +1,68 @@
+/**
+ * Sequence lock
+ * =============
+ *
+ * Publishes data written by one thread to readers of lower priority
+ * without blocking the writer.
+ *
+ * The writer increments the sequence before and after writing, it is odd
+ * while a write is in progress. A reader copies the data and retries if the
+ * sequence was odd or changed meanwhile, which only happens when the writer
+ * preempted it.
+ *
+ * Written for a single core, the barriers only keep the compiler from
+ * reordering the data accesses around the sequence accesses.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    volatile uint32_t sequence;
+} seqlock_t;
+
+#define SEQLOCK_BARRIER() __asm__ volatile ("" ::: "memory")
+
+static inline void seqlock_init(seqlock_t *l)
+{
+    l->sequence = 0;
+}
+
+static inline void seqlock_write_begin(seqlock_t *l)
+{
+    l->sequence++;
+    SEQLOCK_BARRIER();
+}
+
+static inline void seqlock_write_end(seqlock_t *l)
+{
+    SEQLOCK_BARRIER();
+    l->sequence++;
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t *l)
+{
+    uint32_t sequence = l->sequence;
+    SEQLOCK_BARRIER();
+    return sequence;
+}
+
+/* true if the data read since read_begin must be discarded */
+static inline bool seqlock_read_retry(const seqlock_t *l, uint32_t sequence)
+{
+    SEQLOCK_BARRIER();
+    return (sequence & 1) || l->sequence != sequence;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEQLOCK_H */
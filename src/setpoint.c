@@ -6,6 +6,7 @@
 #define SETPT_MODE_VEL      1
 #define SETPT_MODE_TORQUE   2
 #define SETPT_MODE_TRAJ     3
+#define SETPT_MODE_TRAJ_BUFFER 4
 
 
 static float pos_setpt_interpolation(float pos, float vel, float acc, float delta_t)
@@ -53,6 +54,8 @@ void setpoint_init(setpoint_interpolator_t *ip)
     ip->setpt_torque = 0;
     ip->acc_limit = 0;
     ip->vel_limit = 0;
+    ip->traj_buffer = NULL;
+    ip->traj_underruns = 0;
 }
 
 void setpoint_set_acceleration_limit(setpoint_interpolator_t *ip,
@@ -66,6 +69,19 @@ void setpoint_set_velocity_limit(setpoint_interpolator_t *ip, float vel_limit)
     ip->vel_limit = vel_limit;
 }
 
+void setpoint_set_trajectory_buffer(setpoint_interpolator_t *ip,
+                                    trajectory_buffer_t *buffer)
+{
+    ip->traj_buffer = buffer;
+}
+
+void setpoint_discard_trajectory(setpoint_interpolator_t *ip, uint32_t mark)
+{
+    if (ip->traj_buffer != NULL) {
+        trajectory_buffer_discard_until(ip->traj_buffer, mark);
+    }
+}
+
 
 void setpoint_update_position(setpoint_interpolator_t *ip,
                               float pos,
@@ -115,11 +131,120 @@ void setpoint_update_trajectory(setpoint_interpolator_t *ip,
     ip->setpt_ts = ts;
 }
 
+/*
+ * Quintic Hermite interpolation between two points, continuous in position,
+ * velocity and acceleration. t is the time since p0.
+ */
+static void trajectory_segment_interpolation(const struct trajectory_point_s *p0,
+                                             const struct trajectory_point_s *p1,
+                                             float t,
+                                             float *pos, float *vel, float *acc)
+{
+    float T = (int32_t)(p1->time - p0->time) / 1000000.f;
+    float s = t / T;
+    float dp = p1->position - p0->position;
+    float v0 = p0->velocity * T, v1 = p1->velocity * T;
+    float a0 = p0->acceleration * T * T, a1 = p1->acceleration * T * T;
+
+    float c3 = 10 * dp - 6 * v0 - 4 * v1 - 1.5f * a0 + 0.5f * a1;
+    float c4 = -15 * dp + 8 * v0 + 7 * v1 + 1.5f * a0 - a1;
+    float c5 = 6 * dp - 3 * v0 - 3 * v1 - 0.5f * a0 + 0.5f * a1;
+
+    *pos = p0->position + s * (v0 + s * (a0 / 2 + s * (c3 + s * (c4 + s * c5))));
+    *vel = (v0 + s * (a0 + s * (3 * c3 + s * (4 * c4 + s * 5 * c5)))) / T;
+    *acc = (a0 + s * (6 * c3 + s * (12 * c4 + s * 20 * c5))) / (T * T);
+}
+
+// true if the first buffered point is due
+static bool trajectory_buffer_ready(setpoint_interpolator_t *ip, timestamp_t now)
+{
+    if (ip->traj_buffer == NULL) {
+        return false;
+    }
+    const struct trajectory_point_s *p = trajectory_buffer_peek(ip->traj_buffer, 0);
+    return p != NULL && (int32_t)(now - p->time) >= 0;
+}
+
+// hands over to position control, stopping with the acceleration limit
+static void trajectory_stop(setpoint_interpolator_t *ip, struct setpoint_s *setpts)
+{
+    ip->target_pos = ip->setpt_pos;
+    if (ip->acc_limit > 0) {
+        ip->target_pos += ip->setpt_vel * fabsf(ip->setpt_vel) / 2 / ip->acc_limit;
+    }
+    ip->setpt_mode = SETPT_MODE_POS;
+
+    setpts->position_setpt = ip->setpt_pos;
+    setpts->velocity_setpt = ip->setpt_vel;
+    setpts->acceleration_setpt = 0;
+}
+
+static void trajectory_buffer_compute(setpoint_interpolator_t *ip,
+                                      struct setpoint_s *setpts,
+                                      timestamp_t now)
+{
+    trajectory_buffer_t *b = ip->traj_buffer;
+    const struct trajectory_point_s *p0, *p1;
+
+    // drop the segments that are over, a restarted trajectory replaces the
+    // points queued after its start
+    while ((p1 = trajectory_buffer_peek(b, 1)) != NULL) {
+        p0 = trajectory_buffer_peek(b, 0);
+        if ((int32_t)(now - p1->time) < 0 && (int32_t)(p1->time - p0->time) > 0) {
+            break;
+        }
+        trajectory_buffer_pop(b);
+    }
+    p0 = trajectory_buffer_peek(b, 0);
+    p1 = trajectory_buffer_peek(b, 1);
+
+    setpts->position_control_enabled = true;
+    setpts->velocity_control_enabled = true;
+    if (p0 == NULL) {
+        // nothing left to play out
+        setpts->feedforward_torque = 0;
+        trajectory_stop(ip, setpts);
+        return;
+    }
+    float t = (int32_t)(now - p0->time) / 1000000.f;
+    setpts->feedforward_torque = p0->torque;
+
+    if (p1 != NULL && t >= 0) {
+        float acc;
+        trajectory_segment_interpolation(p0, p1, t, &ip->setpt_pos, &ip->setpt_vel, &acc);
+        setpts->position_setpt = ip->setpt_pos;
+        setpts->velocity_setpt = ip->setpt_vel;
+        setpts->acceleration_setpt = acc;
+        return;
+    }
+
+    // stop with the acceleration limit until the next point is due
+    if (t >= 0) {
+        // last point reached
+        if (p0->velocity != 0 || p0->acceleration != 0) {
+            ip->traj_underruns++;
+        }
+        ip->setpt_pos = pos_setpt_interpolation(p0->position, p0->velocity, 0, t);
+        ip->setpt_vel = p0->velocity;
+        trajectory_buffer_pop(b);
+    }
+    trajectory_stop(ip, setpts);
+}
+
 
 void setpoint_compute(setpoint_interpolator_t *ip,
                       struct setpoint_s *setpts,
                       float delta_t)
 {
+    if (ip->traj_buffer != NULL) {
+        timestamp_t now = timestamp_get();
+        if (ip->setpt_mode == SETPT_MODE_TRAJ_BUFFER || trajectory_buffer_ready(ip, now)) {
+            ip->setpt_mode = SETPT_MODE_TRAJ_BUFFER;
+            trajectory_buffer_compute(ip, setpts, now);
+            return;
+        }
+    }
+
     if (ip->setpt_mode == SETPT_MODE_TRAJ) {
         timestamp_t now = timestamp_get();
         float ip_delta_t = timestamp_duration_s(ip->setpt_ts, now); // interpolation delta_t
@@ -133,19 +258,23 @@ void setpoint_compute(setpoint_interpolator_t *ip,
         setpts->velocity_setpt = vel_setpt_interpolation(ip->setpt_vel,
                                                          ip->traj_acc,
                                                          ip_delta_t);
+        setpts->acceleration_setpt = ip->traj_acc;
         setpts->feedforward_torque = ip->setpt_torque;
 
     } else if (ip->setpt_mode == SETPT_MODE_TORQUE) {
         setpts->position_control_enabled = false;
         setpts->velocity_control_enabled = false;
+        setpts->acceleration_setpt = 0;
         setpts->feedforward_torque = ip->setpt_torque;
 
     } else if (ip->setpt_mode == SETPT_MODE_VEL) {
         setpts->position_control_enabled = false;
         setpts->velocity_control_enabled = true;
-        float delta_vel = ip->target_vel - ip->setpt_vel;
-        ip->setpt_vel += filter_limit_sym(delta_vel, delta_t * ip->acc_limit);
+        float delta_vel = filter_limit_sym(ip->target_vel - ip->setpt_vel,
+                                           delta_t * ip->acc_limit);
+        ip->setpt_vel += delta_vel;
         setpts->velocity_setpt = ip->setpt_vel;
+        setpts->acceleration_setpt = delta_vel / delta_t;
         setpts->feedforward_torque = 0;
 
     } else { // setpt_mode == SETPT_MODE_POS
@@ -166,6 +295,7 @@ void setpoint_compute(setpoint_interpolator_t *ip,
         float vel = vel_setpt_interpolation(ip->setpt_vel, acc, delta_t);
         setpts->position_setpt = ip->setpt_pos = pos;
         setpts->velocity_setpt = ip->setpt_vel = vel;
+        setpts->acceleration_setpt = acc;
         setpts->feedforward_torque = 0;
     }
 }
@@ -1,8 +1,10 @@
 #ifndef SETPOINT_H
 #define SETPOINT_H
 
+#include <stdint.h>
 #include <stdbool.h>
 #include "timestamp/timestamp.h"
+#include "trajectory_buffer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +22,8 @@ typedef struct {
     timestamp_t setpt_ts; // timestamp of the last setpoint update (traj. mode)
     float acc_limit;    // acceleration limit
     float vel_limit;    // velocity limit
+    trajectory_buffer_t *traj_buffer; // buffered trajectory points or NULL
+    uint32_t traj_underruns; // buffer ran empty while moving
 } setpoint_interpolator_t;
 
 
@@ -28,6 +32,7 @@ struct setpoint_s {
     bool velocity_control_enabled;
     float position_setpt;
     float velocity_setpt;
+    float acceleration_setpt;   // planned acceleration, 0 if none
     float feedforward_torque;
 };
 
@@ -57,6 +62,20 @@ void setpoint_update_trajectory(setpoint_interpolator_t *ip,
                                 float torque,
                                 timestamp_t ts);
 
+/*
+ * Plays out the points of the buffer once the first one is due. When the
+ * buffer runs empty the setpoint stops with the acceleration limit.
+ */
+void setpoint_set_trajectory_buffer(setpoint_interpolator_t *ip,
+                                    trajectory_buffer_t *buffer);
+
+/*
+ * Drops the buffered points queued before mark (see trajectory_buffer_mark),
+ * called with the other setpoint updates, the points queued after the
+ * command was received are kept.
+ */
+void setpoint_discard_trajectory(setpoint_interpolator_t *ip, uint32_t mark);
+
 void setpoint_compute(setpoint_interpolator_t *ip,
                       struct setpoint_s *setpts,
                       float delta_t);
@@ -0,0 +1,30 @@
+#include <math.h>
+#include "signal_aggregate.h"
+
+void signal_aggregate_reset(struct signal_aggregate_s *a)
+{
+    a->min = INFINITY;
+    a->max = -INFINITY;
+    a->sum = 0;
+    a->count = 0;
+}
+
+void signal_aggregate_add(struct signal_aggregate_s *a, float value)
+{
+    if (value < a->min) {
+        a->min = value;
+    }
+    if (value > a->max) {
+        a->max = value;
+    }
+    a->sum += value;
+    a->count++;
+}
+
+float signal_aggregate_mean(const struct signal_aggregate_s *a)
+{
+    if (a->count == 0) {
+        return 0;
+    }
+    return a->sum / a->count;
+}
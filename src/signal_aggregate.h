@@ -0,0 +1,30 @@
+#ifndef SIGNAL_AGGREGATE_H
+#define SIGNAL_AGGREGATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Minimum, maximum and mean of a signal over an interval, accumulated at
+ * every sample so that peaks between two reports are not missed.
+ */
+struct signal_aggregate_s {
+    float min;
+    float max;
+    float sum;
+    uint32_t count;
+};
+
+void signal_aggregate_reset(struct signal_aggregate_s *a);
+void signal_aggregate_add(struct signal_aggregate_s *a, float value);
+/* 0 if there is no sample */
+float signal_aggregate_mean(const struct signal_aggregate_s *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIGNAL_AGGREGATE_H */
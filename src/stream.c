@@ -1,29 +1,204 @@
 #include "stream.h"
 #include <math.h>
 
+#define PHASE_FULL_SCALE    4294967296.f    // 2^32
 
-void stream_set_prescaler(stream_config_t *stream_config, float frequency, float spin_frequency)
+#define UAVCAN_FRAME_PAYLOAD    7   // bytes, one is the tail byte
+#define UAVCAN_TRANSFER_CRC     2
+
+
+unsigned stream_frame_count(unsigned payload_bytes)
+{
+    if (payload_bytes <= UAVCAN_FRAME_PAYLOAD) {
+        return 1;
+    }
+    // multi frame transfers start with a CRC
+    return (payload_bytes + UAVCAN_TRANSFER_CRC + UAVCAN_FRAME_PAYLOAD - 1) / UAVCAN_FRAME_PAYLOAD;
+}
+
+void stream_init(stream_config_t *stream_config, unsigned payload_bytes)
+{
+    stream_config->enabled = false;
+    stream_config->due = false;
+    stream_config->frequency = 0;
+    stream_config->frame_count = stream_frame_count(payload_bytes);
+    stream_config->increment = 0;
+    stream_config->phase = 0;
+    stream_config->deadband = 0;
+    stream_config->last_value = 0;
+    stream_config->last_count = 0;
+    stream_config->max_interval = 0;
+    stream_config->idle_ticks = 0;
+}
+
+static uint32_t phase_increment(float frequency, float tick_frequency)
+{
+    float increment = frequency / tick_frequency * PHASE_FULL_SCALE;
+    if (increment >= PHASE_FULL_SCALE) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)increment;
+}
+
+static void rebalance(stream_scheduler_t *sched)
+{
+    unsigned i;
+    float frames = 0;
+    for (i = 0; i < sched->nb_streams; i++) {
+        if (sched->streams[i]->enabled) {
+            frames += sched->streams[i]->frequency * sched->streams[i]->frame_count;
+        }
+    }
+
+    float budget = sched->frame_budget - sched->reserved;
+    if (budget < 0) {
+        budget = 0;
+    }
+    sched->rate_scale = 1;
+    if (frames > budget) {
+        sched->rate_scale = budget / frames;
+    }
+
+    for (i = 0; i < sched->nb_streams; i++) {
+        stream_config_t *s = sched->streams[i];
+        s->increment = phase_increment(s->frequency * sched->rate_scale,
+                                       sched->tick_frequency);
+    }
+}
+
+void stream_scheduler_init(stream_scheduler_t *sched, stream_config_t **streams,
+                           unsigned nb_streams, float tick_frequency,
+                           float frame_budget)
+{
+    unsigned i;
+    sched->streams = streams;
+    sched->nb_streams = nb_streams;
+    sched->tick_frequency = tick_frequency;
+    sched->frame_budget = frame_budget;
+    sched->reserved = 0;
+    for (i = 0; i < nb_streams; i++) {
+        streams[i]->phase = (uint32_t)(PHASE_FULL_SCALE / nb_streams * i);
+    }
+    rebalance(sched);
+}
+
+void stream_set_frequency(stream_scheduler_t *sched, stream_config_t *stream_config, float frequency)
 {
-    stream_config->prescaler = nearbyint(spin_frequency / frequency);
-    stream_config->counter = stream_config->prescaler;
+    if (!(frequency > 0)) {
+        frequency = 0;
+    }
+    if (frequency > STREAM_MAX_FREQUENCY) {
+        frequency = STREAM_MAX_FREQUENCY;
+    }
+    stream_config->frequency = frequency;
+    rebalance(sched);
 }
 
-void stream_enable(stream_config_t *stream_config, bool enabled)
+void stream_scheduler_reserve(stream_scheduler_t *sched, float frames_per_s)
+{
+    if (!(frames_per_s > 0)) {
+        frames_per_s = 0;
+    }
+    if (frames_per_s != sched->reserved) {
+        sched->reserved = frames_per_s;
+        rebalance(sched);
+    }
+}
+
+void stream_enable(stream_scheduler_t *sched, stream_config_t *stream_config, bool enabled)
 {
     stream_config->enabled = enabled;
+    if (!enabled) {
+        stream_config->due = false;
+    }
+    rebalance(sched);
 }
 
-bool stream_update(stream_config_t *stream_config)
+void stream_set_deadband(stream_scheduler_t *sched, stream_config_t *stream_config,
+                         float deadband, float max_interval)
+{
+    if (!(deadband > 0)) {
+        deadband = 0;
+    }
+    stream_config->deadband = deadband;
+    float ticks = max_interval * sched->tick_frequency;
+    if (ticks > 0 && ticks < UINT32_MAX) {
+        stream_config->max_interval = ticks;
+    } else {
+        stream_config->max_interval = UINT32_MAX;
+    }
+    // the next message is sent regardless of the value
+    stream_config->idle_ticks = UINT32_MAX;
+}
+
+float stream_get_frequency(const stream_scheduler_t *sched, const stream_config_t *stream_config)
+{
+    if (!stream_config->enabled) {
+        return 0;
+    }
+    return stream_config->increment / PHASE_FULL_SCALE * sched->tick_frequency;
+}
+
+void stream_scheduler_tick(stream_scheduler_t *sched, uint32_t nb_ticks)
 {
-    if (stream_config->enabled) {
-        stream_config->counter--;
-        if (stream_config->counter == 0) {
-            stream_config->counter = stream_config->prescaler;
-            return true;
+    unsigned i;
+    for (i = 0; i < sched->nb_streams; i++) {
+        stream_config_t *s = sched->streams[i];
+        if (!s->enabled) {
+            continue;
+        }
+        if (s->idle_ticks < UINT32_MAX - nb_ticks) {
+            s->idle_ticks += nb_ticks;
         } else {
-            return false;
+            s->idle_ticks = UINT32_MAX;
         }
+        uint64_t phase = s->phase + (uint64_t)s->increment * nb_ticks;
+        if (phase > UINT32_MAX) {
+            s->due = true;
+        }
+        s->phase = (uint32_t)phase;
     }
+}
 
-    return false;
+bool stream_update(stream_config_t *stream_config)
+{
+    bool due = stream_config->due;
+    stream_config->due = false;
+    return due;
+}
+
+// true if a due stream is sent, moved is the distance to the last message
+static bool deadband_update(stream_config_t *stream_config, float moved)
+{
+    if (stream_config->deadband > 0
+        && moved <= stream_config->deadband
+        && stream_config->idle_ticks < stream_config->max_interval) {
+        return false;
+    }
+    stream_config->idle_ticks = 0;
+    return true;
+}
+
+bool stream_update_value(stream_config_t *stream_config, float value)
+{
+    if (!stream_update(stream_config)
+        || !deadband_update(stream_config, fabsf(value - stream_config->last_value))) {
+        return false;
+    }
+    stream_config->last_value = value;
+    return true;
+}
+
+bool stream_update_count(stream_config_t *stream_config, uint32_t count)
+{
+    // shortest distance, also across the wrap around
+    uint32_t moved = count - stream_config->last_count;
+    if (moved > INT32_MAX) {
+        moved = -moved;
+    }
+    if (!stream_update(stream_config) || !deadband_update(stream_config, moved)) {
+        return false;
+    }
+    stream_config->last_count = count;
+    return true;
 }
@@ -9,17 +9,91 @@
 extern "C" {
 #endif
 
+#define STREAM_MAX_FREQUENCY    1000    // [Hz]
+
+/*
+ * Telemetry streams are scheduled by a fractional rate accumulator: every
+ * tick adds frequency / tick_frequency to a 32 bit phase, the stream is due
+ * when it wraps. Rates are exact on average, independent of the tick rate.
+ */
 typedef struct {
     bool enabled;
-    uint16_t prescaler;
-    uint16_t counter;
+    bool due;
+    float frequency;        // requested [Hz]
+    uint8_t frame_count;    // CAN frames per message
+    uint32_t increment;     // phase per tick, 2^32 is one message
+    uint32_t phase;
+
+    // deadband mode, see stream_update_value()
+    float deadband;         // 0 for a periodic stream
+    float last_value;       // of the last message
+    uint32_t last_count;    // of the last message, counter streams
+    uint32_t max_interval;  // [ticks]
+    uint32_t idle_ticks;    // since the last message
 } stream_config_t;
 
+typedef struct {
+    stream_config_t **streams;
+    unsigned nb_streams;
+    float tick_frequency;   // [Hz]
+    float frame_budget;     // [frames/s] for all streams
+    float reserved;         // [frames/s] of the budget used by other traffic
+    float rate_scale;       // below 1 when the budget is exceeded
+} stream_scheduler_t;
+
+
+/* number of CAN frames of a UAVCAN transfer */
+unsigned stream_frame_count(unsigned payload_bytes);
+
+/* disabled stream of messages of payload_bytes */
+void stream_init(stream_config_t *stream_config, unsigned payload_bytes);
+
+/*
+ * Streams are spread over the phase so that streams of the same rate are
+ * not due on the same tick.
+ */
+void stream_scheduler_init(stream_scheduler_t *sched, stream_config_t **streams,
+                           unsigned nb_streams, float tick_frequency,
+                           float frame_budget);
 
-void stream_set_prescaler(stream_config_t *stream_config, float frequency, float spin_frequency);
-void stream_enable(stream_config_t *stream_config, bool enabled);
+/*
+ * If the enabled streams need more than the frame budget, all rates are
+ * scaled down by the same factor.
+ */
+void stream_set_frequency(stream_scheduler_t *sched, stream_config_t *stream_config, float frequency);
+
+/* frames/s sent outside of the streams, deducted from the budget */
+void stream_scheduler_reserve(stream_scheduler_t *sched, float frames_per_s);
+void stream_enable(stream_scheduler_t *sched, stream_config_t *stream_config, bool enabled);
+
+/*
+ * With a deadband, a due stream is only sent if its value moved by more
+ * than the deadband since the last message, or after max_interval [s]
+ * (0 for none). The stream frequency is then the maximum rate. A deadband
+ * of 0 makes the stream periodic again.
+ */
+void stream_set_deadband(stream_scheduler_t *sched, stream_config_t *stream_config,
+                         float deadband, float max_interval);
+
+/* effective rate of a stream after the budget [Hz] */
+float stream_get_frequency(const stream_scheduler_t *sched, const stream_config_t *stream_config);
+
+/*
+ * Advances all streams by nb_ticks. A stream is due at most once per call,
+ * missed messages are dropped instead of sent in a burst.
+ */
+void stream_scheduler_tick(stream_scheduler_t *sched, uint32_t nb_ticks);
+
+/* returns true once if the stream is due */
 bool stream_update(stream_config_t *stream_config);
 
+/* same as stream_update, applies the deadband to value */
+bool stream_update_value(stream_config_t *stream_config, float value);
+
+/* same for a wrapping counter (e.g. an encoder), the deadband is compared to
+ * the exact integer difference */
+bool stream_update_count(stream_config_t *stream_config, uint32_t count);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,101 @@
+#include <stddef.h>
+#include <math.h>
+#include "telemetry_batch.h"
+
+#define DELTA_RANGE 32000   // below INT16_MAX, the rounding error can add a step
+
+
+void telemetry_batch_channel_init(telemetry_batch_channel_t *c)
+{
+    c->write = 0;
+    c->count = 0;
+    c->ready = -1;
+    c->overruns = 0;
+    c->signal = 0;
+    c->sample_period = 0;
+}
+
+void telemetry_batch_restart(telemetry_batch_channel_t *c, int signal, float sample_period)
+{
+    c->count = 0;
+    c->signal = signal;
+    c->sample_period = sample_period;
+}
+
+bool telemetry_batch_add(telemetry_batch_channel_t *c, float value, timestamp_t timestamp)
+{
+    telemetry_batch_t *batch = &c->buffer[c->write];
+    if (c->count == 0) {
+        batch->timestamp = timestamp;
+        batch->signal = c->signal;
+        batch->sample_period = c->sample_period;
+    }
+    batch->samples[c->count++] = value;
+    if (c->count < TELEMETRY_BATCH_SIZE) {
+        return false;
+    }
+
+    c->count = 0;
+    if (c->ready >= 0) {
+        // the other buffer wasn't sent yet, overwrite this one
+        c->overruns++;
+        return false;
+    }
+    c->ready = c->write;
+    c->write ^= 1;
+    return true;
+}
+
+const telemetry_batch_t *telemetry_batch_get(telemetry_batch_channel_t *c)
+{
+    int ready = c->ready;
+    if (ready < 0) {
+        return NULL;
+    }
+    return &c->buffer[ready];
+}
+
+void telemetry_batch_release(telemetry_batch_channel_t *c)
+{
+    c->ready = -1;
+}
+
+void telemetry_batch_pack(const telemetry_batch_t *batch, struct telemetry_batch_packed_s *packed)
+{
+    unsigned i;
+    float max_step = 0;
+    for (i = 1; i < TELEMETRY_BATCH_SIZE; i++) {
+        float step = fabsf(batch->samples[i] - batch->samples[i - 1]);
+        if (step > max_step) {
+            max_step = step;
+        }
+    }
+
+    packed->base = batch->samples[0];
+    packed->scale = max_step / DELTA_RANGE;
+
+    float value = packed->base;
+    for (i = 1; i < TELEMETRY_BATCH_SIZE; i++) {
+        float delta = 0;
+        if (packed->scale > 0) {
+            delta = nearbyintf((batch->samples[i] - value) / packed->scale);
+        }
+        if (delta > INT16_MAX) {
+            delta = INT16_MAX;
+        } else if (delta < INT16_MIN) {
+            delta = INT16_MIN;
+        }
+        packed->deltas[i - 1] = delta;
+        value += packed->deltas[i - 1] * packed->scale;
+    }
+}
+
+float telemetry_batch_unpack(const struct telemetry_batch_packed_s *packed, unsigned i)
+{
+    unsigned j;
+    float value = packed->base;
+    for (j = 0; j < i; j++) {
+        value += packed->deltas[j] * packed->scale;
+    }
+    return value;
+}
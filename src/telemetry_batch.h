@@ -0,0 +1,78 @@
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timestamp/timestamp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batched telemetry
+ * =================
+ *
+ * Consecutive samples of one signal are collected by the control loop and
+ * sent in a single transfer as a base value and int16 deltas:
+ *
+ *     sample[0] = base
+ *     sample[i] = sample[i - 1] + deltas[i - 1] * scale
+ *
+ * The scale is chosen per batch from the largest step and the deltas are
+ * quantized against the reconstructed value, so the rounding error does
+ * not accumulate along the batch.
+ *
+ * Each channel has two buffers, the control loop fills one while the other
+ * waits to be sent. The channel is single producer, single consumer and
+ * needs no lock on a single core.
+ */
+
+#define TELEMETRY_BATCH_SIZE    48  // samples per message
+
+typedef struct {
+    float samples[TELEMETRY_BATCH_SIZE];
+    timestamp_t timestamp;  // of the first sample
+    int signal;             // configuration when the batch was started
+    float sample_period;    // [s]
+} telemetry_batch_t;
+
+typedef struct {
+    telemetry_batch_t buffer[2];
+    unsigned write;             // buffer filled by the producer
+    unsigned count;             // samples in the write buffer
+    volatile int ready;         // full buffer waiting for the consumer, or -1
+    volatile uint32_t overruns; // batches dropped because the consumer was late
+    int signal;                 // copied to every batch started
+    float sample_period;
+} telemetry_batch_channel_t;
+
+struct telemetry_batch_packed_s {
+    float base;
+    float scale;
+    int16_t deltas[TELEMETRY_BATCH_SIZE - 1];
+};
+
+void telemetry_batch_channel_init(telemetry_batch_channel_t *c);
+
+/*
+ * producer, restarts the batch being filled with a new configuration, a
+ * full batch waiting for the consumer keeps the one it was sampled with
+ */
+void telemetry_batch_restart(telemetry_batch_channel_t *c, int signal, float sample_period);
+/* producer, returns true when it completed a batch */
+bool telemetry_batch_add(telemetry_batch_channel_t *c, float value, timestamp_t timestamp);
+
+/* consumer, returns the full batch or NULL, to release when sent */
+const telemetry_batch_t *telemetry_batch_get(telemetry_batch_channel_t *c);
+void telemetry_batch_release(telemetry_batch_channel_t *c);
+
+void telemetry_batch_pack(const telemetry_batch_t *batch, struct telemetry_batch_packed_s *packed);
+/* reference decoder, sample i of a packed batch */
+float telemetry_batch_unpack(const struct telemetry_batch_packed_s *packed, unsigned i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_BATCH_H */
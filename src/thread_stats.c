@@ -0,0 +1,94 @@
+#include <ch.h>
+#include "thread_stats.h"
+
+volatile uint32_t thread_stats_irq_cycles = 0;
+volatile uint32_t thread_stats_irq_start;
+volatile unsigned thread_stats_irq_nesting = 0;
+
+// current thread slice
+static uint32_t slice_start;
+static uint32_t slice_irq_start;
+
+static uint32_t last_sample;
+static uint32_t last_irq_cycles;
+static float irq_load;
+
+// process stack of the main thread, filled by the startup code
+extern uint8_t __process_stack_base__[];
+extern uint8_t __process_stack_end__[];
+
+// called from a locked state
+static void account(thread_t *tp, uint32_t now)
+{
+    uint32_t irq = thread_stats_irq_cycles;
+    tp->stats_cycles += (now - slice_start) - (irq - slice_irq_start);
+    slice_start = now;
+    slice_irq_start = irq;
+}
+
+void thread_stats_init(void)
+{
+    chSysLock();
+    slice_start = cycle_counter_get();
+    slice_irq_start = thread_stats_irq_cycles;
+    last_sample = slice_start;
+    chSysUnlock();
+}
+
+void thread_stats_switch(thread_t *ntp, thread_t *otp)
+{
+    (void)ntp;
+    account(otp, cycle_counter_get());
+}
+
+void thread_stats_sample(void)
+{
+    chSysLock();
+    uint32_t now = cycle_counter_get();
+    account(chThdGetSelfX(), now);
+    float window = now - last_sample;
+    last_sample = now;
+    uint32_t irq = thread_stats_irq_cycles;
+    chSysUnlock();
+
+    if (window == 0) {
+        return;
+    }
+    irq_load = (irq - last_irq_cycles) / window;
+    last_irq_cycles = irq;
+
+    thread_t *tp = chRegFirstThread();
+    while (tp != NULL) {
+        uint32_t cycles = tp->stats_cycles;
+        tp->stats_load = (cycles - tp->stats_last_cycles) / window;
+        tp->stats_last_cycles = cycles;
+        tp = chRegNextThread(tp);
+    }
+}
+
+static int unused_bytes(const uint8_t *bottom, const uint8_t *top)
+{
+    const uint8_t *p = bottom;
+    while (p < top && *p == CH_DBG_STACK_FILL_VALUE) {
+        p++;
+    }
+    return p - bottom;
+}
+
+void thread_stats_get(thread_t *tp, struct thread_stats_s *stats)
+{
+    stats->name = tp->p_name;
+    stats->cpu_load = tp->stats_load;
+    if (tp == &ch.mainthread) {
+        stats->stack_free = unused_bytes(__process_stack_base__, __process_stack_end__);
+    } else {
+        // the stack grows down to the thread descriptor at the working area
+        // start, the initial context at the top always ends the scan
+        stats->stack_free = unused_bytes((const uint8_t *)(tp + 1), (const uint8_t *)UINTPTR_MAX);
+    }
+}
+
+float thread_stats_irq_load(void)
+{
+    return irq_load;
+}
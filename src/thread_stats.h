@@ -0,0 +1,73 @@
+#ifndef THREAD_STATS_H
+#define THREAD_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ch.h>
+#include "cycle_counter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CPU time per thread and stack headroom.
+ *
+ * The context switch hook (chconf.h) adds the cycle counter time of every
+ * thread slice to the thread, minus the time spent in the instrumented
+ * interrupt handlers, which is accounted separately. Interrupts without
+ * thread_stats_irq_enter/exit count towards the thread they preempt.
+ *
+ * The stacks are filled with CH_DBG_STACK_FILL_VALUE at creation, the free
+ * stack is the part never written since.
+ */
+
+struct thread_stats_s {
+    const char *name;
+    float cpu_load;         // fraction of the CPU over the last window
+    int stack_free;         // [bytes] never used since the thread started
+};
+
+extern volatile uint32_t thread_stats_irq_cycles;
+extern volatile uint32_t thread_stats_irq_start;
+extern volatile unsigned thread_stats_irq_nesting;
+
+/* at the start and end of an interrupt handler, nested handlers count once */
+static inline void thread_stats_irq_enter(void)
+{
+    if (thread_stats_irq_nesting++ == 0) {
+        thread_stats_irq_start = cycle_counter_get();
+    }
+}
+
+static inline void thread_stats_irq_exit(void)
+{
+    uint32_t now = cycle_counter_get();
+    if (--thread_stats_irq_nesting == 0) {
+        thread_stats_irq_cycles += now - thread_stats_irq_start;
+    }
+}
+
+/* starts the first window, after cycle_counter_init() */
+void thread_stats_init(void);
+
+/* called by CH_CFG_CONTEXT_SWITCH_HOOK */
+void thread_stats_switch(thread_t *ntp, thread_t *otp);
+
+/*
+ * Computes the CPU load of every thread and of the interrupts since the
+ * previous call, the window must be shorter than the cycle counter wrap
+ * around (~60s at 72MHz).
+ */
+void thread_stats_sample(void);
+
+/* thread statistics of the last window, iterate with chRegFirstThread() */
+void thread_stats_get(thread_t *tp, struct thread_stats_s *stats);
+
+float thread_stats_irq_load(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREAD_STATS_H */
@@ -0,0 +1,31 @@
+#include "time_sync.h"
+
+void time_sync_init(time_sync_t *ts)
+{
+    ts->network_ref = 0;
+    ts->local_ref = 0;
+    ts->valid = false;
+}
+
+void time_sync_update(time_sync_t *ts, uint64_t network_us, timestamp_t local)
+{
+    ts->network_ref = network_us;
+    ts->local_ref = local;
+    ts->valid = (network_us != 0);
+}
+
+bool time_sync_is_valid(const time_sync_t *ts)
+{
+    return ts->valid;
+}
+
+timestamp_t time_sync_to_local(const time_sync_t *ts, uint64_t network_us)
+{
+    // modulo 2^32, like the local time
+    return ts->local_ref + (timestamp_t)(network_us - ts->network_ref);
+}
+
+uint64_t time_sync_to_network(const time_sync_t *ts, timestamp_t local)
+{
+    return ts->network_ref + (int64_t)(int32_t)(local - ts->local_ref);
+}
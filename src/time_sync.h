@@ -0,0 +1,50 @@
+/**
+ * Time synchronization
+ * ====================
+ *
+ * Maps the UAVCAN clock (uavcan.protocol.GlobalTimeSync network time, or
+ * frame reception timestamps) to the local timestamp_t time base of the
+ * control loop.
+ *
+ * Both clocks are derived from the same crystal, but the UAVCAN UTC clock
+ * is slewed and stepped by the time sync slave. The mapping is therefore
+ * refreshed with a pair of readings taken at the same instant, at least
+ * every few seconds (the local time wraps every 71 minutes).
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timestamp/timestamp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t network_ref;   // [us]
+    timestamp_t local_ref;  // local time at network_ref
+    bool valid;
+} time_sync_t;
+
+void time_sync_init(time_sync_t *ts);
+
+/** Records a network and local time sampled at the same instant, a network
+ * time of zero means the network clock is not set and invalidates the
+ * mapping. */
+void time_sync_update(time_sync_t *ts, uint64_t network_us, timestamp_t local);
+
+bool time_sync_is_valid(const time_sync_t *ts);
+
+/** Local time of a network time, within +-35 minutes of the last update. */
+timestamp_t time_sync_to_local(const time_sync_t *ts, uint64_t network_us);
+
+uint64_t time_sync_to_network(const time_sync_t *ts, timestamp_t local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIME_SYNC_H */
@@ -0,0 +1,66 @@
+#include "trajectory_buffer.h"
+
+#define INDEX_MASK (TRAJECTORY_BUFFER_SIZE - 1)
+
+
+void trajectory_buffer_init(trajectory_buffer_t *b)
+{
+    b->head = 0;
+    b->tail = 0;
+}
+
+bool trajectory_buffer_push(trajectory_buffer_t *b,
+                            const struct trajectory_point_s *point)
+{
+    uint32_t tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+    if (b->head - tail >= TRAJECTORY_BUFFER_SIZE) {
+        return false;
+    }
+    b->points[b->head & INDEX_MASK] = *point;
+
+    // the release ordering makes the point visible before the index
+    __atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+unsigned trajectory_buffer_count(trajectory_buffer_t *b)
+{
+    uint32_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+const struct trajectory_point_s *trajectory_buffer_peek(trajectory_buffer_t *b,
+                                                        unsigned i)
+{
+    if (i >= trajectory_buffer_count(b)) {
+        return NULL;
+    }
+    return &b->points[(b->tail + i) & INDEX_MASK];
+}
+
+void trajectory_buffer_pop(trajectory_buffer_t *b)
+{
+    if (trajectory_buffer_count(b) > 0) {
+        // the point is read before the slot is handed back to the producer
+        __atomic_store_n(&b->tail, b->tail + 1, __ATOMIC_RELEASE);
+    }
+}
+
+void trajectory_buffer_flush(trajectory_buffer_t *b)
+{
+    __atomic_store_n(&b->tail, __atomic_load_n(&b->head, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+uint32_t trajectory_buffer_mark(trajectory_buffer_t *b)
+{
+    return __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+}
+
+void trajectory_buffer_discard_until(trajectory_buffer_t *b, uint32_t mark)
+{
+    if ((int32_t)(mark - b->tail) > 0) {
+        __atomic_store_n(&b->tail, mark, __ATOMIC_RELEASE);
+    }
+}
@@ -0,0 +1,71 @@
+/**
+ * Trajectory buffer
+ * =================
+ *
+ * Queue of timestamped trajectory points from the communication thread to
+ * the control loop, lets the host send points ahead of their playout time.
+ *
+ * Single producer, single consumer ring buffer without locks: the producer
+ * only writes head, the consumer only writes tail. The points between tail
+ * and head belong to the consumer.
+ */
+
+#ifndef TRAJECTORY_BUFFER_H
+#define TRAJECTORY_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "timestamp/timestamp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRAJECTORY_BUFFER_SIZE 32   // must be a power of two
+
+struct trajectory_point_s {
+    timestamp_t time;       // local playout time
+    float position;
+    float velocity;
+    float acceleration;
+    float torque;
+};
+
+typedef struct {
+    struct trajectory_point_s points[TRAJECTORY_BUFFER_SIZE];
+    uint32_t head;          // next point to write, owned by the producer
+    uint32_t tail;          // oldest point, owned by the consumer
+} trajectory_buffer_t;
+
+
+void trajectory_buffer_init(trajectory_buffer_t *b);
+
+// producer, returns false if the buffer is full
+bool trajectory_buffer_push(trajectory_buffer_t *b,
+                            const struct trajectory_point_s *point);
+
+// number of queued points, exact for the consumer, upper bound otherwise
+unsigned trajectory_buffer_count(trajectory_buffer_t *b);
+
+// consumer, returns the i-th oldest point or NULL
+const struct trajectory_point_s *trajectory_buffer_peek(trajectory_buffer_t *b,
+                                                        unsigned i);
+
+// consumer, drops the oldest point
+void trajectory_buffer_pop(trajectory_buffer_t *b);
+
+// consumer, drops all points
+void trajectory_buffer_flush(trajectory_buffer_t *b);
+
+// any context, position of the next point to be pushed
+uint32_t trajectory_buffer_mark(trajectory_buffer_t *b);
+
+// consumer, drops the points pushed before mark
+void trajectory_buffer_discard_until(trajectory_buffer_t *b, uint32_t mark);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRAJECTORY_BUFFER_H */
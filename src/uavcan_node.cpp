@@ -1,5 +1,6 @@
 #include <ch.h>
 #include <hal.h>
+#include <math.h>
 #include <chprintf.h>
 #include <main.h>
 #include <uavcan/uavcan.hpp>
@@ -13,7 +14,12 @@
 #include <can-bootloader/boot_arg.h>
 #include <uavcan_stm32/uavcan_stm32.hpp>
 #include <uavcan/protocol/NodeStatus.hpp>
+#include <uavcan/protocol/global_time_sync_slave.hpp>
+#include <uavcan/transport/can_acceptance_filter_configurator.hpp>
 #include "stream.h"
+#include "time_sync.h"
+#include "cycle_counter.h"
+#include "thread_stats.h"
 
 #include <cvra/motor/config/LoadConfiguration.hpp>
 #include <cvra/motor/config/CurrentPID.hpp>
@@ -23,6 +29,15 @@
 #include <cvra/motor/config/EnableMotor.hpp>
 #include <cvra/motor/config/FeedbackStream.hpp>
 #include <cvra/StringID.hpp>
+#include <cvra/ControlLoopTiming.hpp>
+#include <cvra/TrajectoryPoint.hpp>
+#include <cvra/Scope.hpp>
+#include <cvra/TelemetryBatch.hpp>
+#include <cvra/TelemetryBatchConfig.hpp>
+#include <cvra/MotorState.hpp>
+#include <cvra/SignalAggregate.hpp>
+#include <cvra/CommStatus.hpp>
+#include <cvra/ThreadStats.hpp>
 #include <cvra/motor/feedback/CurrentPID.hpp>
 #include <cvra/motor/feedback/VelocityPID.hpp>
 #include <cvra/motor/feedback/PositionPID.hpp>
@@ -37,7 +52,19 @@
 #include <cvra/motor/control/Voltage.hpp>
 
 #define CAN_BITRATE             1000000
-#define UAVCAN_SPIN_FREQUENCY   100
+#define UAVCAN_RX_PRIO          (NORMALPRIO + 1)
+#define UAVCAN_RX_STACKSIZE     5000
+#define UAVCAN_RX_EVENT         EVENT_MASK(0)
+#define UAVCAN_SPIN_PERIOD      1       // [ms] without received frames
+#define UAVCAN_MAX_SUBSCRIPTIONS    32
+#define TELEMETRY_MAX_TX_TIMEOUT    1000000 // [us]
+#define TELEMETRY_PRIO          (NORMALPRIO - 1)
+#define TELEMETRY_STACKSIZE     3000
+#define TELEMETRY_TICK_EVENT    EVENT_MASK(0)
+#define TELEMETRY_IDLE_PERIOD   1       // [ms] while the control loop is stopped
+#define TELEMETRY_FRAME_BUDGET  2000    // [frames/s], about a quarter of the bus
+#define BATCH_FRAME_BUDGET      (TELEMETRY_FRAME_BUDGET / 2)    // [frames/s], part of it
+#define LOOP_TIMING_STREAM_FREQUENCY    (CONTROL_TIMING_NB_STAGES * 0.5) // every stage each 2s
 
 uavcan_stm32::CanInitHelper<128> can;
 
@@ -45,26 +72,355 @@ typedef uavcan::Node<4096> Node;
 
 uavcan::LazyConstructor<Node> node_;
 
+// libuavcan isn't thread safe, the RX and telemetry threads share the node
+// under this lock. The telemetry state is owned by the telemetry thread, the
+// RX thread only posts requests to it under the system lock.
+static uavcan_stm32::Mutex node_mutex;
+static thread_t *rx_thread;
+
+
+
+stream_config_t string_id_stream_config;
+stream_config_t current_pid_stream_config;
+stream_config_t velocity_pid_stream_config;
+stream_config_t position_pid_stream_config;
+stream_config_t index_stream_config;
+stream_config_t motor_enc_stream_config;
+stream_config_t motor_pos_stream_config;
+stream_config_t motor_torque_stream_config;
+stream_config_t loop_timing_stream_config;
+stream_config_t motor_state_stream_config;
+stream_config_t comm_status_stream_config;
+stream_config_t thread_stats_stream_config;
+
+static struct {
+    parameter_namespace_t ns;
+    parameter_t signal;
+    parameter_t frequency;
+    stream_config_t stream;
+} aggregate_streams[CONTROL_AGGREGATE_NB_CHANNELS];
+static const char *aggregate_names[CONTROL_AGGREGATE_NB_CHANNELS] = {"0", "1", "2", "3"};
+
+static stream_config_t *telemetry_streams[] = {
+    &string_id_stream_config,
+    &current_pid_stream_config,
+    &velocity_pid_stream_config,
+    &position_pid_stream_config,
+    &index_stream_config,
+    &motor_enc_stream_config,
+    &motor_pos_stream_config,
+    &motor_torque_stream_config,
+    &loop_timing_stream_config,
+    &motor_state_stream_config,
+    &comm_status_stream_config,
+    &thread_stats_stream_config,
+    &aggregate_streams[0].stream,
+    &aggregate_streams[1].stream,
+    &aggregate_streams[2].stream,
+    &aggregate_streams[3].stream,
+};
+
+static parameter_namespace_t param_ns_telemetry;
+static parameter_namespace_t param_ns_aggregate;
+static parameter_namespace_t param_ns_deadband;
+
+// telemetry/deadband/<stream>/{deadband,max_interval}
+static struct {
+    const char *name;
+    stream_config_t *stream;
+    parameter_namespace_t ns;
+    parameter_t deadband;
+    parameter_t max_interval;
+} deadband_streams[] = {
+    {"current_pid", &current_pid_stream_config},        // on current
+    {"velocity_pid", &velocity_pid_stream_config},      // on velocity
+    {"position_pid", &position_pid_stream_config},      // on position
+    {"motor_encoder", &motor_enc_stream_config},        // on encoder counts
+    {"motor_position", &motor_pos_stream_config},       // on position
+    {"motor_torque", &motor_torque_stream_config},      // on torque
+    {"motor_state", &motor_state_stream_config},        // on position
+};
+static parameter_t param_state_frequency;
+static parameter_t param_comm_status_frequency;
+static parameter_t param_thread_stats_frequency;
+
+// ticks are timestamp_get() microseconds, woken by the control loop
+static stream_scheduler_t telemetry;
+
+// TX frames dropped by the CAN driver, per telemetry message type
+static struct {
+    const char *name;
+    uint16_t data_type_id;
+    bool coalesce;              // a newer message replaces a pending one
+    volatile uint32_t expired;
+    volatile uint32_t replaced;
+} tx_streams[] = {
+    {"current_pid", cvra::motor::feedback::CurrentPID::DefaultDataTypeID, true, 0, 0},
+    {"velocity_pid", cvra::motor::feedback::VelocityPID::DefaultDataTypeID, true, 0, 0},
+    {"position_pid", cvra::motor::feedback::PositionPID::DefaultDataTypeID, true, 0, 0},
+    {"index", cvra::motor::feedback::Index::DefaultDataTypeID, true, 0, 0},
+    {"motor_encoder", cvra::motor::feedback::MotorEncoderPosition::DefaultDataTypeID, true, 0, 0},
+    {"motor_position", cvra::motor::feedback::MotorPosition::DefaultDataTypeID, true, 0, 0},
+    {"motor_torque", cvra::motor::feedback::MotorTorque::DefaultDataTypeID, true, 0, 0},
+    {"motor_state", cvra::MotorState::DefaultDataTypeID, true, 0, 0},
+    {"string_id", cvra::StringID::DefaultDataTypeID, true, 0, 0},
+    // channels and stages share the type, all of them must be sent
+    {"aggregate", cvra::SignalAggregate::DefaultDataTypeID, false, 0, 0},
+    {"loop_timing", cvra::ControlLoopTiming::DefaultDataTypeID, false, 0, 0},
+    {"batch", cvra::TelemetryBatch::DefaultDataTypeID, false, 0, 0},
+    {"other", 0, false, 0, 0},      // services, node status, ...
+};
+#define TX_STREAM_OTHER (sizeof(tx_streams) / sizeof(tx_streams[0]) - 1)
+
+// network time (UAVCAN UTC clock) to local time
+static time_sync_t network_time;
+// copy for the telemetry thread, protected by the system lock
+static time_sync_t telemetry_network_time;
+static bool network_time_active;        // time sync master present
+
+static parameter_namespace_t param_ns_uavcan;
+static parameter_t param_rx_fast_path;
+static parameter_t param_hw_filters;
+static volatile bool rx_fast_path_enabled;
+
+// message types of the started subscribers and our node ID, frames for
+// anything else are dropped in the RX interrupt
+static uint16_t subscribed_types[UAVCAN_MAX_SUBSCRIPTIONS];
+static volatile unsigned nb_subscribed_types;   // 0 accepts everything
+static uint8_t own_node_id;
+
+static volatile uint32_t rx_fast_path_count;
+static volatile uint32_t rx_software_reject_count;
+
+
+// FeedbackStream settings of the RX thread, applied by the telemetry thread
+static struct {
+    stream_config_t *stream;
+    bool pending;
+    bool enabled;
+    float frequency;
+} feedback_stream_requests[] = {
+    {&current_pid_stream_config, false, false, 0},
+    {&velocity_pid_stream_config, false, false, 0},
+    {&position_pid_stream_config, false, false, 0},
+    {&index_stream_config, false, false, 0},
+    {&motor_enc_stream_config, false, false, 0},
+    {&motor_pos_stream_config, false, false, 0},
+    {&motor_torque_stream_config, false, false, 0},
+};
+
+static void feedback_stream_request(stream_config_t *stream_config,
+                                    const uavcan::ReceivedDataStructure<cvra::motor::config::FeedbackStream>& msg)
+{
+    for (auto &r : feedback_stream_requests) {
+        if (r.stream == stream_config) {
+            chSysLock();
+            r.enabled = msg.enabled != 0;
+            r.frequency = msg.frequency;
+            r.pending = true;
+            chSysUnlock();
+        }
+    }
+}
+
+static void feedback_stream_apply_requests(void)
+{
+    for (auto &r : feedback_stream_requests) {
+        chSysLock();
+        bool pending = r.pending;
+        bool enabled = r.enabled;
+        float frequency = r.frequency;
+        r.pending = false;
+        chSysUnlock();
+        if (!pending) {
+            continue;
+        }
+        if (enabled) {
+            stream_set_frequency(&telemetry, r.stream, frequency);
+        }
+        stream_enable(&telemetry, r.stream, enabled);
+    }
+}
 
+#define PAYLOAD_SIZE(type) ((type::MaxBitLen + 7) / 8)
 
-stream_config_t string_id_stream_config     = {false, 0, 0};
-stream_config_t current_pid_stream_config   = {false, 0, 0};
-stream_config_t velocity_pid_stream_config  = {false, 0, 0};
-stream_config_t position_pid_stream_config  = {false, 0, 0};
-stream_config_t index_stream_config         = {false, 0, 0};
-stream_config_t motor_enc_stream_config     = {false, 0, 0};
-stream_config_t motor_pos_stream_config     = {false, 0, 0};
-stream_config_t motor_torque_stream_config  = {false, 0, 0};
+// TelemetryBatchConfig of the RX thread, applied by the telemetry thread
+static struct control_batch_config_s batch_request_shadow[CONTROL_BATCH_NB_CHANNELS];
+static bool batch_request_pending[CONTROL_BATCH_NB_CHANNELS];
+// configuration of each batch channel as requested by the host
+static struct control_batch_config_s batch_requests[CONTROL_BATCH_NB_CHANNELS];
+// accepted divider of each batch channel, 0 if disabled
+static unsigned batch_dividers[CONTROL_BATCH_NB_CHANNELS];
 
+// frames/s of a batch channel sampling every divider cycles
+static float batch_frame_rate(unsigned divider)
+{
+    unsigned frames = stream_frame_count(PAYLOAD_SIZE(cvra::TelemetryBatch));
+    return frames / (divider * control_cycle_period() * TELEMETRY_BATCH_SIZE);
+}
 
-static void stream_init_from_callback(stream_config_t *stream_config,
-                                      const uavcan::ReceivedDataStructure<cvra::motor::config::FeedbackStream>& msg)
+static float batch_frame_rate_total(void)
 {
-    if (msg.enabled != 0) {
-        stream_set_prescaler(stream_config, msg.frequency, UAVCAN_SPIN_FREQUENCY);
-        stream_enable(stream_config, true);
-    } else {
-        stream_enable(stream_config, false);
+    float frames = 0;
+    for (auto divider : batch_dividers) {
+        if (divider != 0) {
+            frames += batch_frame_rate(divider);
+        }
+    }
+    return frames;
+}
+
+/*
+ * Raises the divider so that all batch channels fit in BATCH_FRAME_BUDGET,
+ * returns false if the budget is used up by the other channels.
+ */
+static bool batch_limit_divider(unsigned channel, struct control_batch_config_s *cfg)
+{
+    float available = BATCH_FRAME_BUDGET;
+    for (unsigned i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        if (i != channel && batch_dividers[i] != 0) {
+            available -= batch_frame_rate(batch_dividers[i]);
+        }
+    }
+    if (!(available > 0)) {
+        return false;
+    }
+    unsigned min_divider = ceilf(batch_frame_rate(1) / available);
+    if (cfg->divider < min_divider) {
+        cfg->divider = min_divider;
+    }
+    return true;
+}
+
+static void node_warning(Node& node)
+{
+    node_mutex.lock();
+    node.setStatusWarning();
+    node_mutex.unlock();
+}
+
+/*
+ * The batch frame rates scale with the control cycle, when its period
+ * changes the dividers are limited again from the requested ones. A channel
+ * that no longer fits is disabled.
+ */
+static void batch_update_cycle_period(Node& node)
+{
+    static float period = 0;
+    if (control_cycle_period() == period) {
+        return;
+    }
+    period = control_cycle_period();
+
+    for (auto &divider : batch_dividers) {
+        divider = 0;
+    }
+    for (unsigned i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        struct control_batch_config_s cfg = batch_requests[i];
+        if (!cfg.enabled) {
+            continue;
+        }
+        if (!batch_limit_divider(i, &cfg)) {
+            cfg.enabled = false;
+        }
+        if (cfg.divider != batch_requests[i].divider || !cfg.enabled) {
+            node_warning(node);
+        }
+        control_batch_configure(i, &cfg);
+        batch_dividers[i] = cfg.enabled ? cfg.divider : 0;
+    }
+}
+
+// returns false if the request was refused or its divider limited
+static bool batch_configure(unsigned channel, const struct control_batch_config_s *request)
+{
+    struct control_batch_config_s cfg = *request;
+    if (cfg.enabled && !batch_limit_divider(channel, &cfg)) {
+        return false;
+    }
+    if (!control_batch_configure(channel, &cfg)) {
+        return false;
+    }
+    batch_requests[channel] = *request;
+    batch_dividers[channel] = cfg.enabled ? cfg.divider : 0;
+    return cfg.divider == request->divider;
+}
+
+static void batch_apply_requests(Node& node)
+{
+    for (unsigned i = 0; i < CONTROL_BATCH_NB_CHANNELS; i++) {
+        chSysLock();
+        bool pending = batch_request_pending[i];
+        struct control_batch_config_s request = batch_request_shadow[i];
+        batch_request_pending[i] = false;
+        chSysUnlock();
+        if (pending && !batch_configure(i, &request)) {
+            node_warning(node);
+        }
+    }
+}
+
+static void telemetry_init(void)
+{
+    stream_init(&string_id_stream_config, PAYLOAD_SIZE(cvra::StringID));
+    stream_init(&current_pid_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::CurrentPID));
+    stream_init(&velocity_pid_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::VelocityPID));
+    stream_init(&position_pid_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::PositionPID));
+    stream_init(&index_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::Index));
+    stream_init(&motor_enc_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::MotorEncoderPosition));
+    stream_init(&motor_pos_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::MotorPosition));
+    stream_init(&motor_torque_stream_config, PAYLOAD_SIZE(cvra::motor::feedback::MotorTorque));
+    stream_init(&loop_timing_stream_config, PAYLOAD_SIZE(cvra::ControlLoopTiming));
+    stream_init(&motor_state_stream_config, PAYLOAD_SIZE(cvra::MotorState));
+    stream_init(&comm_status_stream_config, PAYLOAD_SIZE(cvra::CommStatus));
+    stream_init(&thread_stats_stream_config, PAYLOAD_SIZE(cvra::ThreadStats));
+    for (int i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+        stream_init(&aggregate_streams[i].stream, PAYLOAD_SIZE(cvra::SignalAggregate));
+    }
+    stream_scheduler_init(&telemetry, telemetry_streams,
+                          sizeof(telemetry_streams) / sizeof(telemetry_streams[0]),
+                          1000000, TELEMETRY_FRAME_BUDGET);
+
+    stream_set_frequency(&telemetry, &string_id_stream_config, 0.5);
+    stream_enable(&telemetry, &string_id_stream_config, true);
+    stream_set_frequency(&telemetry, &loop_timing_stream_config, LOOP_TIMING_STREAM_FREQUENCY);
+    stream_enable(&telemetry, &loop_timing_stream_config, true);
+}
+
+static void telemetry_update_parameters(void)
+{
+    if (parameter_changed(&param_state_frequency)) {
+        float frequency = parameter_scalar_get(&param_state_frequency);
+        stream_set_frequency(&telemetry, &motor_state_stream_config, frequency);
+        stream_enable(&telemetry, &motor_state_stream_config, frequency > 0);
+    }
+    if (parameter_changed(&param_comm_status_frequency)) {
+        float frequency = parameter_scalar_get(&param_comm_status_frequency);
+        stream_set_frequency(&telemetry, &comm_status_stream_config, frequency);
+        stream_enable(&telemetry, &comm_status_stream_config, frequency > 0);
+    }
+    if (parameter_changed(&param_thread_stats_frequency)) {
+        float frequency = parameter_scalar_get(&param_thread_stats_frequency);
+        stream_set_frequency(&telemetry, &thread_stats_stream_config, frequency);
+        stream_enable(&telemetry, &thread_stats_stream_config, frequency > 0);
+    }
+    for (auto &d : deadband_streams) {
+        if (parameter_namespace_contains_changed(&d.ns)) {
+            stream_set_deadband(&telemetry, d.stream,
+                                parameter_scalar_get(&d.deadband),
+                                parameter_scalar_get(&d.max_interval));
+        }
+    }
+    for (int i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+        if (!parameter_namespace_contains_changed(&aggregate_streams[i].ns)) {
+            continue;
+        }
+        int signal = parameter_scalar_get(&aggregate_streams[i].signal);
+        float frequency = parameter_scalar_get(&aggregate_streams[i].frequency);
+        control_aggregate_select(i, signal);
+        stream_set_frequency(&telemetry, &aggregate_streams[i].stream, frequency);
+        stream_enable(&telemetry, &aggregate_streams[i].stream,
+                      signal >= 0 && signal < CONTROL_NB_SIGNALS && frequency > 0);
     }
 }
 
@@ -82,17 +438,700 @@ void uavcan_failure(const char *reason)
     chSysHalt(reason);
 }
 
-static THD_WORKING_AREA(uavcan_node_wa, 8000);
+// samples the UAVCAN UTC clock between two local timestamps
+static void network_time_update(void)
+{
+    timestamp_t before = timestamp_get();
+    uint64_t utc = uavcan_stm32::clock::getUtc().toUSec();
+    timestamp_t after = timestamp_get();
+    time_sync_update(&network_time, utc, before + (after - before) / 2);
+    chSysLock();
+    telemetry_network_time = network_time;
+    chSysUnlock();
+}
+
+// cycle counter at a frame reception timestamp, includes the RX queue delay
+static uint32_t rx_cycles_from_monotonic(uavcan::MonotonicTime rx_time)
+{
+    uint32_t now = cycle_counter_get();
+    uint64_t rx_usec = rx_time.toUSec();
+    uint64_t usec_now = uavcan_stm32::clock::getMonotonic().toUSec();
+    if (rx_usec == 0 || rx_usec > usec_now || usec_now - rx_usec > 1000000) {
+        return now;
+    }
+    return now - (uint32_t)(usec_now - rx_usec) * (STM32_SYSCLK / 1000000);
+}
+
+/*
+ * Setpoint fast path: single frame setpoint messages (Position, Velocity and
+ * Torque) are decoded in the CAN RX interrupt and go straight to the control
+ * loop, instead of waiting in the RX queue for the node thread. Everything
+ * else, including multi frame transfers like Trajectory, goes through
+ * libuavcan.
+ */
+#define CAN_ID_SERVICE_NOT_MESSAGE  (1 << 7)
+#define CAN_ID_SOURCE_MASK          0x7f
+#define CAN_ID_DESTINATION(id)      (((id) >> 8) & 0x7f)    // service frames
+#define TAIL_START_END_MASK         0xc0    // start and end of transfer bits
+
+template <typename T>
+static bool decode_single_frame(const uavcan::CanFrame& frame, T& msg)
+{
+    if (T::MaxBitLen > (uavcan::CanFrame::MaxDataLen - 1) * 8) {
+        return false;
+    }
+    uavcan::StaticTransferBuffer<uavcan::CanFrame::MaxDataLen> buf;
+    buf.write(0, frame.data, frame.dlc - 1);
+    uavcan::BitStream bitstream(buf);
+    uavcan::ScalarCodec codec(bitstream);
+    return T::decode(msg, codec) >= 0;
+}
+
+static bool setpoint_fast_path(const uavcan::CanFrame& frame)
+{
+    if (!frame.isExtended() || frame.isRemoteTransmissionRequest() || frame.isErrorFrame()
+        || frame.dlc < 1) {
+        return false;
+    }
+    uint32_t id = frame.id & uavcan::CanFrame::MaskExtID;
+    if ((id & CAN_ID_SERVICE_NOT_MESSAGE) || (id & CAN_ID_SOURCE_MASK) == 0) {
+        return false;
+    }
+    if ((frame.data[frame.dlc - 1] & TAIL_START_END_MASK) != TAIL_START_END_MASK) {
+        return false;
+    }
+
+    struct command_s cmd = {};
+    cmd.rx_cycles = cycle_counter_get();
+    uint16_t data_type_id = (id >> 8) & 0xffff;
+    if (data_type_id == cvra::motor::control::Velocity::DefaultDataTypeID) {
+        cvra::motor::control::Velocity msg;
+        if (!decode_single_frame(frame, msg)) {
+            return false;
+        }
+        cmd.mode = COMMAND_VELOCITY;
+        cmd.velocity = msg.velocity;
+    } else if (data_type_id == cvra::motor::control::Position::DefaultDataTypeID) {
+        cvra::motor::control::Position msg;
+        if (!decode_single_frame(frame, msg)) {
+            return false;
+        }
+        cmd.mode = COMMAND_POSITION;
+        cmd.position = msg.position;
+    } else if (data_type_id == cvra::motor::control::Torque::DefaultDataTypeID) {
+        cvra::motor::control::Torque msg;
+        if (!decode_single_frame(frame, msg)) {
+            return false;
+        }
+        cmd.mode = COMMAND_TORQUE;
+        cmd.torque = msg.torque;
+    } else {
+        return false;
+    }
+
+    chSysLockFromISR();
+    control_update_setpoint_i(&cmd);
+    chSysUnlockFromISR();
+    return true;
+}
+
+// same acceptance as libuavcan, the hardware filters may let more through
+static bool frame_is_for_us(const uavcan::CanFrame& frame)
+{
+    unsigned nb_types = nb_subscribed_types;
+    if (nb_types == 0) {
+        return true;
+    }
+    if (!frame.isExtended() || frame.isErrorFrame()) {
+        return false;
+    }
+    uint32_t id = frame.id & uavcan::CanFrame::MaskExtID;
+    if (id & CAN_ID_SERVICE_NOT_MESSAGE) {
+        return CAN_ID_DESTINATION(id) == own_node_id;
+    }
+    if ((id & CAN_ID_SOURCE_MASK) == 0) {
+        return true;    // anonymous, the type ID is truncated
+    }
+    uint16_t data_type_id = (id >> 8) & 0xffff;
+    for (unsigned i = 0; i < nb_types; i++) {
+        if (subscribed_types[i] == data_type_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// called by the CAN RX interrupt for every frame
+static bool can_rx_handler(const uavcan::CanFrame& frame, uavcan::uint64_t utc_usec)
+{
+    (void)utc_usec;
+    if (rx_fast_path_enabled && setpoint_fast_path(frame)) {
+        rx_fast_path_count++;
+        return true;
+    }
+    if (!frame_is_for_us(frame)) {
+        rx_software_reject_count++;
+        return true;
+    }
+    // the frame is queued for libuavcan, wake up the RX thread
+    chSysLockFromISR();
+    chEvtSignalI(rx_thread, UAVCAN_RX_EVENT);
+    chSysUnlockFromISR();
+    return false;
+}
+
+static void subscribed_types_update(Node& node)
+{
+    unsigned n = 0;
+    const uavcan::TransferListener *l = node.getDispatcher().getListOfMessageListeners().get();
+    for (; l != NULL; l = l->getNextListNode()) {
+        if (n == UAVCAN_MAX_SUBSCRIPTIONS) {
+            n = 0;      // table too small, accept everything
+            break;
+        }
+        subscribed_types[n++] = l->getDataTypeDescriptor().getID().get();
+    }
+    own_node_id = node.getNodeID().get();
+    nb_subscribed_types = n;
+}
+
+// called with the node lock held
+static void rx_filter_update_parameters(Node& node)
+{
+    if (parameter_changed(&param_rx_fast_path)) {
+        rx_fast_path_enabled = parameter_scalar_get(&param_rx_fast_path) != 0;
+    }
+    if (parameter_changed(&param_hw_filters)) {
+        int res = 0;
+        if (parameter_scalar_get(&param_hw_filters) != 0) {
+            // merges the subscriptions into the available filter banks
+            res = uavcan::configureCanAcceptanceFilters(node);
+        } else {
+            uavcan::ICanDriver& driver = can.driver;
+            for (int i = 0; i < driver.getNumIfaces(); i++) {
+                if (driver.getIface(i)->configureFilters(NULL, 0) < 0) {
+                    res = -1;
+                }
+            }
+        }
+        if (res < 0) {
+            node.setStatusWarning();
+        }
+    }
+}
+
+extern "C"
+void uavcan_node_get_rx_stats(struct uavcan_rx_stats_s *stats)
+{
+    stats->frames = 0;
+    for (int i = 0; i < can.driver.getNumIfaces(); i++) {
+        stats->frames += can.driver.getIface(i)->getRxFrameCount();
+    }
+    stats->fast_path = rx_fast_path_count;
+    stats->software_rejects = rx_software_reject_count;
+}
+
+static unsigned tx_stream_find(const uavcan::CanFrame& frame)
+{
+    uint32_t id = frame.id & uavcan::CanFrame::MaskExtID;
+    if (frame.isExtended() && !(id & CAN_ID_SERVICE_NOT_MESSAGE)) {
+        uint16_t data_type_id = (id >> 8) & 0xffff;
+        for (unsigned i = 0; i < TX_STREAM_OTHER; i++) {
+            if (tx_streams[i].data_type_id == data_type_id) {
+                return i;
+            }
+        }
+    }
+    return TX_STREAM_OTHER;
+}
+
+// called by the CAN driver from a critical section
+static bool tx_coalesce_predicate(const uavcan::CanFrame& frame)
+{
+    if (frame.dlc < 1 || (frame.data[frame.dlc - 1] & TAIL_START_END_MASK) != TAIL_START_END_MASK) {
+        return false;   // only single frame transfers can be replaced
+    }
+    return tx_streams[tx_stream_find(frame)].coalesce;
+}
+
+static void tx_drop_handler(const uavcan::CanFrame& frame, uavcan_stm32::TxDropReason reason)
+{
+    unsigned i = tx_stream_find(frame);
+    if (reason == uavcan_stm32::TxDropReplaced) {
+        tx_streams[i].replaced++;
+    } else {
+        tx_streams[i].expired++;
+    }
+}
+
+extern "C"
+bool uavcan_node_get_tx_stats(unsigned i, struct uavcan_tx_stats_s *stats)
+{
+    if (i >= sizeof(tx_streams) / sizeof(tx_streams[0])) {
+        return false;
+    }
+    stats->name = tx_streams[i].name;
+    stats->expired = tx_streams[i].expired;
+    stats->replaced = tx_streams[i].replaced;
+    return true;
+}
+
+// transfers per second, updated by the telemetry thread
+static struct {
+    timestamp_t last_update;
+    uint64_t last_rx;
+    uint64_t last_tx;
+    float rx_per_s;
+    float tx_per_s;
+} transfer_rates;
+
+// called with the node lock held
+static void transfer_rates_update(Node& node, timestamp_t now)
+{
+    const uint32_t period = 1000000;    // [us]
+    if (now - transfer_rates.last_update < period) {
+        return;
+    }
+    const uavcan::TransferPerfCounter& perf = node.getDispatcher().getTransferPerfCounter();
+    float dt = (now - transfer_rates.last_update) * 1e-6f;
+    transfer_rates.rx_per_s = (perf.getRxTransferCount() - transfer_rates.last_rx) / dt;
+    transfer_rates.tx_per_s = (perf.getTxTransferCount() - transfer_rates.last_tx) / dt;
+    transfer_rates.last_rx = perf.getRxTransferCount();
+    transfer_rates.last_tx = perf.getTxTransferCount();
+    transfer_rates.last_update = now;
+}
+
+// called with the node lock held
+static bool comm_stats_get(Node& node, unsigned iface, struct uavcan_comm_stats_s *stats)
+{
+    if (iface >= can.driver.getNumIfaces()) {
+        return false;
+    }
+    const auto& pool = node.getAllocator();
+    stats->pool_used = pool.getNumUsedBlocks();
+    stats->pool_capacity = stats->pool_used + pool.getNumFreeBlocks();
+    stats->pool_peak = pool.getPeakNumUsedBlocks();
+
+    uavcan_stm32::CanIfaceStatus status = can.driver.getIface(iface)->getStatus();
+    stats->rx_queue_capacity = status.rx_queue_capacity;
+    stats->rx_queue_peak = status.rx_queue_peak;
+    stats->rx_queue_overflows = status.rx_queue_overflows;
+    stats->tx_mailboxes_peak = status.tx_mailboxes_peak;
+    stats->tx_mailboxes_full = status.tx_mailboxes_full;
+    stats->errors = status.errors;
+    stats->bus_off = status.bus_off;
+    stats->tx_error_counter = status.tx_error_counter;
+    stats->rx_error_counter = status.rx_error_counter;
+
+    stats->rx_transfers_per_s = transfer_rates.rx_per_s;
+    stats->tx_transfers_per_s = transfer_rates.tx_per_s;
+    stats->transfer_errors = node.getDispatcher().getTransferPerfCounter().getErrorCount();
+    return true;
+}
+
+extern "C"
+bool uavcan_node_get_comm_stats(unsigned iface, struct uavcan_comm_stats_s *stats)
+{
+    if (!node_.isConstructed()) {
+        return false;
+    }
+    node_mutex.lock();
+    bool ok = comm_stats_get(*node_, iface, stats);
+    node_mutex.unlock();
+    return ok;
+}
+
+static float stream_period(const stream_config_t *stream_config)
+{
+    float frequency = stream_get_frequency(&telemetry, stream_config);
+    return frequency > 0 ? 1 / frequency : 0;
+}
+
+/* Broadcasts msg with a TX deadline of period [s], when the next message of
+ * the same stream replaces it. The driver and libuavcan drop it afterwards
+ * instead of sending stale values. The node is locked for the broadcast only,
+ * so the RX thread waits at most for one message to be serialized. */
+template <typename T>
+static void broadcast_stale_after(uavcan::Publisher<T>& pub, const T& msg, float period)
+{
+    if (period > 0) {
+        float timeout = period * 1e6f;
+        if (timeout > TELEMETRY_MAX_TX_TIMEOUT) {
+            timeout = TELEMETRY_MAX_TX_TIMEOUT;
+        }
+        pub.setTxTimeout(uavcan::MonotonicDuration::fromUSec(timeout));
+    }
+    node_mutex.lock();
+    pub.broadcast(msg);
+    node_mutex.unlock();
+}
+
+static THD_WORKING_AREA(telemetry_wa, TELEMETRY_STACKSIZE);
+static THD_FUNCTION(telemetry_thread, arg)
+{
+    struct uavcan_node_arg *node_arg;
+    node_arg = (struct uavcan_node_arg *)arg;
+
+    chRegSetThreadName("uavcan telemetry");
+
+    Node& node = get_node();
+    node_mutex.lock();
+
+    /* Publishers */
+    uavcan::Publisher<cvra::StringID> string_id_pub(node);
+    const int string_id_pub_init_res = string_id_pub.init();
+    if (string_id_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::StringID publisher");
+    }
+
+    uavcan::Publisher<cvra::ControlLoopTiming> loop_timing_pub(node);
+    const int loop_timing_pub_init_res = loop_timing_pub.init();
+    if (loop_timing_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::ControlLoopTiming publisher");
+    }
+    int loop_timing_stage = 0;
+
+    uavcan::Publisher<cvra::SignalAggregate> aggregate_pub(node);
+    const int aggregate_pub_init_res = aggregate_pub.init();
+    if (aggregate_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::SignalAggregate publisher");
+    }
+
+    uavcan::Publisher<cvra::CommStatus> comm_status_pub(node);
+    const int comm_status_pub_init_res = comm_status_pub.init();
+    if (comm_status_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::CommStatus publisher");
+    }
+
+    uavcan::Publisher<cvra::ThreadStats> thread_stats_pub(node);
+    const int thread_stats_pub_init_res = thread_stats_pub.init();
+    if (thread_stats_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::ThreadStats publisher");
+    }
+    unsigned thread_stats_index = 0;
+
+    uavcan::Publisher<cvra::MotorState> motor_state_pub(node);
+    const int motor_state_pub_init_res = motor_state_pub.init();
+    if (motor_state_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::MotorState publisher");
+    }
+
+    uavcan::Publisher<cvra::TelemetryBatch> batch_pub(node);
+    const int batch_pub_init_res = batch_pub.init();
+    if (batch_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::TelemetryBatch publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::CurrentPID> current_pid_pub(node);
+    const int current_pid_pub_init_res = current_pid_pub.init();
+    if (current_pid_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::CurrentPID publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::VelocityPID> velocity_pid_pub(node);
+    const int velocity_pid_pub_init_res = velocity_pid_pub.init();
+    if (velocity_pid_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::VelocityPID publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::PositionPID> position_pid_pub(node);
+    const int position_pid_pub_init_res = position_pid_pub.init();
+    if (position_pid_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::PositionPID publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::Index> index_pub(node);
+    const int index_pub_init_res = index_pub.init();
+    if (index_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::Index publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::MotorEncoderPosition> enc_pos_pub(node);
+    const int enc_pos_pub_init_res = enc_pos_pub.init();
+    if (enc_pos_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::MotorEncoderPosition publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::MotorPosition> motor_pos_pub(node);
+    const int motor_pos_pub_init_res = motor_pos_pub.init();
+    if (motor_pos_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::MotorPosition publisher");
+    }
+
+    uavcan::Publisher<cvra::motor::feedback::MotorTorque> motor_torque_pub(node);
+    const int motor_torque_pub_init_res = motor_torque_pub.init();
+    if (motor_torque_pub_init_res < 0)
+    {
+        uavcan_failure("cvra::motor::feedback::MotorTorque publisher");
+    }
+
+    node_mutex.unlock();
+
+    event_listener_t control_tick_listener;
+    chEvtRegisterMask(&control_tick_event, &control_tick_listener, TELEMETRY_TICK_EVENT);
+    timestamp_t last_tick = timestamp_get();
+
+    while (true) {
+        // streams are sent right after a control cycle, with fresh values
+        chEvtWaitAnyTimeout(TELEMETRY_TICK_EVENT, MS2ST(TELEMETRY_IDLE_PERIOD));
+        uint32_t start = cycle_counter_get();
+
+        timestamp_t now = timestamp_get();
+        stream_scheduler_tick(&telemetry, now - last_tick);
+        last_tick = now;
+
+        feedback_stream_apply_requests();
+        telemetry_update_parameters();
+        // batches are sent when full, their frames are taken off the budget
+        batch_apply_requests(node);
+        batch_update_cycle_period(node);
+        stream_scheduler_reserve(&telemetry, batch_frame_rate_total());
+
+        chSysLock();
+        time_sync_t net_time = telemetry_network_time;
+        bool net_time_valid = network_time_active && time_sync_is_valid(&net_time);
+        chSysUnlock();
+
+        /* Streams, all values of the same control cycle */
+        struct control_state_s state;
+        control_get_state(&state);
+
+        if (stream_update_value(&motor_state_stream_config, state.position)) {
+            cvra::MotorState msg;
+            if (net_time_valid) {
+                msg.timestamp.usec = time_sync_to_network(&net_time, state.timestamp);
+            }
+            msg.time_us = state.timestamp;
+            msg.cycle = state.cycle;
+            msg.position = state.position;
+            msg.position_setpoint = state.position_setpoint;
+            msg.velocity = state.velocity;
+            msg.velocity_setpoint = state.velocity_setpoint;
+            msg.torque = state.torque;
+            msg.current = state.current;
+            msg.current_setpoint = state.current_setpoint;
+            msg.motor_voltage = state.motor_voltage;
+            broadcast_stale_after(motor_state_pub, msg, stream_period(&motor_state_stream_config));
+        }
+
+        for (int i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+            // the control loop ends the interval at its next cycle
+            if (stream_update(&aggregate_streams[i].stream)) {
+                control_aggregate_request(i);
+            }
+            struct signal_aggregate_s aggregate;
+            int signal;
+            timestamp_t end;
+            if (!control_aggregate_get(i, &aggregate, &signal, &end)) {
+                continue;
+            }
+            cvra::SignalAggregate msg;
+            if (net_time_valid) {
+                msg.timestamp.usec = time_sync_to_network(&net_time, end);
+            }
+            msg.channel = i;
+            msg.signal = signal;
+            msg.count = aggregate.count < 0xffff ? aggregate.count : 0xffff;
+            msg.min = aggregate.min;
+            msg.max = aggregate.max;
+            msg.mean = signal_aggregate_mean(&aggregate);
+            broadcast_stale_after(aggregate_pub, msg, stream_period(&aggregate_streams[i].stream));
+        }
+
+        if (stream_update_value(&current_pid_stream_config, state.current)) {
+            cvra::motor::feedback::CurrentPID current_pid;
+            current_pid.current = state.current;
+            current_pid.current_setpoint = state.current_setpoint;
+            current_pid.motor_voltage = state.motor_voltage;
+            broadcast_stale_after(current_pid_pub, current_pid, stream_period(&current_pid_stream_config));
+        }
+
+        if (stream_update_value(&velocity_pid_stream_config, state.velocity)) {
+            cvra::motor::feedback::VelocityPID velocity_pid;
+            velocity_pid.velocity = state.velocity;
+            velocity_pid.velocity_setpoint = state.velocity_setpoint;
+            broadcast_stale_after(velocity_pid_pub, velocity_pid, stream_period(&velocity_pid_stream_config));
+        }
+
+        if (stream_update_value(&position_pid_stream_config, state.position)) {
+            cvra::motor::feedback::PositionPID position_pid;
+            position_pid.position = state.position;
+            position_pid.position_setpoint = state.position_setpoint;
+            broadcast_stale_after(position_pid_pub, position_pid, stream_period(&position_pid_stream_config));
+        }
+
+        uint32_t raw_encoder_position = encoder_get_secondary();
+        if (stream_update_count(&motor_enc_stream_config, raw_encoder_position)) {
+            cvra::motor::feedback::MotorEncoderPosition enc_pos;
+            enc_pos.raw_encoder_position = raw_encoder_position;
+            broadcast_stale_after(enc_pos_pub, enc_pos, stream_period(&motor_enc_stream_config));
+        }
+
+        if (stream_update(&index_stream_config)) {
+            cvra::motor::feedback::Index index;
+            index.position = index_get_position();
+            broadcast_stale_after(index_pub, index, stream_period(&index_stream_config));
+        }
+
+        if (stream_update_value(&motor_pos_stream_config, state.position)) {
+            cvra::motor::feedback::MotorPosition motor_pos;
+            motor_pos.position = state.position;
+            motor_pos.velocity = state.velocity;
+            broadcast_stale_after(motor_pos_pub, motor_pos, stream_period(&motor_pos_stream_config));
+        }
+
+        if (stream_update_value(&motor_torque_stream_config, state.torque)) {
+            cvra::motor::feedback::MotorTorque motor_torque;
+            motor_torque.torque = state.torque;
+            motor_torque.position = state.position;
+            broadcast_stale_after(motor_torque_pub, motor_torque, stream_period(&motor_torque_stream_config));
+        }
+
+        if (stream_update(&string_id_stream_config)) {
+            cvra::StringID string_id;
+            string_id.id = node_arg->node_name;
+            broadcast_stale_after(string_id_pub, string_id, stream_period(&string_id_stream_config));
+        }
+
+        if (stream_update(&loop_timing_stream_config)) {
+            // one stage per message, round robin
+            cycle_stats_t stats;
+            control_get_timing_stats((enum control_timing_stage)loop_timing_stage, &stats);
+            cvra::ControlLoopTiming timing;
+            timing.stage = loop_timing_stage;
+            timing.cpu_frequency = STM32_SYSCLK;
+            timing.count = stats.count;
+            timing.min = stats.count > 0 ? stats.min : 0;
+            timing.max = stats.max;
+            timing.mean = cycle_stats_mean(&stats);
+            for (int i = 0; i < CYCLE_STATS_NB_BUCKETS; i++) {
+                timing.histogram.push_back(stats.histogram[i] < 0xffff ? stats.histogram[i] : 0xffff);
+            }
+            broadcast_stale_after(loop_timing_pub, timing, stream_period(&loop_timing_stream_config));
+            loop_timing_stage = (loop_timing_stage + 1) % CONTROL_TIMING_NB_STAGES;
+        }
+
+        node_mutex.lock();
+        transfer_rates_update(node, now);
+        node_mutex.unlock();
+        if (stream_update(&comm_status_stream_config)) {
+            struct uavcan_comm_stats_s stats;
+            for (unsigned iface = 0; uavcan_node_get_comm_stats(iface, &stats); iface++) {
+                cvra::CommStatus msg;
+                msg.iface = iface;
+                msg.pool_capacity = stats.pool_capacity;
+                msg.pool_used = stats.pool_used;
+                msg.pool_peak = stats.pool_peak;
+                msg.rx_queue_capacity = stats.rx_queue_capacity;
+                msg.rx_queue_peak = stats.rx_queue_peak;
+                msg.rx_queue_overflows = stats.rx_queue_overflows;
+                msg.tx_mailboxes_peak = stats.tx_mailboxes_peak;
+                msg.tx_mailboxes_full = stats.tx_mailboxes_full;
+                msg.errors = stats.errors;
+                msg.bus_off = stats.bus_off;
+                msg.tx_error_counter = stats.tx_error_counter;
+                msg.rx_error_counter = stats.rx_error_counter;
+                msg.rx_transfers_per_s = stats.rx_transfers_per_s;
+                msg.tx_transfers_per_s = stats.tx_transfers_per_s;
+                msg.transfer_errors = stats.transfer_errors;
+                broadcast_stale_after(comm_status_pub, msg, stream_period(&comm_status_stream_config));
+            }
+        }
+
+        if (stream_update(&thread_stats_stream_config)) {
+            // walk the whole registry so that no thread reference is kept
+            struct thread_stats_s stats;
+            unsigned nb_threads = 0;
+            thread_t *tp = chRegFirstThread();
+            while (tp != NULL) {
+                if (nb_threads == thread_stats_index || nb_threads == 0) {
+                    thread_stats_get(tp, &stats);
+                }
+                nb_threads++;
+                tp = chRegNextThread(tp);
+            }
+            if (thread_stats_index >= nb_threads) {
+                thread_stats_index = 0;
+            }
+            cvra::ThreadStats msg;
+            for (const char *c = stats.name; c != NULL && *c != '\0'
+                 && msg.name.size() < msg.name.capacity(); c++) {
+                msg.name.push_back(*c);
+            }
+            msg.cpu_load = stats.cpu_load;
+            msg.stack_free = stats.stack_free < 0xffff ? stats.stack_free : 0xffff;
+            msg.irq_load = thread_stats_irq_load();
+            broadcast_stale_after(thread_stats_pub, msg, stream_period(&thread_stats_stream_config));
+            thread_stats_index++;
+        }
+
+        /* Batched telemetry, sent when full */
+        for (unsigned channel = 0; channel < CONTROL_BATCH_NB_CHANNELS; channel++) {
+            telemetry_batch_channel_t *c = control_batch_channel(channel);
+            const telemetry_batch_t *batch = telemetry_batch_get(c);
+            if (batch == NULL) {
+                continue;
+            }
+            static struct telemetry_batch_packed_s packed;
+            telemetry_batch_pack(batch, &packed);
+
+            cvra::TelemetryBatch msg;
+            if (net_time_valid) {
+                msg.timestamp.usec = time_sync_to_network(&net_time, batch->timestamp);
+            }
+            msg.time_us = batch->timestamp;
+            msg.signal = batch->signal;
+            msg.sample_period = batch->sample_period;
+            telemetry_batch_release(c);
+
+            msg.channel = channel;
+            msg.base = packed.base;
+            msg.scale = packed.scale;
+            for (int i = 0; i < TELEMETRY_BATCH_SIZE - 1; i++) {
+                msg.deltas.push_back(packed.deltas[i]);
+            }
+            // stale once the next batch of the channel is full
+            broadcast_stale_after(batch_pub, msg, msg.sample_period * TELEMETRY_BATCH_SIZE);
+        }
+
+        control_timing_probe(CONTROL_TIMING_TELEMETRY, start);
+    }
+    return 0;
+}
+
+static void telemetry_start(struct uavcan_node_arg *node_arg)
+{
+    chThdCreateStatic(telemetry_wa, sizeof(telemetry_wa), TELEMETRY_PRIO, telemetry_thread, node_arg);
+}
+
+static THD_WORKING_AREA(uavcan_node_wa, UAVCAN_RX_STACKSIZE);
 static THD_FUNCTION(uavcan_node, arg)
 {
     struct uavcan_node_arg *node_arg;
     node_arg = (struct uavcan_node_arg *)arg;
 
-    chRegSetThreadName("uavcan node");
+    chRegSetThreadName("uavcan rx");
 
     if (can.init(CAN_BITRATE) != 0) {
         uavcan_failure("CAN driver");
     }
+    rx_thread = chThdGetSelfX();
+    uavcan_stm32::setRxFastPathHandler(can_rx_handler);
+    uavcan_stm32::setTxDropHandler(tx_drop_handler);
+    uavcan_stm32::setTxCoalescePredicate(tx_coalesce_predicate);
 
     Node& node = get_node();
 
@@ -103,8 +1142,15 @@ static THD_FUNCTION(uavcan_node, arg)
         uavcan_failure("UAVCAN node start");
     }
 
-    stream_set_prescaler(&string_id_stream_config, 0.5, UAVCAN_SPIN_FREQUENCY);
-    stream_enable(&string_id_stream_config, true);
+    // adjusts the UAVCAN UTC clock to the time sync master
+    uavcan::GlobalTimeSyncSlave time_sync_slave(node);
+    if (time_sync_slave.start() < 0) {
+        uavcan_failure("UAVCAN time sync slave");
+    }
+    time_sync_init(&network_time);
+    network_time_update();
+
+    telemetry_init();
 
     /* Subscribers */
     uavcan::Subscriber<cvra::Reboot> reboot_sub(node);
@@ -133,22 +1179,89 @@ static THD_FUNCTION(uavcan_node, arg)
         [&](const uavcan::ReceivedDataStructure<cvra::motor::control::Trajectory>& msg)
         {
             timestamp_t timestamp = timestamp_get();
-            control_update_trajectory_setpoint(msg.position,
-                                               msg.velocity,
-                                               msg.acceleration,
-                                               msg.torque,
-                                               timestamp);
+            // reception time from the CAN interrupt, once the clock is set
+            uint64_t rx_time = msg.getUtcTimestamp().toUSec();
+            if (rx_time != 0 && time_sync_is_valid(&network_time)) {
+                timestamp = time_sync_to_local(&network_time, rx_time);
+            }
+            struct command_s cmd = {};
+            cmd.mode = COMMAND_TRAJECTORY;
+            cmd.position = msg.position;
+            cmd.velocity = msg.velocity;
+            cmd.acceleration = msg.acceleration;
+            cmd.torque = msg.torque;
+            cmd.timestamp = timestamp;
+            cmd.rx_cycles = rx_cycles_from_monotonic(msg.getMonotonicTimestamp());
+            control_update_setpoint(&cmd);
         }
     );
     if (ret != 0) {
         uavcan_failure("cvra::motor::control::Trajectory subscriber");
     }
 
+    uavcan::Subscriber<cvra::TrajectoryPoint> traj_point_sub(node);
+    ret = traj_point_sub.start(
+        [&](const uavcan::ReceivedDataStructure<cvra::TrajectoryPoint>& msg)
+        {
+            bool queued;
+            if (msg.timestamp.usec != 0) {
+                if (!time_sync_slave.isActive() || !time_sync_is_valid(&network_time)) {
+                    node.setStatusWarning();
+                    return;
+                }
+                timestamp_t time = time_sync_to_local(&network_time, msg.timestamp.usec);
+                queued = control_queue_trajectory_point_at(time,
+                                                           msg.position,
+                                                           msg.velocity,
+                                                           msg.acceleration,
+                                                           msg.torque);
+            } else {
+                queued = control_queue_trajectory_point(msg.time_us,
+                                                        msg.position,
+                                                        msg.velocity,
+                                                        msg.acceleration,
+                                                        msg.torque,
+                                                        msg.start);
+            }
+            if (!queued) {
+                node.setStatusWarning();
+            }
+        }
+    );
+    if (ret != 0) {
+        uavcan_failure("cvra::TrajectoryPoint subscriber");
+    }
+
+    uavcan::Subscriber<cvra::TelemetryBatchConfig> batch_config_sub(node);
+    ret = batch_config_sub.start(
+        [&](const uavcan::ReceivedDataStructure<cvra::TelemetryBatchConfig>& msg)
+        {
+            if (msg.channel >= CONTROL_BATCH_NB_CHANNELS || msg.divider == 0) {
+                node.setStatusWarning();
+                return;
+            }
+            // the budget is checked by the telemetry thread, which owns it
+            chSysLock();
+            batch_request_shadow[msg.channel].enabled = msg.enabled;
+            batch_request_shadow[msg.channel].signal = (enum control_signal)msg.signal;
+            batch_request_shadow[msg.channel].divider = msg.divider;
+            batch_request_pending[msg.channel] = true;
+            chSysUnlock();
+        }
+    );
+    if (ret != 0) {
+        uavcan_failure("cvra::TelemetryBatchConfig subscriber");
+    }
+
     uavcan::Subscriber<cvra::motor::control::Velocity> vel_ctrl_sub(node);
     ret = vel_ctrl_sub.start(
         [&](const uavcan::ReceivedDataStructure<cvra::motor::control::Velocity>& msg)
         {
-            control_update_velocity_setpoint(msg.velocity);
+            struct command_s cmd = {};
+            cmd.mode = COMMAND_VELOCITY;
+            cmd.velocity = msg.velocity;
+            cmd.rx_cycles = rx_cycles_from_monotonic(msg.getMonotonicTimestamp());
+            control_update_setpoint(&cmd);
         }
     );
     if (ret != 0) {
@@ -159,7 +1272,11 @@ static THD_FUNCTION(uavcan_node, arg)
     ret = pos_ctrl_sub.start(
         [&](const uavcan::ReceivedDataStructure<cvra::motor::control::Position>& msg)
         {
-            control_update_position_setpoint(msg.position);
+            struct command_s cmd = {};
+            cmd.mode = COMMAND_POSITION;
+            cmd.position = msg.position;
+            cmd.rx_cycles = rx_cycles_from_monotonic(msg.getMonotonicTimestamp());
+            control_update_setpoint(&cmd);
         }
     );
     if (ret != 0) {
@@ -170,7 +1287,11 @@ static THD_FUNCTION(uavcan_node, arg)
     ret = torque_ctrl_sub.start(
         [&](const uavcan::ReceivedDataStructure<cvra::motor::control::Torque>& msg)
         {
-            control_update_torque_setpoint(msg.torque);
+            struct command_s cmd = {};
+            cmd.mode = COMMAND_TORQUE;
+            cmd.torque = msg.torque;
+            cmd.rx_cycles = rx_cycles_from_monotonic(msg.getMonotonicTimestamp());
+            control_update_setpoint(&cmd);
         }
     );
     if (ret != 0) {
@@ -195,31 +1316,31 @@ static THD_FUNCTION(uavcan_node, arg)
         {
             switch (msg.stream) {
                 case cvra::motor::config::FeedbackStream::STREAM_CURRENT_PID : {
-                    stream_init_from_callback(&current_pid_stream_config, msg);
+                    feedback_stream_request(&current_pid_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_VELOCITY_PID : {
-                    stream_init_from_callback(&velocity_pid_stream_config, msg);
+                    feedback_stream_request(&velocity_pid_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_POSITION_PID : {
-                    stream_init_from_callback(&position_pid_stream_config, msg);
+                    feedback_stream_request(&position_pid_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_INDEX : {
-                    stream_init_from_callback(&index_stream_config, msg);
+                    feedback_stream_request(&index_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_MOTOR_ENCODER : {
-                    stream_init_from_callback(&motor_enc_stream_config, msg);
+                    feedback_stream_request(&motor_enc_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_MOTOR_POSITION : {
-                    stream_init_from_callback(&motor_pos_stream_config, msg);
+                    feedback_stream_request(&motor_pos_stream_config, msg);
                     break;
                 }
                 case cvra::motor::config::FeedbackStream::STREAM_MOTOR_TORQUE : {
-                    stream_init_from_callback(&motor_torque_stream_config, msg);
+                    feedback_stream_request(&motor_torque_stream_config, msg);
                     break;
                 }
             }
@@ -229,130 +1350,71 @@ static THD_FUNCTION(uavcan_node, arg)
         uavcan_failure("cvra::motor::config::FeedbackStream subscriber");
     }
 
-    /* Publishers */
-    uavcan::Publisher<cvra::StringID> string_id_pub(node);
-    const int string_id_pub_init_res = string_id_pub.init();
-    if (string_id_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::StringID publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::CurrentPID> current_pid_pub(node);
-    const int current_pid_pub_init_res = current_pid_pub.init();
-    if (current_pid_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::CurrentPID publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::VelocityPID> velocity_pid_pub(node);
-    const int velocity_pid_pub_init_res = velocity_pid_pub.init();
-    if (velocity_pid_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::VelocityPID publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::PositionPID> position_pid_pub(node);
-    const int position_pid_pub_init_res = position_pid_pub.init();
-    if (position_pid_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::PositionPID publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::Index> index_pub(node);
-    const int index_pub_init_res = index_pub.init();
-    if (index_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::Index publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::MotorEncoderPosition> enc_pos_pub(node);
-    const int enc_pos_pub_init_res = enc_pos_pub.init();
-    if (enc_pos_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::MotorEncoderPosition publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::MotorPosition> motor_pos_pub(node);
-    const int motor_pos_pub_init_res = motor_pos_pub.init();
-    if (motor_pos_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::MotorPosition publisher");
-    }
-
-    uavcan::Publisher<cvra::motor::feedback::MotorTorque> motor_torque_pub(node);
-    const int motor_torque_pub_init_res = motor_torque_pub.init();
-    if (motor_torque_pub_init_res < 0)
-    {
-        uavcan_failure("cvra::motor::feedback::MotorTorque publisher");
-    }
-
-
-
     /* Servers */
     /** initial config */
     uavcan::Subscriber<cvra::motor::config::LoadConfiguration> load_config_srv(node);
     const int load_config_srv_res = load_config_srv.start(
         [&](const uavcan::ReceivedDataStructure<cvra::motor::config::LoadConfiguration>& req)
         {
-            control_stop();
-
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/acceleration_limit"), req.acceleration_limit);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/velocity_limit"), req.velocity_limit);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/torque_limit"), req.torque_limit);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/low_batt_th"), req.low_batt_th);
-
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/current/kp"), req.current_pid.kp);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/current/ki"), req.current_pid.ki);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/current/kd"), req.current_pid.kd);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/current/i_limit"), req.current_pid.ilimit);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/velocity/kp"), req.velocity_pid.kp);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/velocity/ki"), req.velocity_pid.ki);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/velocity/kd"), req.velocity_pid.kd);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/velocity/i_limit"), req.velocity_pid.ilimit);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/position/kp"), req.position_pid.kp);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/position/ki"), req.position_pid.ki);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/position/kd"), req.position_pid.kd);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "control/position/i_limit"), req.position_pid.ilimit);
-
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "motor/torque_cst"), req.torque_constant);
-
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "thermal/current_gain"), req.thermal_current_gain);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "thermal/max_temp"), req.max_temperature);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "thermal/Rth"), req.thermal_resistance);
-            parameter_scalar_set(parameter_find(&parameter_root_ns, "thermal/Cth"), req.thermal_capacity);
-
-
+            static struct control_config_s cfg;
+
+            cfg.acceleration_limit = req.acceleration_limit;
+            cfg.velocity_limit = req.velocity_limit;
+            cfg.torque_limit = req.torque_limit;
+            cfg.low_batt_th = req.low_batt_th;
+
+            cfg.current_pid.kp = req.current_pid.kp;
+            cfg.current_pid.ki = req.current_pid.ki;
+            cfg.current_pid.kd = req.current_pid.kd;
+            cfg.current_pid.i_limit = req.current_pid.ilimit;
+            cfg.velocity_pid.kp = req.velocity_pid.kp;
+            cfg.velocity_pid.ki = req.velocity_pid.ki;
+            cfg.velocity_pid.kd = req.velocity_pid.kd;
+            cfg.velocity_pid.i_limit = req.velocity_pid.ilimit;
+            cfg.position_pid.kp = req.position_pid.kp;
+            cfg.position_pid.ki = req.position_pid.ki;
+            cfg.position_pid.kd = req.position_pid.kd;
+            cfg.position_pid.i_limit = req.position_pid.ilimit;
+
+            cfg.torque_constant = req.torque_constant;
+
+            cfg.thermal_current_gain = req.thermal_current_gain;
+            cfg.max_temperature = req.max_temperature;
+            cfg.thermal_resistance = req.thermal_resistance;
+            cfg.thermal_capacity = req.thermal_capacity;
+
+            cfg.input_selection = control_feedback.input_selection;
             if (req.mode == cvra::motor::config::LoadConfiguration::MODE_INDEX) {
-                control_feedback.input_selection = FEEDBACK_RPM;
+                cfg.input_selection = FEEDBACK_RPM;
             }
             if (req.mode == cvra::motor::config::LoadConfiguration::MODE_ENC_PERIODIC) {
-                control_feedback.input_selection = FEEDBACK_PRIMARY_ENCODER_PERIODIC;
+                cfg.input_selection = FEEDBACK_PRIMARY_ENCODER_PERIODIC;
             }
             if (req.mode == cvra::motor::config::LoadConfiguration::MODE_ENC_BOUNDED) {
-                control_feedback.input_selection = FEEDBACK_PRIMARY_ENCODER_BOUNDED;
+                cfg.input_selection = FEEDBACK_PRIMARY_ENCODER_BOUNDED;
             }
             if (req.mode == cvra::motor::config::LoadConfiguration::MODE_2_ENC_PERIODIC) {
-                control_feedback.input_selection = FEEDBACK_TWO_ENCODERS_PERIODIC;
+                cfg.input_selection = FEEDBACK_TWO_ENCODERS_PERIODIC;
             }
             if (req.mode == cvra::motor::config::LoadConfiguration::MODE_MOTOR_POT) {
-                control_feedback.input_selection = FEEDBACK_POTENTIOMETER;
+                cfg.input_selection = FEEDBACK_POTENTIOMETER;
             }
 
+            cfg.primary_encoder.transmission_p = req.transmission_ratio_p;
+            cfg.primary_encoder.transmission_q = req.transmission_ratio_q;
+            cfg.primary_encoder.ticks_per_rev = req.motor_encoder_steps_per_revolution;
 
-            control_feedback.primary_encoder.transmission_p = req.transmission_ratio_p;
-            control_feedback.primary_encoder.transmission_q = req.transmission_ratio_q;
-            control_feedback.primary_encoder.ticks_per_rev = req.motor_encoder_steps_per_revolution;
-
-            control_feedback.secondary_encoder.transmission_p = 1;
-            control_feedback.secondary_encoder.transmission_q = 1;
-            control_feedback.secondary_encoder.ticks_per_rev = req.second_encoder_steps_per_revolution;
+            cfg.secondary_encoder.transmission_p = 1;
+            cfg.secondary_encoder.transmission_q = 1;
+            cfg.secondary_encoder.ticks_per_rev = req.second_encoder_steps_per_revolution;
 
-            control_feedback.potentiometer.gain = req.potentiometer_gain;
-            control_feedback.potentiometer.zero = 0;
+            cfg.potentiometer_gain = req.potentiometer_gain;
+            cfg.potentiometer_zero = 0;
 
-            control_feedback.rpm.phase = 0;
+            cfg.rpm_phase = 0;
 
-            control_start();
+            // applied at the next control cycle, without stopping the loop
+            control_configure(&cfg);
 
             chprintf(ch_stdout, "LoadConfiguration received\n");
 
@@ -432,69 +1494,85 @@ static THD_FUNCTION(uavcan_node, arg)
         uavcan_failure("cvra::motor::config::EnableMotor server");
     }
 
-    while (true) {
-        int res = node.spin(uavcan::MonotonicDuration::fromMSec(1000/UAVCAN_SPIN_FREQUENCY));
-
-        if (res < 0) {
-            uavcan_failure("UAVCAN spin");
-        }
-
-        /* Streams */
-        if (stream_update(&current_pid_stream_config)) {
-            cvra::motor::feedback::CurrentPID current_pid;
-            current_pid.current = control_get_current();
-            current_pid.current_setpoint = control_get_current_setpoint();
-            current_pid.motor_voltage = control_get_motor_voltage();
-            current_pid_pub.broadcast(current_pid);
-        }
-
-        if (stream_update(&velocity_pid_stream_config)) {
-            cvra::motor::feedback::VelocityPID velocity_pid;
-            velocity_pid.velocity = control_get_velocity();
-            velocity_pid.velocity_setpoint = control_get_velocity_setpoint();
-            velocity_pid_pub.broadcast(velocity_pid);
-        }
+    /** Scope capture */
+    uavcan::ServiceServer<cvra::Scope> scope_srv(node);
+    const int scope_srv_res = scope_srv.start(
+        [&](const uavcan::ReceivedDataStructure<cvra::Scope::Request>& req,
+            cvra::Scope::Response& rsp)
+        {
+            static struct control_scope_config_s cfg;
+            const scope_t *scope = control_scope_get();
+
+            rsp.ok = true;
+            if (req.command == cvra::Scope::Request::COMMAND_ARM) {
+                unsigned i;
+                cfg.nb_channels = req.signals.size();
+                for (i = 0; i < cfg.nb_channels; i++) {
+                    cfg.signals[i] = (enum control_signal)req.signals[i];
+                }
+                cfg.divider = req.divider;
+                cfg.pretrigger = req.pretrigger;
+                cfg.trigger_signal = (enum control_signal)req.trigger_signal;
+                cfg.trigger_mode = (enum scope_trigger_mode)req.trigger_mode;
+                cfg.trigger_level = req.trigger_level;
+                if (cfg.trigger_mode > SCOPE_TRIGGER_MANUAL) {
+                    rsp.ok = false;
+                } else {
+                    rsp.ok = control_scope_arm(&cfg);
+                }
+            } else if (req.command == cvra::Scope::Request::COMMAND_TRIGGER) {
+                control_scope_trigger();
+            }
 
-        if (stream_update(&position_pid_stream_config)) {
-            cvra::motor::feedback::PositionPID position_pid;
-            position_pid.position = control_get_position();
-            position_pid.position_setpoint = control_get_position_setpoint();
-            position_pid_pub.broadcast(position_pid);
-        }
+            enum scope_state state = scope_get_state(scope);
+            rsp.state = state;
+            rsp.nb_channels = scope->nb_channels;
+            rsp.sequence = scope->sequence;
+            rsp.sample_period = control_scope_sample_period();
+            if (state != SCOPE_DONE) {
+                return;
+            }
+            rsp.nb_samples = scope_nb_samples(scope);
+            rsp.trigger_sample = scope_trigger_sample(scope);
+            if (req.command == cvra::Scope::Request::COMMAND_READ) {
+                unsigned sample, channel;
+                rsp.first_sample = req.sample;
+                for (sample = req.sample; sample < rsp.nb_samples; sample++) {
+                    if (rsp.data.size() + scope->nb_channels > rsp.data.capacity()) {
+                        break;
+                    }
+                    for (channel = 0; channel < scope->nb_channels; channel++) {
+                        rsp.data.push_back(scope_read(scope, sample, channel));
+                    }
+                }
+            }
+        });
 
-        if (stream_update(&motor_enc_stream_config)) {
-            cvra::motor::feedback::MotorEncoderPosition enc_pos;
-            enc_pos.raw_encoder_position = encoder_get_secondary();
-            enc_pos_pub.broadcast(enc_pos);
-        }
+    if (scope_srv_res < 0) {
+        uavcan_failure("cvra::Scope server");
+    }
 
-        if (stream_update(&index_stream_config)) {
-            cvra::motor::feedback::Index index;
-            index.position = index_get_position();
-            index_pub.broadcast(index);
-        }
+    subscribed_types_update(node);
 
-        if (stream_update(&motor_pos_stream_config)) {
-            cvra::motor::feedback::MotorPosition motor_pos;
-            motor_pos.position = control_get_position();
-            motor_pos.velocity = control_get_velocity();
-            motor_pos_pub.broadcast(motor_pos);
-        }
+    telemetry_start(node_arg);
 
-        if (stream_update(&motor_torque_stream_config)) {
-            cvra::motor::feedback::MotorTorque motor_torque;
-            motor_torque.torque = control_get_torque();
-            motor_torque.position = control_get_position();
-            motor_torque_pub.broadcast(motor_torque);
-        }
+    while (true) {
+        // woken by every frame left to libuavcan, the timeout runs its timers
+        // and flushes the TX queue
+        chEvtWaitAnyTimeout(UAVCAN_RX_EVENT, MS2ST(UAVCAN_SPIN_PERIOD));
+        uint32_t start = cycle_counter_get();
 
-        if (stream_update(&string_id_stream_config)) {
-            cvra::StringID string_id;
-            string_id.id = node_arg->node_name;
-            string_id_pub.broadcast(string_id);
+        node_mutex.lock();
+        int res = node.spinOnce();
+        if (res < 0) {
+            uavcan_failure("UAVCAN spin");
         }
+        network_time_update();
+        network_time_active = time_sync_slave.isActive();
+        rx_filter_update_parameters(node);
+        node_mutex.unlock();
 
-
+        control_timing_probe(CONTROL_TIMING_UAVCAN_RX, start);
     }
     return 0;
 }
@@ -502,5 +1580,25 @@ static THD_FUNCTION(uavcan_node, arg)
 extern "C"
 void uavcan_node_start(void *arg)
 {
-    chThdCreateStatic(uavcan_node_wa, sizeof(uavcan_node_wa), NORMALPRIO, uavcan_node, arg);
+    parameter_namespace_declare(&param_ns_uavcan, &parameter_root_ns, "uavcan");
+    parameter_scalar_declare_with_default(&param_rx_fast_path, &param_ns_uavcan, "rx_fast_path", 1);
+    parameter_scalar_declare_with_default(&param_hw_filters, &param_ns_uavcan, "hw_filters", 1);
+    parameter_namespace_declare(&param_ns_telemetry, &parameter_root_ns, "telemetry");
+    parameter_scalar_declare_with_default(&param_state_frequency, &param_ns_telemetry, "state_frequency", 0);
+    parameter_scalar_declare_with_default(&param_comm_status_frequency, &param_ns_telemetry, "comm_status_frequency", 1);
+    parameter_scalar_declare_with_default(&param_thread_stats_frequency, &param_ns_telemetry, "thread_stats_frequency", 1);
+    parameter_namespace_declare(&param_ns_deadband, &param_ns_telemetry, "deadband");
+    for (auto &d : deadband_streams) {
+        parameter_namespace_declare(&d.ns, &param_ns_deadband, d.name);
+        parameter_scalar_declare_with_default(&d.deadband, &d.ns, "deadband", 0);
+        parameter_scalar_declare_with_default(&d.max_interval, &d.ns, "max_interval", 1);
+    }
+    parameter_namespace_declare(&param_ns_aggregate, &param_ns_telemetry, "aggregate");
+    for (int i = 0; i < CONTROL_AGGREGATE_NB_CHANNELS; i++) {
+        parameter_namespace_declare(&aggregate_streams[i].ns, &param_ns_aggregate, aggregate_names[i]);
+        parameter_scalar_declare_with_default(&aggregate_streams[i].signal, &aggregate_streams[i].ns, "signal", -1);
+        parameter_scalar_declare_with_default(&aggregate_streams[i].frequency, &aggregate_streams[i].ns, "frequency", 10);
+    }
+
+    chThdCreateStatic(uavcan_node_wa, sizeof(uavcan_node_wa), UAVCAN_RX_PRIO, uavcan_node, arg);
 }
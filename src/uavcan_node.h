@@ -6,13 +6,49 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
 
 struct uavcan_node_arg {
     const char *node_name;
     uint8_t node_id:7;
 };
 
+struct uavcan_rx_stats_s {
+    uint32_t frames;            // passed the hardware acceptance filters
+    uint32_t fast_path;         // setpoints decoded in the RX interrupt
+    uint32_t software_rejects;  // passed the filters but not for this node
+};
+
+struct uavcan_tx_stats_s {
+    const char *name;           // telemetry message type
+    uint32_t expired;           // TX deadline passed in a mailbox
+    uint32_t replaced;          // superseded by a newer message
+};
+
+struct uavcan_comm_stats_s {
+    unsigned pool_capacity;     // UAVCAN memory pool [blocks]
+    unsigned pool_used;
+    unsigned pool_peak;
+    unsigned rx_queue_capacity; // [frames]
+    unsigned rx_queue_peak;
+    uint32_t rx_queue_overflows;
+    unsigned tx_mailboxes_peak; // most pending at once, out of 3
+    uint32_t tx_mailboxes_full; // times all became busy, frames waited in the queue
+    uint32_t errors;            // hardware errors and RX queue overflows
+    bool bus_off;
+    unsigned tx_error_counter;
+    unsigned rx_error_counter;
+    float rx_transfers_per_s;
+    float tx_transfers_per_s;
+    uint32_t transfer_errors;
+};
+
 void uavcan_node_start(void *arg);
+void uavcan_node_get_rx_stats(struct uavcan_rx_stats_s *stats);
+/* returns false if there is no message type i */
+bool uavcan_node_get_tx_stats(unsigned i, struct uavcan_tx_stats_s *stats);
+/* returns false if there is no CAN interface iface */
+bool uavcan_node_get_comm_stats(unsigned iface, struct uavcan_comm_stats_s *stats);
 
 #ifdef __cplusplus
 }
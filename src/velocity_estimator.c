@@ -0,0 +1,50 @@
+#include <math.h>
+#include "velocity_estimator.h"
+
+
+void encoder_edge_sample(struct encoder_edge_s *edge, uint16_t count, uint32_t time)
+{
+    if (count != edge->count) {
+        edge->count = count;
+        edge->time = time;
+    }
+}
+
+void velocity_estimator_reset(velocity_estimator_t *est)
+{
+    est->velocity = 0;
+    est->valid = false;
+}
+
+float velocity_estimator_update(velocity_estimator_t *est,
+                                const struct encoder_edge_s *edge,
+                                uint32_t now,
+                                float time_lsb)
+{
+    if (!est->valid) {
+        est->reference = *edge;
+        est->velocity = 0;
+        est->valid = true;
+        return 0;
+    }
+
+    int16_t counts = (int16_t)(edge->count - est->reference.count);
+    if (counts != 0) {
+        uint32_t window = edge->time - est->reference.time;
+        est->velocity = counts / (window * time_lsb);
+        est->reference = *edge;
+        return est->velocity;
+    }
+
+    // no edge since the reference, the next one is at least this far away
+    uint32_t timeout = VELOCITY_ESTIMATOR_TIMEOUT / time_lsb;
+    uint32_t elapsed = now - est->reference.time;
+    if (elapsed >= timeout) {
+        // also keeps the time difference from wrapping around
+        est->reference.time = now - timeout;
+        est->velocity = 0;
+    } else if (fabsf(est->velocity) * elapsed * time_lsb > 1) {
+        est->velocity = copysignf(1 / (elapsed * time_lsb), est->velocity);
+    }
+    return est->velocity;
+}
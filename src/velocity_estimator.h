@@ -0,0 +1,57 @@
+#ifndef VELOCITY_ESTIMATOR_H
+#define VELOCITY_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Encoder velocity from edge timing (M/T method)
+ * ==============================================
+ *
+ * The encoder count is sampled at a high fixed rate and the time of the last
+ * count change is kept. The velocity is the number of counts between two
+ * edges divided by the time between these edges, so it has a resolution of
+ * one count per measurement window at high speed and the resolution of the
+ * edge timing at low speed.
+ * Without a new edge the velocity is bounded by one count per time since the
+ * last edge, it decays to zero after VELOCITY_ESTIMATOR_TIMEOUT.
+ */
+
+#define VELOCITY_ESTIMATOR_TIMEOUT 0.5f // [s]
+
+struct encoder_edge_s {
+    uint16_t count;     // encoder count after the last edge
+    uint32_t time;      // time of the sample which saw the last edge
+};
+
+typedef struct {
+    struct encoder_edge_s reference;    // start of the measurement window
+    float velocity;                     // [counts/s]
+    bool valid;
+} velocity_estimator_t;
+
+
+// call at a fixed rate with the encoder count and a free running time
+void encoder_edge_sample(struct encoder_edge_s *edge, uint16_t count, uint32_t time);
+
+// restarts the estimation at the next update, velocity is zero until then
+void velocity_estimator_reset(velocity_estimator_t *est);
+
+/*
+ * Returns the velocity in [counts/s], edge is the last edge seen by
+ * encoder_edge_sample(), now the current time, time_lsb the time unit [s].
+ */
+float velocity_estimator_update(velocity_estimator_t *est,
+                                const struct encoder_edge_s *edge,
+                                uint32_t now,
+                                float time_lsb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VELOCITY_ESTIMATOR_H */
@@ -0,0 +1,125 @@
+#include "CppUTest/TestHarness.h"
+#include <stdlib.h>
+#include "../src/adc_stats.h"
+
+#define NB_CONVERSIONS 243
+
+
+TEST_GROUP(ADCStats)
+{
+    uint32_t buffer[NB_CONVERSIONS * ADC_STATS_NB_CHANNELS / 2];
+    uint16_t *samples = (uint16_t *)buffer;
+    struct adc_stats_s stats;
+
+    void fill(int i, uint16_t aux1, uint16_t current, uint16_t aux2, uint16_t battery)
+    {
+        samples[i * 4 + 0] = aux1;
+        samples[i * 4 + 1] = current;
+        samples[i * 4 + 2] = aux2;
+        samples[i * 4 + 3] = battery;
+    }
+
+    // straightforward computation of the statistics
+    void check_matches_reference(const uint16_t *s, size_t n)
+    {
+        int32_t sum = 0;
+        uint32_t sq_sum = 0, battery_sum = 0, aux_sum = 0;
+        uint16_t min = 0xffff, max = 0;
+        for (size_t i = 0; i < n; i++) {
+            int32_t c = s[i * 4 + 1] - ADC_STATS_MID_SCALE;
+            sum += c;
+            sq_sum += c * c;
+            min = s[i * 4 + 1] < min ? s[i * 4 + 1] : min;
+            max = s[i * 4 + 1] > max ? s[i * 4 + 1] : max;
+            aux_sum += s[i * 4] + s[i * 4 + 2];
+            battery_sum += s[i * 4 + 3];
+        }
+        adc_stats_compute(&stats, s, n);
+        CHECK_EQUAL(n, stats.nb_samples);
+        CHECK_EQUAL(sum, adc_stats_current_sum(s, n));
+        CHECK_EQUAL(sum, stats.current_sum);
+        CHECK_EQUAL(sq_sum, stats.current_sq_sum);
+        CHECK_EQUAL(min, stats.current_min);
+        CHECK_EQUAL(max, stats.current_max);
+        CHECK_EQUAL(battery_sum, stats.battery_sum);
+        CHECK_EQUAL(aux_sum, stats.aux_sum);
+    }
+};
+
+TEST(ADCStats, ZeroCurrent)
+{
+    for (int i = 0; i < NB_CONVERSIONS; i++) {
+        fill(i, 100, ADC_STATS_MID_SCALE, 300, 2000);
+    }
+    adc_stats_compute(&stats, samples, NB_CONVERSIONS);
+    CHECK_EQUAL(0, stats.current_sum);
+    CHECK_EQUAL(0, stats.current_sq_sum);
+    CHECK_EQUAL(ADC_STATS_MID_SCALE, stats.current_min);
+    CHECK_EQUAL(ADC_STATS_MID_SCALE, stats.current_max);
+    CHECK_EQUAL(2000 * NB_CONVERSIONS, stats.battery_sum);
+    CHECK_EQUAL(400 * NB_CONVERSIONS, stats.aux_sum);
+}
+
+TEST(ADCStats, MinMaxInEitherLane)
+{
+    for (int i = 0; i < NB_CONVERSIONS; i++) {
+        fill(i, 0, 2000, 0, 0);
+    }
+    samples[10 * 4 + 1] = 12;
+    samples[21 * 4 + 1] = 4000;
+    adc_stats_compute(&stats, samples, NB_CONVERSIONS);
+    CHECK_EQUAL(12, stats.current_min);
+    CHECK_EQUAL(4000, stats.current_max);
+}
+
+TEST(ADCStats, OddConversionIsIncluded)
+{
+    for (int i = 0; i < NB_CONVERSIONS; i++) {
+        fill(i, 1, 2048, 1, 1);
+    }
+    fill(NB_CONVERSIONS - 1, 5, 4095, 7, 9);
+    check_matches_reference(samples, NB_CONVERSIONS);
+    CHECK_EQUAL(4095, stats.current_max);
+}
+
+TEST(ADCStats, MatchesReferenceOnRandomSamples)
+{
+    srand(42);
+    for (int i = 0; i < NB_CONVERSIONS * 4; i++) {
+        samples[i] = rand() % 4096;
+    }
+    check_matches_reference(samples, NB_CONVERSIONS);
+    // after skipping samples, like the charge pump recharge does
+    check_matches_reference(&samples[111 * 4], NB_CONVERSIONS - 111);
+    check_matches_reference(samples, 0);
+}
+
+TEST(ADCStats, FullScaleDoesNotOverflow)
+{
+    for (int i = 0; i < NB_CONVERSIONS; i++) {
+        fill(i, 4095, i % 2 ? 0 : 4095, 4095, 4095);
+    }
+    check_matches_reference(samples, NB_CONVERSIONS);
+}
+
+TEST(ADCStats, MergeEqualsSinglePass)
+{
+    srand(1);
+    for (int i = 0; i < NB_CONVERSIONS * 4; i++) {
+        samples[i] = rand() % 4096;
+    }
+    struct adc_stats_s a, b;
+    adc_stats_compute(&a, samples, 0);
+    adc_stats_compute(&b, samples, 100);
+    adc_stats_merge(&a, &b);
+    adc_stats_compute(&b, &samples[100 * 4], NB_CONVERSIONS - 100);
+    adc_stats_merge(&a, &b);
+    check_matches_reference(samples, NB_CONVERSIONS);
+    CHECK_EQUAL(stats.nb_samples, a.nb_samples);
+    CHECK_EQUAL(stats.current_sum, a.current_sum);
+    CHECK_EQUAL(stats.current_sq_sum, a.current_sq_sum);
+    CHECK_EQUAL(stats.current_min, a.current_min);
+    CHECK_EQUAL(stats.current_max, a.current_max);
+    CHECK_EQUAL(stats.battery_sum, a.battery_sum);
+    CHECK_EQUAL(stats.aux_sum, a.aux_sum);
+}
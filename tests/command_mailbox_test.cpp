@@ -0,0 +1,127 @@
+#include "CppUTest/TestHarness.h"
+#include <thread>
+#include <atomic>
+#include "../src/command_mailbox.h"
+
+
+static struct command_s make_command(uint32_t i)
+{
+    struct command_s cmd;
+    cmd.mode = (enum command_mode)(i % 4);
+    cmd.position = i;
+    cmd.velocity = 2.f * i;
+    cmd.acceleration = -1.f * i;
+    cmd.torque = 0.5f * i;
+    cmd.timestamp = i;
+    return cmd;
+}
+
+static bool command_is_consistent(const struct command_s *cmd)
+{
+    uint32_t i = cmd->timestamp;
+    return cmd->mode == (enum command_mode)(i % 4)
+        && cmd->position == (float)i
+        && cmd->velocity == 2.f * i
+        && cmd->acceleration == -1.f * i
+        && cmd->torque == 0.5f * i;
+}
+
+
+TEST_GROUP(CommandMailbox)
+{
+    command_mailbox_t mb;
+
+    void setup(void)
+    {
+        command_mailbox_init(&mb);
+    }
+};
+
+TEST(CommandMailbox, EmptyAfterInit)
+{
+    struct command_s cmd;
+    CHECK_FALSE(command_mailbox_fetch(&mb, &cmd));
+}
+
+TEST(CommandMailbox, FetchPublished)
+{
+    struct command_s in = make_command(42);
+    struct command_s out;
+
+    command_mailbox_publish(&mb, &in);
+
+    CHECK_TRUE(command_mailbox_fetch(&mb, &out));
+    CHECK_EQUAL(42, out.timestamp);
+    CHECK_TRUE(command_is_consistent(&out));
+}
+
+TEST(CommandMailbox, FetchOnlyOnce)
+{
+    struct command_s in = make_command(1);
+    struct command_s out;
+
+    command_mailbox_publish(&mb, &in);
+    command_mailbox_fetch(&mb, &out);
+
+    CHECK_FALSE(command_mailbox_fetch(&mb, &out));
+}
+
+TEST(CommandMailbox, NewestWins)
+{
+    struct command_s out;
+    for (uint32_t i = 1; i <= 10; i++) {
+        struct command_s in = make_command(i);
+        command_mailbox_publish(&mb, &in);
+    }
+
+    CHECK_TRUE(command_mailbox_fetch(&mb, &out));
+    CHECK_EQUAL(10, out.timestamp);
+    CHECK_FALSE(command_mailbox_fetch(&mb, &out));
+}
+
+TEST(CommandMailbox, AlternatingPublishFetch)
+{
+    struct command_s out;
+    for (uint32_t i = 1; i <= 10; i++) {
+        struct command_s in = make_command(i);
+        command_mailbox_publish(&mb, &in);
+        CHECK_TRUE(command_mailbox_fetch(&mb, &out));
+        CHECK_EQUAL(i, out.timestamp);
+    }
+}
+
+TEST(CommandMailbox, ConcurrentProducerConsumerNoTornReads)
+{
+    const uint32_t nb_commands = 1000000;
+    std::atomic<bool> done(false);
+
+    std::thread producer([&]() {
+        for (uint32_t i = 1; i <= nb_commands; i++) {
+            struct command_s in = make_command(i);
+            command_mailbox_publish(&mb, &in);
+        }
+        done = true;
+    });
+
+    uint32_t last = 0;
+    uint32_t nb_torn = 0;
+    uint32_t nb_out_of_order = 0;
+    struct command_s out;
+    while (!done || last != nb_commands) {
+        if (command_mailbox_fetch(&mb, &out)) {
+            if (!command_is_consistent(&out)) {
+                nb_torn++;
+            }
+            if (out.timestamp <= last) {
+                nb_out_of_order++;
+            }
+            last = out.timestamp;
+        }
+    }
+
+    producer.join();
+
+    CHECK_EQUAL(0, nb_torn);
+    CHECK_EQUAL(0, nb_out_of_order);
+    CHECK_EQUAL(nb_commands, last);
+}
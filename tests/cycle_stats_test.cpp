@@ -0,0 +1,54 @@
+#include "CppUTest/TestHarness.h"
+#include "../src/cycle_stats.h"
+
+
+TEST_GROUP(CycleStats)
+{
+    cycle_stats_t s;
+
+    void setup(void)
+    {
+        cycle_stats_reset(&s);
+    }
+};
+
+TEST(CycleStats, Reset)
+{
+    CHECK_EQUAL(0, s.count);
+    CHECK_EQUAL(0, s.max);
+    CHECK_EQUAL(UINT32_MAX, s.min);
+    CHECK_EQUAL(0, cycle_stats_mean(&s));
+}
+
+TEST(CycleStats, MinMaxMean)
+{
+    cycle_stats_update(&s, 100);
+    cycle_stats_update(&s, 300);
+    cycle_stats_update(&s, 200);
+
+    CHECK_EQUAL(3, s.count);
+    CHECK_EQUAL(100, s.min);
+    CHECK_EQUAL(300, s.max);
+    CHECK_EQUAL(200, cycle_stats_mean(&s));
+}
+
+TEST(CycleStats, Buckets)
+{
+    CHECK_EQUAL(0, cycle_stats_bucket(0));
+    CHECK_EQUAL(1, cycle_stats_bucket(1));
+    CHECK_EQUAL(2, cycle_stats_bucket(2));
+    CHECK_EQUAL(2, cycle_stats_bucket(3));
+    CHECK_EQUAL(3, cycle_stats_bucket(4));
+    CHECK_EQUAL(11, cycle_stats_bucket(1024));
+    CHECK_EQUAL(CYCLE_STATS_NB_BUCKETS - 1, cycle_stats_bucket(UINT32_MAX));
+}
+
+TEST(CycleStats, Histogram)
+{
+    cycle_stats_update(&s, 5);
+    cycle_stats_update(&s, 6);
+    cycle_stats_update(&s, 1000);
+
+    CHECK_EQUAL(2, s.histogram[3]);
+    CHECK_EQUAL(1, s.histogram[10]);
+}
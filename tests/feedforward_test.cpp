@@ -0,0 +1,81 @@
+#include "CppUTest/TestHarness.h"
+#include <math.h>
+#include "../src/feedforward.h"
+
+
+TEST_GROUP(Feedforward)
+{
+    feedforward_t ff;
+    struct setpoint_s setpts;
+
+    void setup(void)
+    {
+        feedforward_init(&ff);
+        setpts.position_control_enabled = true;
+        setpts.velocity_control_enabled = true;
+        setpts.position_setpt = 0;
+        setpts.velocity_setpt = 0;
+        setpts.acceleration_setpt = 0;
+        setpts.feedforward_torque = 0;
+    }
+};
+
+TEST(Feedforward, ZeroByDefault)
+{
+    setpts.velocity_setpt = 3;
+    setpts.acceleration_setpt = 10;
+    DOUBLES_EQUAL(0, feedforward_torque(&ff, &setpts), 1e-7);
+}
+
+TEST(Feedforward, InertiaAndViscous)
+{
+    ff.inertia = 0.02;
+    ff.viscous = 0.1;
+    setpts.velocity_setpt = -3;
+    setpts.acceleration_setpt = 10;
+    DOUBLES_EQUAL(0.2 - 0.3, feedforward_torque(&ff, &setpts), 1e-6);
+}
+
+TEST(Feedforward, CoulombFriction)
+{
+    ff.coulomb = 0.5;
+    ff.coulomb_band = 0.1;
+    setpts.velocity_setpt = 2;
+    DOUBLES_EQUAL(0.5, feedforward_torque(&ff, &setpts), 1e-6);
+    setpts.velocity_setpt = -2;
+    DOUBLES_EQUAL(-0.5, feedforward_torque(&ff, &setpts), 1e-6);
+    // linear around standstill
+    setpts.velocity_setpt = 0.05;
+    DOUBLES_EQUAL(0.25, feedforward_torque(&ff, &setpts), 1e-6);
+    setpts.velocity_setpt = 0;
+    DOUBLES_EQUAL(0, feedforward_torque(&ff, &setpts), 1e-6);
+}
+
+TEST(Feedforward, CoulombFrictionWithoutBand)
+{
+    ff.coulomb = 0.5;
+    DOUBLES_EQUAL(0, feedforward_torque(&ff, &setpts), 1e-6);
+    setpts.velocity_setpt = 0.001;
+    DOUBLES_EQUAL(0.5, feedforward_torque(&ff, &setpts), 1e-6);
+}
+
+TEST(Feedforward, OffsetAndGravity)
+{
+    ff.offset = 0.1;
+    ff.gravity = 2;
+    setpts.position_setpt = M_PI / 3;
+    DOUBLES_EQUAL(0.1 + 1, feedforward_torque(&ff, &setpts), 1e-6);
+    // no position setpoint in velocity control
+    setpts.position_control_enabled = false;
+    DOUBLES_EQUAL(0.1, feedforward_torque(&ff, &setpts), 1e-6);
+}
+
+TEST(Feedforward, NoneInTorqueControl)
+{
+    ff.offset = 0.1;
+    ff.inertia = 1;
+    setpts.acceleration_setpt = 1;
+    setpts.position_control_enabled = false;
+    setpts.velocity_control_enabled = false;
+    DOUBLES_EQUAL(0, feedforward_torque(&ff, &setpts), 1e-7);
+}
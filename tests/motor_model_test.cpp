@@ -0,0 +1,77 @@
+#include "CppUTest/TestHarness.h"
+#include "../sim/motor_model.h"
+
+
+TEST_GROUP(MotorModel)
+{
+    motor_model_t m;
+    struct motor_model_params p;
+
+    void setup(void)
+    {
+        p.R = 1;
+        p.L = 1e-4;
+        p.Kt = 0.01;
+        p.J_motor = 1e-6;
+        p.gear_ratio = 1;
+        p.J_load = 1e-6;
+        p.viscous = 0;
+        p.coulomb = 0;
+        p.backlash = 0;
+        p.stiffness = 500;
+        p.damping = 0.01;
+    }
+
+    void simulate(double u, double duration)
+    {
+        int i;
+        for (i = 0; i < duration / 1e-6; i++) {
+            motor_model_step(&m, u, 1e-6);
+        }
+    }
+};
+
+TEST(MotorModel, StaysAtRest)
+{
+    motor_model_init(&m, &p);
+    simulate(0, 0.01);
+    DOUBLES_EQUAL(0, m.current, 1e-9);
+    DOUBLES_EQUAL(0, m.load_position, 1e-9);
+}
+
+TEST(MotorModel, StallCurrent)
+{
+    p.J_load = 1e6; // blocked output
+    motor_model_init(&m, &p);
+    simulate(2, 0.002);  // 20 L/R
+    DOUBLES_EQUAL(2 / p.R, m.current, 1e-3);
+}
+
+TEST(MotorModel, NoLoadSpeed)
+{
+    p.gear_ratio = 10;
+    motor_model_init(&m, &p);
+    simulate(1, 0.5);
+    DOUBLES_EQUAL(1 / p.Kt, m.motor_velocity, 0.1);
+    DOUBLES_EQUAL(1 / p.Kt / 10, m.load_velocity, 0.01);
+}
+
+TEST(MotorModel, CoulombFrictionHoldsLoad)
+{
+    p.coulomb = 0.1;
+    p.J_load = 1e-4;
+    motor_model_init(&m, &p);
+    simulate(2, 0.1);    // 0.02Nm stall torque
+    DOUBLES_EQUAL(0, m.load_velocity, 1e-9);
+}
+
+TEST(MotorModel, BacklashDecouplesLoad)
+{
+    p.backlash = 1;
+    p.J_load = 1e6;
+    motor_model_init(&m, &p);
+    simulate(0.1, 0.01);
+    CHECK(m.motor_position > 0.01);
+    CHECK(m.motor_position < 0.5);
+    DOUBLES_EQUAL(0, m.gear_torque, 1e-12);
+}
@@ -0,0 +1,221 @@
+#include "CppUTest/TestHarness.h"
+#include <math.h>
+#include <string.h>
+#include "../src/fixed_point.h"
+#include "../src/pid_q31.h"
+#include "../src/pid_cascade_q31.h"
+
+
+TEST_GROUP(FixedPoint)
+{
+};
+
+TEST(FixedPoint, SaturatingAddSub)
+{
+    CHECK_EQUAL(3, q31_add(1, 2));
+    CHECK_EQUAL(INT32_MAX, q31_add(INT32_MAX - 1, 2));
+    CHECK_EQUAL(INT32_MIN, q31_add(INT32_MIN + 1, -2));
+    CHECK_EQUAL(INT32_MIN, q31_sub(INT32_MIN + 1, 2));
+    CHECK_EQUAL(INT32_MAX, q31_neg(INT32_MIN));
+}
+
+TEST(FixedPoint, Multiply)
+{
+    q31_t half = 1 << 30;
+    CHECK_EQUAL(1 << 29, q31_mul(half, half));
+    CHECK_EQUAL(-(1 << 29), q31_mul(-half, half));
+    CHECK_EQUAL(INT32_MAX, q31_mul(INT32_MIN, INT32_MIN));
+}
+
+TEST(FixedPoint, GainMatchesFloat)
+{
+    const float gains[] = {0.1f, 1.f, 3.7f, -2.5f, 1e-6f, 1234.5f};
+    const int32_t inputs[] = {1000000, -777777, 12345678, 3};
+    for (float gain : gains) {
+        q31_gain_t g = q31_gain_from_float(gain);
+        for (int32_t x : inputs) {
+            double expected = fmax(fmin(x * (double)gain, INT32_MAX), INT32_MIN);
+            DOUBLES_EQUAL(expected, q31_gain_apply(g, x), fabs(expected) * 1e-7 + 1);
+        }
+    }
+}
+
+TEST(FixedPoint, GainSaturates)
+{
+    q31_gain_t g = q31_gain_from_float(1000);
+    CHECK_EQUAL(INT32_MAX, q31_gain_apply(g, 10000000));
+    CHECK_EQUAL(INT32_MIN, q31_gain_apply(g, -10000000));
+}
+
+TEST(FixedPoint, HugeGainIsClamped)
+{
+    q31_gain_t g = q31_gain_from_float(1e12f);
+    CHECK_EQUAL(INT32_MAX, g.mantissa);
+    CHECK_EQUAL(31, g.exponent);
+    g = q31_gain_from_float(-1e12f);
+    CHECK_EQUAL(INT32_MIN, g.mantissa);
+    CHECK_EQUAL(INT32_MIN, q31_gain_apply(g, 10));
+}
+
+TEST(FixedPoint, ZeroGain)
+{
+    CHECK_EQUAL(0, q31_gain_apply(q31_gain_from_float(0), 123456));
+    CHECK_EQUAL(0, q31_gain_apply(q31_gain_from_float(1e-20f), 123456));
+}
+
+
+TEST_GROUP(PIDQ31)
+{
+    pid_ctrl_t ref;
+    pid_q31_t pid;
+    const float input_lsb = 1e-6f;
+    const float output_lsb = 1e-5f;
+
+    void setup(void)
+    {
+        pid_init(&ref);
+        pid_q31_init(&pid);
+    }
+
+    void check_tracks_float(void)
+    {
+        pid_q31_configure(&pid, &ref, input_lsb, output_lsb);
+        for (int i = 0; i < 1000; i++) {
+            float error = sinf(i * 0.05f) + 0.3f;
+            int32_t error_q = q31_from_float(error, input_lsb);
+            float expected = pid_process(&ref, q31_to_float(error_q, input_lsb));
+            float out = q31_to_float(pid_q31_process(&pid, error_q), output_lsb);
+            DOUBLES_EQUAL(expected, out, 1e-4 + fabsf(expected) * 1e-4);
+        }
+    }
+};
+
+TEST(PIDQ31, Proportional)
+{
+    pid_set_gains(&ref, 2.5, 0, 0);
+    check_tracks_float();
+}
+
+TEST(PIDQ31, Integral)
+{
+    pid_set_gains(&ref, 1, 20, 0);
+    pid_set_frequency(&ref, 100);
+    check_tracks_float();
+}
+
+TEST(PIDQ31, IntegralLimit)
+{
+    pid_set_gains(&ref, 0, 20, 0);
+    pid_set_frequency(&ref, 100);
+    pid_set_integral_limit(&ref, 5);
+    check_tracks_float();
+}
+
+TEST(PIDQ31, Derivative)
+{
+    pid_set_gains(&ref, 0, 0, 0.01);
+    pid_set_frequency(&ref, 100);
+    check_tracks_float();
+}
+
+
+/*
+ * Runs the float and the fixed point cascade on the same inputs, the fixed
+ * point outputs must stay within tolerance of the float ones.
+ */
+TEST_GROUP(PIDCascadeQ31)
+{
+    struct pid_cascade_s ref;
+    struct pid_cascade_q31_s q;
+    const float position_lsb = 2 * (float)M_PI / (4096 * 49);
+    float setpoint_offset;
+
+    void setup(void)
+    {
+        setpoint_offset = 0;
+        memset(&ref, 0, sizeof(ref));
+        memset(&q, 0, sizeof(q));
+        pid_init(&ref.position_pid);
+        pid_init(&ref.velocity_pid);
+        pid_init(&ref.current_pid);
+        pid_q31_init(&q.position_pid);
+        pid_q31_init(&q.velocity_pid);
+        pid_q31_init(&q.current_pid);
+
+        pid_set_gains(&ref.position_pid, 15, 1, 0);
+        pid_set_frequency(&ref.position_pid, 2000);
+        pid_set_gains(&ref.velocity_pid, 2, 60, 0.001);
+        pid_set_frequency(&ref.velocity_pid, 2000);
+        pid_set_integral_limit(&ref.velocity_pid, 100);
+        pid_set_gains(&ref.current_pid, 3, 10000, 0);
+        pid_set_frequency(&ref.current_pid, 25000);
+
+        ref.motor_current_constant = 0.68;
+        ref.velocity_limit = 10;
+        ref.torque_limit = 5;
+        ref.current_limit = INFINITY;
+        ref.setpts.position_control_enabled = true;
+        ref.setpts.velocity_control_enabled = true;
+    }
+
+    void run_both(int nb_steps)
+    {
+        pid_cascade_q31_configure(&q, &ref, position_lsb);
+        for (int i = 0; i < nb_steps; i++) {
+            float t = i * 0.0005f;
+            // inputs, position quantized to encoder ticks
+            q.position = q31_from_float(0.8f * sinf(3 * t), position_lsb);
+            ref.position = q31_to_float(q.position, position_lsb);
+            ref.velocity = 2.4f * cosf(3 * t) + 0.05f * sinf(200 * t);
+            q.velocity = q31_from_float(ref.velocity, PID_CASCADE_Q31_VELOCITY_LSB);
+            // current follows the previous setpoint, like a current loop would
+            ref.current = ref.current_setpoint + 0.05f * sinf(50 * t);
+            q.current = q31_from_float(ref.current, PID_CASCADE_Q31_CURRENT_LSB);
+            ref.setpts.position_setpt = 0.7f * sinf(3 * t + 0.1f) + setpoint_offset;
+            ref.setpts.velocity_setpt = 2.1f * cosf(3 * t + 0.1f);
+            ref.setpts.feedforward_torque = 0.1f;
+            pid_cascade_q31_set_setpoints(&q, &ref.setpts);
+
+            pid_cascade_control(&ref);
+            pid_cascade_q31_control(&q);
+
+            struct pid_cascade_s out;
+            pid_cascade_q31_to_float(&q, &out);
+            DOUBLES_EQUAL(ref.position_error, out.position_error, 1e-4);
+            DOUBLES_EQUAL(ref.velocity_setpoint, out.velocity_setpoint, 1e-3);
+            // the float reference itself has rounding errors of this order
+            DOUBLES_EQUAL(ref.velocity_ctrl_out, out.velocity_ctrl_out, 5e-3);
+            DOUBLES_EQUAL(ref.current_setpoint, out.current_setpoint, 5e-3);
+            DOUBLES_EQUAL(ref.motor_voltage, out.motor_voltage, 2e-2);
+        }
+    }
+};
+
+TEST(PIDCascadeQ31, TracksFloatCascade)
+{
+    run_both(2000);
+}
+
+TEST(PIDCascadeQ31, TracksFloatCascadeInLimits)
+{
+    ref.velocity_limit = 1;
+    ref.torque_limit = 0.2;
+    run_both(2000);
+}
+
+TEST(PIDCascadeQ31, TracksFloatCascadePeriodic)
+{
+    ref.periodic_actuator = true;
+    setpoint_offset = 2 * M_PI; // error wraps around
+    run_both(2000);
+}
+
+TEST(PIDCascadeQ31, DisabledPositionLoopHasNoOutput)
+{
+    ref.setpts.position_control_enabled = false;
+    pid_cascade_q31_configure(&q, &ref, position_lsb);
+    pid_cascade_q31_set_setpoints(&q, &ref.setpts);
+    q.position = 1000;
+    pid_cascade_q31_position_control(&q);
+    CHECK_EQUAL(0, q.position_ctrl_out);
+}
@@ -1,5 +1,6 @@
 #include "CppUTest/TestHarness.h"
 #include <math.h>
+#include <string.h>
 
 extern "C" {
 #include "pid_cascade.c"
@@ -53,3 +54,70 @@ TEST(PeriodicError, LargeNeg)
     DOUBLES_EQUAL(-5 + 2*M_PI, periodic_error(-5+-2*M_PI), 1e-5);
     DOUBLES_EQUAL(-5 + 2*M_PI, periodic_error(-5+-4*M_PI), 1e-5);
 }
+
+
+TEST_GROUP(PIDCascadeStages)
+{
+    struct pid_cascade_s ctrl;
+
+    void setup(void)
+    {
+        memset(&ctrl, 0, sizeof(ctrl));
+        pid_init(&ctrl.position_pid);
+        pid_init(&ctrl.velocity_pid);
+        pid_init(&ctrl.current_pid);
+        pid_set_gains(&ctrl.position_pid, 2, 0, 0);
+        pid_set_gains(&ctrl.velocity_pid, 3, 0, 0);
+        pid_set_gains(&ctrl.current_pid, 4, 0, 0);
+        ctrl.motor_current_constant = 1;
+        ctrl.velocity_limit = INFINITY;
+        ctrl.torque_limit = INFINITY;
+        ctrl.current_limit = INFINITY;
+        ctrl.setpts.position_control_enabled = true;
+        ctrl.setpts.velocity_control_enabled = true;
+    }
+};
+
+TEST(PIDCascadeStages, SameResultAsFullCascade)
+{
+    ctrl.position = 1;
+    ctrl.velocity = 0.5;
+    ctrl.current = 0.1;
+    ctrl.setpts.position_setpt = 1.5;
+    ctrl.setpts.velocity_setpt = 0.2;
+
+    struct pid_cascade_s full = ctrl;
+    pid_cascade_control(&full);
+
+    pid_cascade_position_control(&ctrl);
+    pid_cascade_velocity_control(&ctrl);
+    pid_cascade_current_control(&ctrl);
+
+    DOUBLES_EQUAL(full.position_ctrl_out, ctrl.position_ctrl_out, 1e-6);
+    DOUBLES_EQUAL(full.current_setpoint, ctrl.current_setpoint, 1e-6);
+    DOUBLES_EQUAL(full.motor_voltage, ctrl.motor_voltage, 1e-6);
+}
+
+TEST(PIDCascadeStages, CurrentLoopUsesLastCurrentSetpoint)
+{
+    ctrl.current_setpoint = 0.5;
+    ctrl.current = 0.25;
+
+    pid_cascade_current_control(&ctrl);
+    DOUBLES_EQUAL(1, ctrl.motor_voltage, 1e-6);
+
+    // faster current loop: new current measurement, same setpoint
+    ctrl.current = 0.5;
+    pid_cascade_current_control(&ctrl);
+    DOUBLES_EQUAL(0, ctrl.motor_voltage, 1e-6);
+}
+
+TEST(PIDCascadeStages, DisabledPositionLoopHasNoOutput)
+{
+    ctrl.position_ctrl_out = 3;
+    ctrl.setpts.position_control_enabled = false;
+
+    pid_cascade_position_control(&ctrl);
+
+    DOUBLES_EQUAL(0, ctrl.position_ctrl_out, 1e-6);
+}
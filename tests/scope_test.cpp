@@ -0,0 +1,130 @@
+#include "CppUTest/TestHarness.h"
+#include "../src/scope.h"
+
+
+TEST_GROUP(Scope)
+{
+    scope_t s;
+
+    void setup(void)
+    {
+        scope_init(&s);
+    }
+
+    // channel 0 is the sample number, channel 1 its negative
+    void feed(int from, int to, float trigger_value)
+    {
+        for (int i = from; i < to; i++) {
+            float values[2] = {(float)i, (float)-i};
+            scope_sample(&s, values, trigger_value);
+        }
+    }
+
+    void feed_ramp(int from, int to)
+    {
+        for (int i = from; i < to; i++) {
+            float values[2] = {(float)i, (float)-i};
+            scope_sample(&s, values, (float)i);
+        }
+    }
+};
+
+TEST(Scope, IdleDoesNotRecord)
+{
+    feed(0, 10, 0);
+    CHECK_EQUAL(SCOPE_IDLE, scope_get_state(&s));
+    CHECK_EQUAL(0, scope_nb_samples(&s));
+}
+
+TEST(Scope, InvalidChannels)
+{
+    CHECK_FALSE(scope_arm(&s, 0, 0, 1, SCOPE_TRIGGER_MANUAL, 0));
+    CHECK_FALSE(scope_arm(&s, SCOPE_NB_CHANNELS + 1, 0, 1, SCOPE_TRIGGER_MANUAL, 0));
+    CHECK_EQUAL(SCOPE_IDLE, scope_get_state(&s));
+}
+
+TEST(Scope, RisingTriggerWithPretrigger)
+{
+    const unsigned depth = SCOPE_BUFFER_SIZE / 2;
+    CHECK_TRUE(scope_arm(&s, 2, 0.25, 1, SCOPE_TRIGGER_RISING, 4999.5));
+    feed_ramp(0, 5000);
+    CHECK_EQUAL(SCOPE_ARMED, scope_get_state(&s));
+    feed_ramp(5000, 5001);
+    CHECK_EQUAL(SCOPE_TRIGGERED, scope_get_state(&s));
+    feed_ramp(5001, 10000);
+    CHECK_EQUAL(SCOPE_DONE, scope_get_state(&s));
+
+    CHECK_EQUAL(depth, scope_nb_samples(&s));
+    unsigned trigger = scope_trigger_sample(&s);
+    CHECK_EQUAL((unsigned)(0.25 * (depth - 1)), trigger);
+    DOUBLES_EQUAL(5000, scope_read(&s, trigger, 0), 0);
+    DOUBLES_EQUAL(-5000, scope_read(&s, trigger, 1), 0);
+    DOUBLES_EQUAL(5000 - trigger, scope_read(&s, 0, 0), 0);
+    DOUBLES_EQUAL(5000 - trigger + depth - 1, scope_read(&s, depth - 1, 0), 0);
+}
+
+TEST(Scope, FallingTrigger)
+{
+    scope_arm(&s, 1, 0, 1, SCOPE_TRIGGER_FALLING, 0);
+    feed(0, 5, 1);
+    feed(5, 6, 0);
+    CHECK_EQUAL(SCOPE_TRIGGERED, scope_get_state(&s));
+    feed(6, 10000, -1);
+    CHECK_EQUAL(SCOPE_DONE, scope_get_state(&s));
+    CHECK_EQUAL(0, scope_trigger_sample(&s));
+    DOUBLES_EQUAL(5, scope_read(&s, 0, 0), 0);
+}
+
+TEST(Scope, AboveTriggerOnNegativeValue)
+{
+    scope_arm(&s, 1, 0, 1, SCOPE_TRIGGER_ABOVE, 0.1);
+    feed(0, 10, 0.05);
+    feed(10, 11, -0.2);
+    CHECK_EQUAL(SCOPE_TRIGGERED, scope_get_state(&s));
+}
+
+TEST(Scope, ChangeTrigger)
+{
+    scope_arm(&s, 1, 0, 1, SCOPE_TRIGGER_CHANGE, 0);
+    feed(0, 10, 2);     // the first sample is no change
+    CHECK_EQUAL(SCOPE_ARMED, scope_get_state(&s));
+    feed(10, 11, 3);
+    CHECK_EQUAL(SCOPE_TRIGGERED, scope_get_state(&s));
+}
+
+TEST(Scope, ForcedBeforePretriggerIsFilled)
+{
+    scope_arm(&s, 1, 0.5, 1, SCOPE_TRIGGER_MANUAL, 0);
+    feed(0, 10, 0);
+    scope_force_trigger(&s);
+    feed(10, 11, 0);
+    CHECK_EQUAL(SCOPE_TRIGGERED, scope_get_state(&s));
+    feed(11, 10000, 0);
+    CHECK_EQUAL(SCOPE_DONE, scope_get_state(&s));
+    // only the 10 samples recorded before the trigger
+    CHECK_EQUAL(10, scope_trigger_sample(&s));
+    CHECK_EQUAL(SCOPE_BUFFER_SIZE - (SCOPE_BUFFER_SIZE - 1) / 2 + 10, scope_nb_samples(&s));
+    DOUBLES_EQUAL(0, scope_read(&s, 0, 0), 0);
+}
+
+TEST(Scope, Divider)
+{
+    scope_arm(&s, 2, 0, 3, SCOPE_TRIGGER_MANUAL, 0);
+    scope_force_trigger(&s);
+    feed(0, 10000, 0);
+    DOUBLES_EQUAL(2, scope_read(&s, 0, 0), 0);
+    DOUBLES_EQUAL(5, scope_read(&s, 1, 0), 0);
+}
+
+TEST(Scope, RearmStartsNewCapture)
+{
+    scope_arm(&s, 1, 0, 1, SCOPE_TRIGGER_MANUAL, 0);
+    uint32_t sequence = s.sequence;
+    scope_force_trigger(&s);
+    feed(0, 10000, 0);
+    scope_arm(&s, 1, 0, 1, SCOPE_TRIGGER_MANUAL, 0);
+    CHECK_EQUAL(SCOPE_ARMED, scope_get_state(&s));
+    CHECK_EQUAL(sequence + 1, s.sequence);
+    feed(0, 10, 0);
+    CHECK_EQUAL(SCOPE_ARMED, scope_get_state(&s));
+}
@@ -0,0 +1,37 @@
+#include "CppUTest/TestHarness.h"
+#include "../src/seqlock.h"
+
+
+TEST_GROUP(Seqlock)
+{
+    seqlock_t lock;
+
+    void setup(void)
+    {
+        seqlock_init(&lock);
+    }
+};
+
+TEST(Seqlock, ReadWithoutWriter)
+{
+    uint32_t s = seqlock_read_begin(&lock);
+    CHECK_FALSE(seqlock_read_retry(&lock, s));
+}
+
+TEST(Seqlock, RetryDuringWrite)
+{
+    seqlock_write_begin(&lock);
+    uint32_t s = seqlock_read_begin(&lock);
+    CHECK_TRUE(seqlock_read_retry(&lock, s));
+    seqlock_write_end(&lock);
+    s = seqlock_read_begin(&lock);
+    CHECK_FALSE(seqlock_read_retry(&lock, s));
+}
+
+TEST(Seqlock, RetryIfWrittenWhileReading)
+{
+    uint32_t s = seqlock_read_begin(&lock);
+    seqlock_write_begin(&lock);
+    seqlock_write_end(&lock);
+    CHECK_TRUE(seqlock_read_retry(&lock, s));
+}
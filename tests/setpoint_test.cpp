@@ -107,6 +107,34 @@ TEST(Setpoint, UpdatePosition)
     // TODO
 }
 
+TEST(Setpoint, VelocityModeAcceleration)
+{
+    setpoint_update_velocity(&interpolator, 1, 0);
+    setpoint_compute(&interpolator, &setpoint, 0.01);
+    DOUBLES_EQUAL(acc_limit, setpoint.acceleration_setpt, 1e-4);
+    DOUBLES_EQUAL(0.1, setpoint.velocity_setpt, FLOAT_TOLERANCE);
+    // target reached, no more acceleration
+    setpoint_compute(&interpolator, &setpoint, 0.1);
+    DOUBLES_EQUAL(9, setpoint.acceleration_setpt, 1e-4);
+    setpoint_compute(&interpolator, &setpoint, 0.1);
+    DOUBLES_EQUAL(0, setpoint.acceleration_setpt, FLOAT_TOLERANCE);
+}
+
+TEST(Setpoint, PositionModeAcceleration)
+{
+    setpoint_update_position(&interpolator, 1, 0, 0);
+    setpoint_compute(&interpolator, &setpoint, 0.01);
+    DOUBLES_EQUAL(acc_limit, setpoint.acceleration_setpt, FLOAT_TOLERANCE);
+}
+
+TEST(Setpoint, TorqueModeHasNoAcceleration)
+{
+    setpoint_update_torque(&interpolator, 0.2);
+    setpoint_compute(&interpolator, &setpoint, 0.01);
+    DOUBLES_EQUAL(0, setpoint.acceleration_setpt, FLOAT_TOLERANCE);
+    DOUBLES_EQUAL(0.2, setpoint.feedforward_torque, FLOAT_TOLERANCE);
+}
+
 TEST_GROUP(SetpointInterpolation)
 {
 
@@ -280,3 +308,140 @@ TEST(SetpointVelocityRamp, Overshot)
                   vel_ramp(pos, vel, target_pos, delta_t, max_vel, max_acc),
                   FLOAT_TOLERANCE);
 }
+
+TEST_GROUP(SetpointTrajectoryBuffer)
+{
+    setpoint_interpolator_t ip;
+    trajectory_buffer_t buffer;
+    struct setpoint_s setpts;
+
+    void setup(void)
+    {
+        setpoint_init(&ip);
+        setpoint_set_acceleration_limit(&ip, 10);
+        setpoint_set_velocity_limit(&ip, 2);
+        trajectory_buffer_init(&buffer);
+        setpoint_set_trajectory_buffer(&ip, &buffer);
+    }
+
+    void push(timestamp_t time, float pos, float vel, float acc)
+    {
+        struct trajectory_point_s p = {time, pos, vel, acc, 0.1f};
+        CHECK_TRUE(trajectory_buffer_push(&buffer, &p));
+    }
+};
+
+TEST(SetpointTrajectoryBuffer, SegmentMatchesEndPoints)
+{
+    struct trajectory_point_s p0 = {1000, 1, 2, 3, 0};
+    struct trajectory_point_s p1 = {101000, 1.5, -1, 4, 0};
+    float pos, vel, acc;
+    trajectory_segment_interpolation(&p0, &p1, 0, &pos, &vel, &acc);
+    DOUBLES_EQUAL(1, pos, 1e-5);
+    DOUBLES_EQUAL(2, vel, 1e-4);
+    DOUBLES_EQUAL(3, acc, 1e-3);
+    trajectory_segment_interpolation(&p0, &p1, 0.1, &pos, &vel, &acc);
+    DOUBLES_EQUAL(1.5, pos, 1e-5);
+    DOUBLES_EQUAL(-1, vel, 1e-4);
+    DOUBLES_EQUAL(4, acc, 1e-3);
+}
+
+TEST(SetpointTrajectoryBuffer, SegmentIsExactForQuintic)
+{
+    // constant acceleration trajectory x = t^2
+    struct trajectory_point_s p0 = {0, 0, 0, 2, 0};
+    struct trajectory_point_s p1 = {200000, 0.04, 0.4, 2, 0};
+    float pos, vel, acc;
+    trajectory_segment_interpolation(&p0, &p1, 0.05, &pos, &vel, &acc);
+    DOUBLES_EQUAL(0.0025, pos, 1e-6);
+    DOUBLES_EQUAL(0.1, vel, 1e-5);
+    DOUBLES_EQUAL(2, acc, 1e-3);
+}
+
+TEST(SetpointTrajectoryBuffer, WaitsForFirstPoint)
+{
+    push(10000, 1, 0, 0);
+    CHECK_FALSE(trajectory_buffer_ready(&ip, 9999));
+    CHECK_TRUE(trajectory_buffer_ready(&ip, 10000));
+}
+
+TEST(SetpointTrajectoryBuffer, InterpolatesBetweenPoints)
+{
+    push(0, 0, 1, 0);
+    push(100000, 0.1, 1, 0);
+    push(200000, 0.2, 1, 0);
+    trajectory_buffer_compute(&ip, &setpts, 150000);
+    CHECK_TRUE(setpts.position_control_enabled);
+    CHECK_TRUE(setpts.velocity_control_enabled);
+    DOUBLES_EQUAL(0.15, setpts.position_setpt, 1e-6);
+    DOUBLES_EQUAL(1, setpts.velocity_setpt, 1e-5);
+    DOUBLES_EQUAL(0.1, setpts.feedforward_torque, 1e-6);
+    // the first segment is over
+    CHECK_EQUAL(2, trajectory_buffer_count(&buffer));
+}
+
+TEST(SetpointTrajectoryBuffer, UnderrunStops)
+{
+    push(0, 0, 1, 0);
+    push(100000, 0.1, 1, 0);
+    trajectory_buffer_compute(&ip, &setpts, 110000);
+    CHECK_EQUAL(1, ip.traj_underruns);
+    CHECK_EQUAL(SETPT_MODE_POS, ip.setpt_mode);
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+    DOUBLES_EQUAL(0.11, setpts.position_setpt, 1e-6);
+    // stops at the acceleration limit
+    DOUBLES_EQUAL(0.11 + 1 / 20.f, ip.target_pos, 1e-6);
+}
+
+TEST(SetpointTrajectoryBuffer, EndAtRestIsNoUnderrun)
+{
+    push(0, 0, 0, 0);
+    trajectory_buffer_compute(&ip, &setpts, 10);
+    CHECK_EQUAL(0, ip.traj_underruns);
+    CHECK_EQUAL(SETPT_MODE_POS, ip.setpt_mode);
+}
+
+TEST(SetpointTrajectoryBuffer, RestartFollowsQueuedPoints)
+{
+    push(0, 0, 1, 0);
+    push(100000, 0.1, 1, 0);
+    push(50000, 1, 0, 0); // new trajectory, earlier time base
+    push(150000, 1, 0, 0);
+    trajectory_buffer_compute(&ip, &setpts, 60000);
+    DOUBLES_EQUAL(0.06, setpts.position_setpt, 1e-6);
+    // the new trajectory takes over at the end of the old one
+    trajectory_buffer_compute(&ip, &setpts, 110000);
+    DOUBLES_EQUAL(1, setpts.position_setpt, 1e-6);
+    CHECK_EQUAL(0, ip.traj_underruns);
+}
+
+TEST(SetpointTrajectoryBuffer, OtherCommandDiscardsPoints)
+{
+    push(0, 0, 1, 0);
+    uint32_t mark = trajectory_buffer_mark(&buffer);
+    setpoint_discard_trajectory(&ip, mark);
+    setpoint_update_velocity(&ip, 1, 0);
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+}
+
+TEST(SetpointTrajectoryBuffer, PointsQueuedAfterCommandAreKept)
+{
+    push(0, 0, 1, 0);
+    uint32_t mark = trajectory_buffer_mark(&buffer);
+    push(100000, 0.1, 1, 0);
+    // the control loop applies the command after the second point arrived
+    setpoint_discard_trajectory(&ip, mark);
+    setpoint_update_velocity(&ip, 1, 0);
+    CHECK_EQUAL(1, trajectory_buffer_count(&buffer));
+    CHECK_EQUAL(100000, trajectory_buffer_peek(&buffer, 0)->time);
+}
+
+TEST(SetpointTrajectoryBuffer, EmptyBufferStops)
+{
+    ip.setpt_pos = 1;
+    ip.setpt_vel = 0;
+    trajectory_buffer_compute(&ip, &setpts, 0);
+    CHECK_EQUAL(SETPT_MODE_POS, ip.setpt_mode);
+    DOUBLES_EQUAL(1, setpts.position_setpt, 1e-6);
+    DOUBLES_EQUAL(0, setpts.feedforward_torque, 1e-6);
+}
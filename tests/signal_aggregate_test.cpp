@@ -0,0 +1,42 @@
+#include "CppUTest/TestHarness.h"
+#include <math.h>
+#include "../src/signal_aggregate.h"
+
+
+TEST_GROUP(SignalAggregate)
+{
+    struct signal_aggregate_s a;
+
+    void setup(void)
+    {
+        signal_aggregate_reset(&a);
+    }
+};
+
+TEST(SignalAggregate, Empty)
+{
+    CHECK_EQUAL(0, a.count);
+    DOUBLES_EQUAL(0, signal_aggregate_mean(&a), 0);
+}
+
+TEST(SignalAggregate, MinMaxMean)
+{
+    signal_aggregate_add(&a, 1);
+    signal_aggregate_add(&a, -3);
+    signal_aggregate_add(&a, 5);
+    CHECK_EQUAL(3, a.count);
+    DOUBLES_EQUAL(-3, a.min, 0);
+    DOUBLES_EQUAL(5, a.max, 0);
+    DOUBLES_EQUAL(1, signal_aggregate_mean(&a), 1e-6);
+}
+
+TEST(SignalAggregate, CatchesPeakBetweenReports)
+{
+    // 10Hz report of a 2kHz signal with a single cycle spike
+    int i;
+    for (i = 0; i < 200; i++) {
+        signal_aggregate_add(&a, i == 77 ? 12.f : 1.f + 0.1f * sinf(i));
+    }
+    DOUBLES_EQUAL(12, a.max, 0);
+    DOUBLES_EQUAL(1, signal_aggregate_mean(&a), 0.1);
+}
@@ -0,0 +1,226 @@
+#include "CppUTest/TestHarness.h"
+#include "../src/stream.h"
+
+#define TICK_FREQUENCY  25000.f     // PWM periods
+#define TICKS_PER_UPDATE 12         // control loop
+
+
+TEST_GROUP(StreamFrameCount)
+{
+};
+
+TEST(StreamFrameCount, SingleFrame)
+{
+    CHECK_EQUAL(1, stream_frame_count(0));
+    CHECK_EQUAL(1, stream_frame_count(7));
+}
+
+TEST(StreamFrameCount, MultiFrameWithCRC)
+{
+    CHECK_EQUAL(2, stream_frame_count(8));
+    CHECK_EQUAL(2, stream_frame_count(12));
+    CHECK_EQUAL(3, stream_frame_count(13));
+}
+
+
+TEST_GROUP(StreamScheduler)
+{
+    stream_config_t a, b;
+    stream_config_t *streams[2] = {&a, &b};
+    stream_scheduler_t sched;
+
+    void setup(void)
+    {
+        stream_init(&a, 4);
+        stream_init(&b, 4);
+        stream_scheduler_init(&sched, streams, 2, TICK_FREQUENCY, 10000);
+    }
+
+    // number of messages of a stream during duration [s]
+    int count_messages(stream_config_t *s, float duration)
+    {
+        int count = 0;
+        int i;
+        for (i = 0; i < duration * TICK_FREQUENCY / TICKS_PER_UPDATE; i++) {
+            stream_scheduler_tick(&sched, TICKS_PER_UPDATE);
+            if (stream_update(s)) {
+                count++;
+            }
+        }
+        return count;
+    }
+};
+
+TEST(StreamScheduler, DisabledIsNeverDue)
+{
+    stream_set_frequency(&sched, &a, 100);
+    CHECK_EQUAL(0, count_messages(&a, 1));
+}
+
+TEST(StreamScheduler, FractionalRateIsExact)
+{
+    // the spin loop prescaler rounded this to 33Hz
+    stream_set_frequency(&sched, &a, 30);
+    stream_enable(&sched, &a, true);
+    int count = count_messages(&a, 10);
+    CHECK(count >= 299 && count <= 301);
+}
+
+TEST(StreamScheduler, HighRate)
+{
+    stream_set_frequency(&sched, &a, 1000);
+    stream_enable(&sched, &a, true);
+    int count = count_messages(&a, 1);
+    CHECK(count >= 999 && count <= 1001);
+}
+
+TEST(StreamScheduler, RateIsLimited)
+{
+    stream_set_frequency(&sched, &a, 5000);
+    stream_enable(&sched, &a, true);
+    DOUBLES_EQUAL(STREAM_MAX_FREQUENCY, stream_get_frequency(&sched, &a), 0.01);
+}
+
+TEST(StreamScheduler, PhaseOffset)
+{
+    stream_set_frequency(&sched, &a, 10);
+    stream_set_frequency(&sched, &b, 10);
+    stream_enable(&sched, &a, true);
+    stream_enable(&sched, &b, true);
+    int i;
+    for (i = 0; i < TICK_FREQUENCY / TICKS_PER_UPDATE; i++) {
+        stream_scheduler_tick(&sched, TICKS_PER_UPDATE);
+        bool a_due = stream_update(&a);
+        bool b_due = stream_update(&b);
+        CHECK_FALSE(a_due && b_due);
+    }
+}
+
+TEST(StreamScheduler, NoBurstAfterGap)
+{
+    stream_set_frequency(&sched, &a, 100);
+    stream_enable(&sched, &a, true);
+    stream_scheduler_tick(&sched, TICK_FREQUENCY); // 1s without update
+    CHECK_TRUE(stream_update(&a));
+    CHECK_FALSE(stream_update(&a));
+}
+
+TEST(StreamScheduler, BudgetScalesRates)
+{
+    stream_config_t big;
+    stream_config_t *all[3] = {&a, &b, &big};
+    stream_init(&big, 20);  // 4 frames
+    stream_scheduler_init(&sched, all, 3, TICK_FREQUENCY, 2000);
+    stream_set_frequency(&sched, &a, 1000);
+    stream_set_frequency(&sched, &big, 500);
+    stream_enable(&sched, &a, true);
+    stream_enable(&sched, &big, true);
+
+    // 1000 + 500 * 4 frames/s for a budget of 2000
+    DOUBLES_EQUAL(666.7, stream_get_frequency(&sched, &a), 0.1);
+    DOUBLES_EQUAL(333.3, stream_get_frequency(&sched, &big), 0.1);
+
+    stream_enable(&sched, &big, false);
+    DOUBLES_EQUAL(1000, stream_get_frequency(&sched, &a), 0.01);
+}
+
+TEST(StreamScheduler, ReservedFramesReduceTheBudget)
+{
+    stream_scheduler_init(&sched, streams, 2, TICK_FREQUENCY, 2000);
+    stream_set_frequency(&sched, &a, 1000);
+    stream_enable(&sched, &a, true);
+    stream_scheduler_reserve(&sched, 1500);
+    DOUBLES_EQUAL(500, stream_get_frequency(&sched, &a), 0.01);
+    stream_scheduler_reserve(&sched, 0);
+    DOUBLES_EQUAL(1000, stream_get_frequency(&sched, &a), 0.01);
+}
+
+
+TEST_GROUP(StreamDeadband)
+{
+    stream_config_t s;
+    stream_config_t *streams[1] = {&s};
+    stream_scheduler_t sched;
+
+    void setup(void)
+    {
+        stream_init(&s, 4);
+        stream_scheduler_init(&sched, streams, 1, TICK_FREQUENCY, 10000);
+        stream_set_frequency(&sched, &s, 100);
+        stream_enable(&sched, &s, true);
+        stream_set_deadband(&sched, &s, 0.5, 1);
+    }
+
+    // one period of the stream
+    bool period(float value)
+    {
+        stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+        return stream_update_value(&s, value);
+    }
+};
+
+TEST(StreamDeadband, FirstMessageIsSent)
+{
+    CHECK_TRUE(period(10));
+}
+
+TEST(StreamDeadband, SilentWhileStationary)
+{
+    period(10);
+    CHECK_FALSE(period(10.2));
+    CHECK_FALSE(period(9.6));
+}
+
+TEST(StreamDeadband, SentOnChange)
+{
+    period(10);
+    CHECK_FALSE(period(10.3));
+    CHECK_TRUE(period(10.6));   // moved from the last message, not the last sample
+    CHECK_FALSE(period(10.6));
+}
+
+TEST(StreamDeadband, MaximumInterval)
+{
+    period(10);
+    int i;
+    for (i = 0; i < 99; i++) {
+        CHECK_FALSE(period(10));
+    }
+    CHECK_TRUE(period(10));
+}
+
+TEST(StreamDeadband, MinimumIntervalIsTheStreamPeriod)
+{
+    period(10);
+    stream_scheduler_tick(&sched, 1);
+    CHECK_FALSE(stream_update_value(&s, 20));
+}
+
+TEST(StreamDeadband, CounterUsesExactDifference)
+{
+    // a float has no unit step left at this magnitude
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_TRUE(stream_update_count(&s, 100000000));
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_TRUE(stream_update_count(&s, 100000001));
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_FALSE(stream_update_count(&s, 100000001));
+}
+
+TEST(StreamDeadband, CounterWrapsAround)
+{
+    stream_set_deadband(&sched, &s, 2, 1);
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_TRUE(stream_update_count(&s, 0xffffffff));
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_FALSE(stream_update_count(&s, 1));
+    stream_scheduler_tick(&sched, TICK_FREQUENCY / 100);
+    CHECK_TRUE(stream_update_count(&s, 2));
+}
+
+TEST(StreamDeadband, ZeroIsPeriodic)
+{
+    stream_set_deadband(&sched, &s, 0, 0);
+    period(10);
+    CHECK_TRUE(period(10));
+}
@@ -0,0 +1,121 @@
+#include "CppUTest/TestHarness.h"
+#include <math.h>
+#include "../src/telemetry_batch.h"
+
+
+TEST_GROUP(TelemetryBatchChannel)
+{
+    telemetry_batch_channel_t c;
+
+    void setup(void)
+    {
+        telemetry_batch_channel_init(&c);
+    }
+
+    bool fill(float offset)
+    {
+        bool full = false;
+        int i;
+        for (i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+            full = telemetry_batch_add(&c, offset + i, 1000 + i);
+        }
+        return full;
+    }
+};
+
+TEST(TelemetryBatchChannel, EmptyUntilFull)
+{
+    telemetry_batch_add(&c, 1, 0);
+    POINTERS_EQUAL(NULL, telemetry_batch_get(&c));
+}
+
+TEST(TelemetryBatchChannel, FullBatch)
+{
+    CHECK_TRUE(fill(0));
+    const telemetry_batch_t *batch = telemetry_batch_get(&c);
+    CHECK(batch != NULL);
+    CHECK_EQUAL(1000, batch->timestamp);
+    DOUBLES_EQUAL(TELEMETRY_BATCH_SIZE - 1, batch->samples[TELEMETRY_BATCH_SIZE - 1], 0);
+    telemetry_batch_release(&c);
+    POINTERS_EQUAL(NULL, telemetry_batch_get(&c));
+}
+
+TEST(TelemetryBatchChannel, FillsOtherBufferWhileSending)
+{
+    fill(0);
+    const telemetry_batch_t *batch = telemetry_batch_get(&c);
+    telemetry_batch_add(&c, 100, 0);
+    DOUBLES_EQUAL(0, batch->samples[0], 0);
+}
+
+TEST(TelemetryBatchChannel, OverrunDropsNewBatch)
+{
+    fill(0);
+    CHECK_FALSE(fill(100));
+    CHECK_EQUAL(1, c.overruns);
+    DOUBLES_EQUAL(0, telemetry_batch_get(&c)->samples[0], 0);
+    telemetry_batch_release(&c);
+    CHECK_TRUE(fill(200));
+    DOUBLES_EQUAL(200, telemetry_batch_get(&c)->samples[0], 0);
+}
+
+TEST(TelemetryBatchChannel, RestartKeepsConfigurationOfReadyBatch)
+{
+    telemetry_batch_restart(&c, 3, 0.001f);
+    fill(0);
+    telemetry_batch_restart(&c, 5, 0.002f);
+    const telemetry_batch_t *batch = telemetry_batch_get(&c);
+    CHECK_EQUAL(3, batch->signal);
+    DOUBLES_EQUAL(0.001f, batch->sample_period, 0);
+    telemetry_batch_release(&c);
+    fill(0);
+    batch = telemetry_batch_get(&c);
+    CHECK_EQUAL(5, batch->signal);
+    DOUBLES_EQUAL(0.002f, batch->sample_period, 0);
+}
+
+
+TEST_GROUP(TelemetryBatchPack)
+{
+    telemetry_batch_t batch;
+    struct telemetry_batch_packed_s packed;
+
+    float max_error(void)
+    {
+        float error = 0;
+        unsigned i;
+        telemetry_batch_pack(&batch, &packed);
+        for (i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+            error = fmaxf(error, fabsf(telemetry_batch_unpack(&packed, i) - batch.samples[i]));
+        }
+        return error;
+    }
+};
+
+TEST(TelemetryBatchPack, Constant)
+{
+    unsigned i;
+    for (i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+        batch.samples[i] = 3.5;
+    }
+    DOUBLES_EQUAL(0, max_error(), 0);
+}
+
+TEST(TelemetryBatchPack, ErrorDoesNotAccumulate)
+{
+    unsigned i;
+    for (i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+        batch.samples[i] = 100 + 0.3f * i + 0.01f * sinf(i);
+    }
+    // half a quantization step of the largest step
+    CHECK(max_error() < 0.32f / 32000 + 1e-5f);
+}
+
+TEST(TelemetryBatchPack, Step)
+{
+    unsigned i;
+    for (i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+        batch.samples[i] = i < 20 ? -2.f : 5.f;
+    }
+    CHECK(max_error() < 1e-3f);
+}
@@ -0,0 +1,48 @@
+#include "CppUTest/TestHarness.h"
+#include "../src/time_sync.h"
+
+
+TEST_GROUP(TimeSync)
+{
+    time_sync_t ts;
+
+    void setup(void)
+    {
+        time_sync_init(&ts);
+    }
+};
+
+TEST(TimeSync, InvalidUntilUpdated)
+{
+    CHECK_FALSE(time_sync_is_valid(&ts));
+    time_sync_update(&ts, 1000000, 42);
+    CHECK_TRUE(time_sync_is_valid(&ts));
+}
+
+TEST(TimeSync, NetworkClockNotSet)
+{
+    time_sync_update(&ts, 1000000, 42);
+    time_sync_update(&ts, 0, 43);
+    CHECK_FALSE(time_sync_is_valid(&ts));
+}
+
+TEST(TimeSync, ToLocal)
+{
+    time_sync_update(&ts, 1500000000000000ULL, 1000);
+    CHECK_EQUAL(1000, time_sync_to_local(&ts, 1500000000000000ULL));
+    CHECK_EQUAL(21000, time_sync_to_local(&ts, 1500000000020000ULL));
+    CHECK_EQUAL(500, time_sync_to_local(&ts, 1500000000000000ULL - 500));
+}
+
+TEST(TimeSync, ToLocalWraps)
+{
+    time_sync_update(&ts, 1500000000000000ULL, 0xffffff00);
+    CHECK_EQUAL(0x100, time_sync_to_local(&ts, 1500000000000000ULL + 0x200));
+}
+
+TEST(TimeSync, ToNetwork)
+{
+    time_sync_update(&ts, 1500000000000000ULL, 0xffffff00);
+    CHECK(1500000000000000ULL + 0x200 == time_sync_to_network(&ts, 0x100));
+    CHECK(1500000000000000ULL - 0x100 == time_sync_to_network(&ts, 0xfffffe00));
+}
@@ -0,0 +1,122 @@
+#include "CppUTest/TestHarness.h"
+#include <thread>
+#include "../src/trajectory_buffer.h"
+
+
+static struct trajectory_point_s make_point(uint32_t i)
+{
+    struct trajectory_point_s p;
+    p.time = i;
+    p.position = i;
+    p.velocity = 2.f * i;
+    p.acceleration = -1.f * i;
+    p.torque = 0.5f * i;
+    return p;
+}
+
+static bool point_is_consistent(const struct trajectory_point_s *p, uint32_t i)
+{
+    return p->time == i
+        && p->position == (float)i
+        && p->velocity == 2.f * i
+        && p->acceleration == -1.f * i
+        && p->torque == 0.5f * i;
+}
+
+
+TEST_GROUP(TrajectoryBuffer)
+{
+    trajectory_buffer_t buffer;
+
+    void setup(void)
+    {
+        trajectory_buffer_init(&buffer);
+    }
+};
+
+TEST(TrajectoryBuffer, EmptyAfterInit)
+{
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+    POINTERS_EQUAL(NULL, trajectory_buffer_peek(&buffer, 0));
+}
+
+TEST(TrajectoryBuffer, FirstInFirstOut)
+{
+    struct trajectory_point_s p1 = make_point(1), p2 = make_point(2);
+    CHECK_TRUE(trajectory_buffer_push(&buffer, &p1));
+    CHECK_TRUE(trajectory_buffer_push(&buffer, &p2));
+    CHECK_EQUAL(2, trajectory_buffer_count(&buffer));
+    CHECK_TRUE(point_is_consistent(trajectory_buffer_peek(&buffer, 0), 1));
+    CHECK_TRUE(point_is_consistent(trajectory_buffer_peek(&buffer, 1), 2));
+    POINTERS_EQUAL(NULL, trajectory_buffer_peek(&buffer, 2));
+    trajectory_buffer_pop(&buffer);
+    CHECK_TRUE(point_is_consistent(trajectory_buffer_peek(&buffer, 0), 2));
+}
+
+TEST(TrajectoryBuffer, Full)
+{
+    unsigned i;
+    for (i = 0; i < TRAJECTORY_BUFFER_SIZE; i++) {
+        struct trajectory_point_s p = make_point(i);
+        CHECK_TRUE(trajectory_buffer_push(&buffer, &p));
+    }
+    struct trajectory_point_s p = make_point(i);
+    CHECK_FALSE(trajectory_buffer_push(&buffer, &p));
+    trajectory_buffer_pop(&buffer);
+    CHECK_TRUE(trajectory_buffer_push(&buffer, &p));
+    CHECK_TRUE(point_is_consistent(trajectory_buffer_peek(&buffer, TRAJECTORY_BUFFER_SIZE - 1), i));
+}
+
+TEST(TrajectoryBuffer, Flush)
+{
+    struct trajectory_point_s p = make_point(1);
+    trajectory_buffer_push(&buffer, &p);
+    trajectory_buffer_push(&buffer, &p);
+    trajectory_buffer_flush(&buffer);
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+    trajectory_buffer_pop(&buffer);
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+}
+
+TEST(TrajectoryBuffer, DiscardUntilMark)
+{
+    struct trajectory_point_s p1 = make_point(1), p2 = make_point(2);
+    trajectory_buffer_push(&buffer, &p1);
+    uint32_t mark = trajectory_buffer_mark(&buffer);
+    trajectory_buffer_push(&buffer, &p2);
+    trajectory_buffer_discard_until(&buffer, mark);
+    CHECK_EQUAL(1, trajectory_buffer_count(&buffer));
+    CHECK_TRUE(point_is_consistent(trajectory_buffer_peek(&buffer, 0), 2));
+    // a mark the consumer already passed is ignored
+    trajectory_buffer_pop(&buffer);
+    trajectory_buffer_discard_until(&buffer, mark);
+    CHECK_EQUAL(0, trajectory_buffer_count(&buffer));
+}
+
+TEST(TrajectoryBuffer, ConcurrentProducerConsumer)
+{
+    const uint32_t nb_points = 200000;
+    std::thread producer([&]() {
+        uint32_t i = 0;
+        while (i < nb_points) {
+            struct trajectory_point_s p = make_point(i);
+            if (trajectory_buffer_push(&buffer, &p)) {
+                i++;
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    bool consistent = true;
+    while (expected < nb_points) {
+        const struct trajectory_point_s *p = trajectory_buffer_peek(&buffer, 0);
+        if (p == NULL) {
+            continue;
+        }
+        consistent = consistent && point_is_consistent(p, expected);
+        trajectory_buffer_pop(&buffer);
+        expected++;
+    }
+    producer.join();
+    CHECK_TRUE(consistent);
+}
@@ -0,0 +1,181 @@
+#include "CppUTest/TestHarness.h"
+#include <math.h>
+#include "../src/velocity_estimator.h"
+
+#define SAMPLE_FREQUENCY 25000.f    // PWM rate
+#define CONTROL_DIVIDER 12          // velocity loop rate = 25kHz / 12
+#define TIME_LSB (1 / SAMPLE_FREQUENCY)
+
+
+TEST_GROUP(EncoderEdge)
+{
+};
+
+TEST(EncoderEdge, KeepsTimeOfLastChange)
+{
+    struct encoder_edge_s edge = {0, 0};
+    encoder_edge_sample(&edge, 5, 10);
+    encoder_edge_sample(&edge, 5, 11);
+    encoder_edge_sample(&edge, 5, 12);
+    CHECK_EQUAL(5, edge.count);
+    CHECK_EQUAL(10, edge.time);
+    encoder_edge_sample(&edge, 4, 13);
+    CHECK_EQUAL(4, edge.count);
+    CHECK_EQUAL(13, edge.time);
+}
+
+
+TEST_GROUP(VelocityEstimator)
+{
+    velocity_estimator_t est;
+    struct encoder_edge_s edge;
+
+    void setup(void)
+    {
+        velocity_estimator_reset(&est);
+        edge.count = 100;
+        edge.time = 0;
+        velocity_estimator_update(&est, &edge, 0, TIME_LSB);
+    }
+};
+
+TEST(VelocityEstimator, ZeroUntilFirstUpdate)
+{
+    velocity_estimator_reset(&est);
+    edge.count = 200;
+    edge.time = 50;
+    DOUBLES_EQUAL(0, velocity_estimator_update(&est, &edge, 60, TIME_LSB), 0);
+}
+
+TEST(VelocityEstimator, CountsBetweenEdges)
+{
+    edge.count = 103;
+    edge.time = 250;    // 10ms
+    DOUBLES_EQUAL(300, velocity_estimator_update(&est, &edge, 260, TIME_LSB), 1e-3);
+}
+
+TEST(VelocityEstimator, Reverse)
+{
+    edge.count = 98;
+    edge.time = 250;
+    DOUBLES_EQUAL(-200, velocity_estimator_update(&est, &edge, 250, TIME_LSB), 1e-3);
+}
+
+TEST(VelocityEstimator, EncoderOverflow)
+{
+    velocity_estimator_reset(&est);
+    edge.count = 65535;
+    velocity_estimator_update(&est, &edge, 0, TIME_LSB);
+    edge.count = 1;
+    edge.time = 50;
+    DOUBLES_EQUAL(1000, velocity_estimator_update(&est, &edge, 50, TIME_LSB), 1e-3);
+}
+
+TEST(VelocityEstimator, DecaysWithoutEdges)
+{
+    edge.count = 110;
+    edge.time = 25;     // 10 counts in 1ms
+    DOUBLES_EQUAL(10000, velocity_estimator_update(&est, &edge, 25, TIME_LSB), 1e-1);
+    // no edge for 1ms, then 2ms
+    DOUBLES_EQUAL(1000, velocity_estimator_update(&est, &edge, 50, TIME_LSB), 1e-3);
+    DOUBLES_EQUAL(500, velocity_estimator_update(&est, &edge, 75, TIME_LSB), 1e-3);
+}
+
+TEST(VelocityEstimator, ZeroAfterTimeout)
+{
+    edge.count = 101;
+    edge.time = 25;
+    velocity_estimator_update(&est, &edge, 25, TIME_LSB);
+    uint32_t now = 25 + VELOCITY_ESTIMATOR_TIMEOUT * SAMPLE_FREQUENCY;
+    DOUBLES_EQUAL(0, velocity_estimator_update(&est, &edge, now, TIME_LSB), 0);
+    // first edge after standing still is at most one count per timeout
+    edge.count = 102;
+    edge.time = now + 1000;
+    float v = velocity_estimator_update(&est, &edge, now + 1000, TIME_LSB);
+    CHECK(v > 0);
+    CHECK(v <= 1 / VELOCITY_ESTIMATOR_TIMEOUT);
+}
+
+
+/*
+ * Compares the edge timing estimator to the encoder delta, raw and with the
+ * 0.9/0.1 IIR of the control loop, on an encoder sampled at the PWM rate.
+ */
+TEST_GROUP(VelocityEstimatorBenchmark)
+{
+    float delta_rms_error;
+    float iir_rms_error;
+    float iir_lag;      // [s]
+    float edge_rms_error;
+    float edge_lag;
+
+    // position in counts = v0 * t + a * t^2 / 2, statistics after 0.1s
+    void compare(float v0, float a, float duration)
+    {
+        velocity_estimator_t est;
+        velocity_estimator_reset(&est);
+        struct encoder_edge_s edge = {0, 0};
+        const float delta_t = CONTROL_DIVIDER / SAMPLE_FREQUENCY;
+        uint16_t previous = 0;
+        float iir = v0;
+        double delta_sq = 0, iir_sq = 0, iir_sum = 0, edge_sq = 0, edge_sum = 0;
+        int n = 0;
+        uint32_t i;
+        for (i = 0; i < duration * SAMPLE_FREQUENCY; i++) {
+            double t = i / (double)SAMPLE_FREQUENCY;
+            uint16_t count = (uint16_t)(int64_t)floor(v0 * t + a * t * t / 2);
+            encoder_edge_sample(&edge, count, i);
+            if (i % CONTROL_DIVIDER != 0) {
+                continue;
+            }
+            float delta = (int16_t)(count - previous) / delta_t;
+            previous = count;
+            iir = iir * 0.9f + delta * 0.1f;
+            float v = velocity_estimator_update(&est, &edge, i, TIME_LSB);
+            if (t < 0.1) {
+                continue;
+            }
+            float truth = v0 + a * t;
+            delta_sq += (truth - delta) * (truth - delta);
+            iir_sum += truth - iir;
+            iir_sq += (truth - iir) * (truth - iir);
+            edge_sum += truth - v;
+            edge_sq += (truth - v) * (truth - v);
+            n++;
+        }
+        delta_rms_error = sqrt(delta_sq / n);
+        iir_rms_error = sqrt(iir_sq / n);
+        edge_rms_error = sqrt(edge_sq / n);
+        if (a != 0) {
+            iir_lag = iir_sum / n / a;
+            edge_lag = edge_sum / n / a;
+        }
+    }
+};
+
+TEST(VelocityEstimatorBenchmark, LowSpeedNoise)
+{
+    // 300 counts/s, 0.14 counts per control period
+    compare(300, 0, 1);
+    CHECK(edge_rms_error < 3);      // 1%, the IIR has ~60
+    CHECK(edge_rms_error < iir_rms_error / 10);
+}
+
+TEST(VelocityEstimatorBenchmark, HighSpeedNoise)
+{
+    // 48 counts per control period, limited by the count resolution like the
+    // raw delta, the IIR trades this for lag
+    compare(100000, 0, 0.5);
+    CHECK(edge_rms_error <= delta_rms_error);
+    CHECK(edge_rms_error < 1000);   // 1%
+}
+
+TEST(VelocityEstimatorBenchmark, AccelerationLag)
+{
+    compare(2000, 100000, 0.5);
+    // the IIR lags by about 10 control periods, ~5ms
+    CHECK(iir_lag > 0.004);
+    // the edge timing by half a control period
+    CHECK(edge_lag < 0.0005);
+    CHECK(edge_rms_error < delta_rms_error);
+}